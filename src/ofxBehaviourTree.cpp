@@ -1,4 +1,11 @@
 #include "ofxBehaviourTree.h"
+#include "ofxBehaviourTreePool.h"
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <cstdlib>
+#include <unordered_map>
 
 namespace {
     using Blackboard = ofxAI::BehaviourTree::Blackboard;
@@ -6,6 +13,10 @@ namespace {
     using Tree = ofxAI::BehaviourTree::Tree;
     using Status = ofxAI::BehaviourTree::Status;
     using NodeScope = ofxAI::BehaviourTree::NodeScope;
+    using FactId = ofxAI::BehaviourTree::FactId;
+    using FactTable = ofxAI::BehaviourTree::FactTable;
+    using Value = ofxAI::BehaviourTree::Value;
+    using LeafParams = ofxAI::BehaviourTree::LeafParams;
     using NodePtr = BaseNode::NodePtr;
 
     
@@ -16,37 +27,49 @@ namespace {
     }
 
 
-    // default blackboard implementation - a plain dictionary-backed blackboard
-    class DictBlackboard : public Blackboard {
-    public:
-        virtual void setFact(const std::string& factName, const std::string& data) override {
-            m_dict[factName] = data;
-        }
-        virtual bool getFact(const std::string& fact, std::string& factData) const override {
-            auto found = m_dict.find(fact);
-            if (found == m_dict.end())
-                return false;
-            factData = found->second;
-            return true;
-        }
-        virtual void removeFact(const std::string& factName) override {
-            m_dict.erase(factName);
-        }
-        virtual bool factExists(const std::string& factName) const override {
-            return m_dict.find(factName) != m_dict.end();
-        }
+    // process-wide fact name <-> ID table. Names are only ever appended,
+    // into chunks that never move, so they are read without the lock:
+    // a name is visible once 'count' has been published past it. Chunk
+    // c holds FirstChunk << c names, enough chunks for every FactId.
+    struct FactSymbols {
+        static const size_t FirstChunk = 64;
+        static const size_t Chunks = 27;
 
-    protected:
-        std::map<std::string, std::string> m_dict;
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, FactId> ids;
+        std::unique_ptr<std::string[]> chunks[Chunks];
+        std::atomic<size_t> count{ 0 };
+
+        static void locate(size_t fact, size_t& chunk, size_t& offset) {
+            chunk = 0;
+            for (size_t index = fact / FirstChunk + 1; index > 1; index >>= 1)
+                chunk++;
+            offset = fact - FirstChunk * ((size_t(1) << chunk) - 1);
+        }
     };
 
-    
+    FactSymbols& factSymbols() {
+        static FactSymbols symbols;
+        return symbols;
+    }
+
+    // scope (#) and indirect (@) references can only be resolved at tick time
+    inline bool isLiteralFact(const std::string& factName) {
+        return !factName.empty() && factName[0] != '#' && factName[0] != '@';
+    }
+
+    inline FactId internLiteral(const std::string& factName) {
+        return isLiteralFact(factName)
+            ? FactTable::intern(factName)
+            : ofxAI::BehaviourTree::InvalidFact;
+    }
+
 
     // generic leaf node, runs a function object on tick
     class LeafNode : public BaseNode {
     public:
-        LeafNode(std::string const & ref, NodeTick tick, const std::vector<std::string>& params)
-            : BaseNode(ref), m_tick(tick), m_params(params) {}
+        LeafNode(std::string const & ref, NodeTick tick, std::vector<std::string> params)
+            : BaseNode(ref), m_tick(tick), m_params(std::move(params)) {}
         virtual Status tick(Tree* tree) override {
             if (!m_tick)
                 return Status::Invalid;
@@ -57,11 +80,24 @@ namespace {
         std::vector<std::string> m_params;
     };
 
+    // leaf node with params parsed when it was built
+    class ParamLeafNode : public BaseNode {
+    public:
+        ParamLeafNode(std::string const & ref, NodeParamTick tick, LeafParams params)
+            : BaseNode(ref), m_tick(tick), m_params(std::move(params)) {}
+        virtual Status tick(Tree* tree) override {
+            return m_tick(tree, m_params);
+        }
+    protected:
+        NodeParamTick m_tick;
+        LeafParams m_params;
+    };
+
     // generic decorator node, runs a filter on the return value for 
     class DecoratorNode : public BaseNode {
     public:
-        DecoratorNode(std::string const & ref, NodeDecorate tick, const std::vector<std::string>& params, NodePtr child)
-            : BaseNode(ref), m_tick(tick), m_params(params), m_child(std::move(child)) {}
+        DecoratorNode(std::string const & ref, NodeDecorate tick, std::vector<std::string> params, NodePtr child)
+            : BaseNode(ref), m_tick(tick), m_child(std::move(child)), m_params(std::move(params)) {}
         virtual Status tick(Tree* tree) override {
             return m_tick(tree, m_child.get(), m_params);
         }
@@ -86,7 +122,7 @@ namespace {
                 if (status != Status::Failure)
                     return status;
             }
-            return Status::Success;
+            return Status::Failure;
         }
     protected:
         NodeVector m_children;
@@ -113,29 +149,63 @@ namespace {
         NodeVector m_children;
     };
 
+    // outcome of a Parallel node given how its children finished so far
+    inline Status parallelStatus(size_t nSuccess, size_t nFailure, size_t count, size_t successThreshold, size_t failureThreshold) {
+        if (nSuccess >= successThreshold)
+            return Status::Success;
+        if (nFailure >= failureThreshold)
+            return Status::Failure;
+        if (nSuccess + nFailure == count)
+            return Status::Failure;
+        return Status::Running;
+    }
+
     class ParallelNode : public BaseNode {
     public:
-        ParallelNode(std::string const & ref, size_t threshold, NodeVector& children)
+        ParallelNode(std::string const & ref, size_t successThreshold, size_t failureThreshold, NodeVector& children)
             : BaseNode(ref)
             , m_children(std::move(children))
-            , m_threshold(threshold)
+            , m_successThreshold(successThreshold)
+            , m_failureThreshold(failureThreshold)
+            , m_finished(m_children.size(), Status::Invalid)
         {}
         ParallelNode(std::string const & ref, NodeVector& children)
-            : ParallelNode(ref, children.size() - 1, children) {
+            : ParallelNode(ref, children.size(), 1, children) {
         }
         virtual Status tick(Tree* tree) override {
-            
-            return Status();
+            if (m_children.empty())
+                return Status::Invalid;
+            size_t nSuccess = 0;
+            size_t nFailure = 0;
+            bool invalid = false;
+            for (size_t i = 0; i < m_children.size(); i++) {
+                if (m_finished[i] == Status::Invalid) {
+                    auto status = m_children[i] ? m_children[i]->tick(tree) : Status::Invalid;
+                    if ((status == Status::Success) || (status == Status::Failure))
+                        m_finished[i] = status;
+                    invalid |= (status == Status::Invalid);
+                }
+                nSuccess += (m_finished[i] == Status::Success);
+                nFailure += (m_finished[i] == Status::Failure);
+            }
+            auto result = invalid
+                ? Status::Invalid
+                : parallelStatus(nSuccess, nFailure, m_children.size(), m_successThreshold, m_failureThreshold);
+            if (result != Status::Running)
+                std::fill(m_finished.begin(), m_finished.end(), Status::Invalid);
+            return result;
         }
     protected:
         NodeVector m_children;
-        size_t m_threshold;
+        size_t m_successThreshold;
+        size_t m_failureThreshold;
+        std::vector<Status> m_finished;
     };
 
     template <const Status status>
     class SimpleDecoratorNode : public BaseNode {
     public:
-        SimpleDecoratorNode(std::string const & ref, NodePtr& child)
+        SimpleDecoratorNode(std::string const & ref, NodePtr child)
             : BaseNode(ref), m_child(std::move(child)) {}
         virtual Status tick(Tree* tree) override {
             if (!m_child) return Status::Invalid;
@@ -151,20 +221,20 @@ namespace {
 
     class FalseDecoratorNode : public SimpleDecoratorNode<Status::Failure> {
     public:
-        FalseDecoratorNode(std::string const & ref, NodePtr& child)
-            : SimpleDecoratorNode(ref, child) {
+        FalseDecoratorNode(std::string const & ref, NodePtr child)
+            : SimpleDecoratorNode(ref, std::move(child)) {
         }
     };
     class TrueDecoratorNode : public SimpleDecoratorNode<Status::Success> {
     public:
-        TrueDecoratorNode(std::string const & ref, NodePtr& child)
-            : SimpleDecoratorNode(ref, child) {
+        TrueDecoratorNode(std::string const & ref, NodePtr child)
+            : SimpleDecoratorNode(ref, std::move(child)) {
         }
     };
 
     class NegateDecoratorNode : public BaseNode {
     public:
-        NegateDecoratorNode(std::string const & ref, NodePtr& child)
+        NegateDecoratorNode(std::string const & ref, NodePtr child)
             : BaseNode(ref), m_child(std::move(child)) {}
         virtual Status tick(Tree* tree) override {
             if (!m_child) return Status::Invalid;
@@ -232,73 +302,187 @@ namespace {
         }
     };
 
+    // operands of the built-in fact nodes - literal fact names are interned
+    // when the node is built, scope (#) and indirect (@) references are
+    // resolved on tick
+    struct FactOperands {
+        FactOperands(const std::string& factName, const std::string& factData = std::string(), const Value& value = Value())
+            : m_factName(factName)
+            , m_factData(factData)
+            , m_fact(internLiteral(factName))
+            , m_literalData(isLiteralFact(factData))
+            , m_value(value) {}
+
+        Status exists(Blackboard* blackboard) const {
+            bool found = (m_fact != ofxAI::BehaviourTree::InvalidFact)
+                ? blackboard->factExists(m_fact)
+                : blackboard->factExists(m_factName);
+            return found
+                ? Status::Success
+                : Status::Failure;
+        }
+        Status wait(Blackboard* blackboard) const {
+            return exists(blackboard) == Status::Success
+                ? Status::Success
+                : Status::Running;
+        }
+        Status remove(Blackboard* blackboard) const {
+            if (m_fact != ofxAI::BehaviourTree::InvalidFact)
+                blackboard->removeFact(m_fact);
+            else
+                blackboard->removeFact(m_factName);
+            return Status::Success;
+        }
+        Status setConst(Tree* tree, Blackboard* blackboard) const {
+            if ((m_fact != ofxAI::BehaviourTree::InvalidFact) && m_literalData) {
+                blackboard->setFact(m_fact, m_factData);
+                return Status::Success;
+            }
+            std::string factName;
+            std::string factData;
+            if (!blackboard->getFactRef(m_factName, factName, tree))
+                return Status::Invalid;
+            if (!blackboard->getFactRef(m_factData, factData, tree))
+                return Status::Invalid;
+            blackboard->setFact(factName, factData);
+            return Status::Success;
+        }
+        Status equalsConst(Tree* tree, Blackboard* blackboard) const {
+            std::string fact;
+            if ((m_fact != ofxAI::BehaviourTree::InvalidFact) && m_literalData) {
+                if (!blackboard->getFact(m_fact, fact))
+                    return Status::Invalid;
+                return fact == m_factData
+                    ? Status::Success
+                    : Status::Failure;
+            }
+            std::string factName;
+            std::string factData;
+            if (!blackboard->getFactRef(m_factName, factName, tree))
+                return Status::Invalid;
+            if (!blackboard->getFactRef(m_factData, factData, tree))
+                return Status::Invalid;
+            if (!blackboard->getFact(factName, fact))
+                return Status::Invalid;
+            return fact == factData
+                ? Status::Success
+                : Status::Failure;
+        }
+        Status setValue(Tree* tree, Blackboard* blackboard) const {
+            FactId fact = m_fact;
+            if (fact == ofxAI::BehaviourTree::InvalidFact) {
+                std::string factName;
+                if (!blackboard->getFactRef(m_factName, factName, tree))
+                    return Status::Invalid;
+                fact = FactTable::intern(factName);
+            }
+            blackboard->setValue(fact, m_value);
+            return Status::Success;
+        }
+        Status equalsValue(Tree* tree, Blackboard* blackboard) const {
+            FactId fact = m_fact;
+            if (fact == ofxAI::BehaviourTree::InvalidFact) {
+                std::string factName;
+                if (!blackboard->getFactRef(m_factName, factName, tree))
+                    return Status::Invalid;
+                fact = FactTable::find(factName);
+            }
+            // compare in place when the blackboard stores Values
+            if (const Value* found = blackboard->findValue(fact)) {
+                return *found == m_value
+                    ? Status::Success
+                    : Status::Failure;
+            }
+            Value value;
+            if (!blackboard->getValue(fact, value))
+                return Status::Invalid;
+            return value == m_value
+                ? Status::Success
+                : Status::Failure;
+        }
+
+        std::string m_factName;
+        std::string m_factData;
+        FactId m_fact;
+        bool m_literalData;
+        Value m_value;
+    };
+
     class FactExistsNode : public BaseNode {
     public:
         FactExistsNode(std::string const & ref, const std::string& factName)
-            : BaseNode(ref), m_factName(factName) {}
+            : BaseNode(ref), m_operands(factName) {}
         virtual Status tick(Tree* tree) override {
-            return tree->getBlackboard()->factExists(m_factName)
-                ? Status::Success
-                : Status::Failure;
+            return m_operands.exists(tree->getBlackboard().get());
         }
     protected:
-        std::string m_factName;
+        FactOperands m_operands;
+    };
+
+    class WaitForFactNode : public BaseNode {
+    public:
+        WaitForFactNode(std::string const & ref, const std::string& factName)
+            : BaseNode(ref), m_operands(factName) {}
+        virtual Status tick(Tree* tree) override {
+            return m_operands.wait(tree->getBlackboard().get());
+        }
+    protected:
+        FactOperands m_operands;
     };
 
     class RemoveFactNode : public BaseNode {
     public:
         RemoveFactNode(std::string const & ref, const std::string& factName)
-            : BaseNode(ref), m_factName(factName) {}
+            : BaseNode(ref), m_operands(factName) {}
         virtual Status tick(Tree* tree) override {
-            tree->getBlackboard()->removeFact(m_factName);
-            return Status::Success;
+            return m_operands.remove(tree->getBlackboard().get());
         }
     protected:
-        std::string m_factName;
+        FactOperands m_operands;
     };
 
     class SetFactConstNode : public BaseNode {
     public:
         SetFactConstNode(std::string const & ref, const std::string& factName, const std::string& factData)
-            : BaseNode(ref), m_factName(factName), m_factData(factData) {}
+            : BaseNode(ref), m_operands(factName, factData) {}
         virtual Status tick(Tree* tree) override {
-            std::string factName;
-            std::string factData;
-            auto blackboard = tree->getBlackboard();
-            if (!blackboard->getFactRef(m_factName, factName, tree))
-                return Status::Invalid;
-            if (!blackboard->getFactRef(m_factData, factData, tree))
-                return Status::Invalid;
-            blackboard->setFact(factName, factData);
-            return Status::Success;
+            return m_operands.setConst(tree, tree->getBlackboard().get());
         }
     protected:
-        std::string m_factName;
-        std::string m_factData;
+        FactOperands m_operands;
     };
 
     class FactEqualsConstantNode : public BaseNode {
     public:
         FactEqualsConstantNode(std::string const & ref, const std::string& factName, const std::string& factData)
-            : BaseNode(ref), m_factName(factName), m_factData(factData) {}
+            : BaseNode(ref), m_operands(factName, factData) {}
         virtual Status tick(Tree* tree) override {
-            std::string factName;
-            std::string factData;
-            auto blackboard = tree->getBlackboard();
-            if (!blackboard->getFactRef(m_factName, factName, tree))
-                return Status::Invalid;
-            if (!blackboard->getFactRef(m_factData, factData, tree))
-                return Status::Invalid;
-            std::string fact;
-            if (!blackboard->getFact(factName, fact))
-                return Status::Invalid;
-            return fact == factData
-                ? Status::Success
-                : Status::Failure;
+            return m_operands.equalsConst(tree, tree->getBlackboard().get());
         }
     protected:
-        std::string m_factName;
-        std::string m_factData;
+        FactOperands m_operands;
+    };
+
+    class SetFactValueNode : public BaseNode {
+    public:
+        SetFactValueNode(std::string const & ref, const std::string& factName, const Value& value)
+            : BaseNode(ref), m_operands(factName, std::string(), value) {}
+        virtual Status tick(Tree* tree) override {
+            return m_operands.setValue(tree, tree->getBlackboard().get());
+        }
+    protected:
+        FactOperands m_operands;
+    };
+
+    class FactEqualsValueNode : public BaseNode {
+    public:
+        FactEqualsValueNode(std::string const & ref, const std::string& factName, const Value& value)
+            : BaseNode(ref), m_operands(factName, std::string(), value) {}
+        virtual Status tick(Tree* tree) override {
+            return m_operands.equalsValue(tree, tree->getBlackboard().get());
+        }
+    protected:
+        FactOperands m_operands;
     };
 
     class ScopeNode : public BaseNode {
@@ -373,6 +557,21 @@ namespace {
     using namespace ofxAI::BehaviourTree;
     using NodePtr = BaseNode::NodePtr;
 
+    NodePtr createParallel(Node const& node) {
+        BaseNode::NodeVector children;
+        for (auto inner : node.children()) {
+            children.push_back(Tree::createNode(inner));
+        }
+        if (node.params().size() < 2)
+            return std::make_unique<ParallelNode>(node.ref(), children);
+        else
+            return std::make_unique<ParallelNode>(
+                node.ref(),
+                std::atoi(node.params()[0].c_str()),
+                std::atoi(node.params()[1].c_str()),
+                children);
+    }
+
     std::map<std::string, std::function<NodePtr(Node const&)>> nodeFactory = {
         {Selector::name, [](Node const& node)->NodePtr {
             BaseNode::NodeVector children;
@@ -388,16 +587,9 @@ namespace {
             }
             return std::make_unique<SequenceNode>(node.ref(), children);
         }},
-        {Parallel::name, [](Node const& node)->NodePtr {
-            BaseNode::NodeVector children;
-            for (auto inner : node.children()) {
-                children.push_back(Tree::createNode(inner));
-            }
-            if (node.params().empty())
-                return std::make_unique<ParallelNode>(node.ref(), children);
-            else
-                return std::make_unique<ParallelNode>(node.ref(), std::atoi(node.params()[0].c_str()), children);
-        }},
+        {Parallel::name, createParallel},
+        // node graphs tick concurrent parallels sequentially
+        {ConcurrentParallel::name, createParallel},
         {UntilFalse::name, [](Node const& node)->NodePtr {
             BaseNode::NodeVector children;
             for (auto inner : node.children()) {
@@ -424,6 +616,9 @@ namespace {
         {FactExists::name, [](Node const& node)->NodePtr {
             return std::make_unique<FactExistsNode>(node.ref(), node.params()[0]);
         }},
+        {WaitForFact::name, [](Node const& node)->NodePtr {
+            return std::make_unique<WaitForFactNode>(node.ref(), node.params()[0]);
+        }},
         {RemoveFact::name, [](Node const& node)->NodePtr {
             return std::make_unique<RemoveFactNode>(node.ref(), node.params()[0]);
         }},
@@ -433,13 +628,148 @@ namespace {
         {FactEqualsConst::name, [](Node const& node)->NodePtr {
             return std::make_unique<FactEqualsConstantNode>(node.ref(), node.params()[0], node.params()[1]);
         }},
+        {SetFactValue::name, [](Node const& node)->NodePtr {
+            return std::make_unique<SetFactValueNode>(node.ref(), node.params()[0], node.values()[0]);
+        }},
+        {FactEqualsValue::name, [](Node const& node)->NodePtr {
+            return std::make_unique<FactEqualsValueNode>(node.ref(), node.params()[0], node.values()[0]);
+        }},
+    };
+}
+
+namespace ofxAI {
+    namespace BehaviourTree {
+        /*
+         * Compiled tree: the nodes of a Node description laid out in one
+         * contiguous array in depth-first order. Every entry stores the index
+         * one past its own subtree, so the children of entry i are the span
+         * [i + 1, next), visited by hopping from sibling to sibling.
+         * Ticking dispatches on the entry kind, producing the same results
+         * as the node classes above.
+         */
+        class CompiledTree {
+        public:
+            enum class Kind : uint8_t {
+                Invalid, // unknown node type, always ticks Invalid
+                Leaf,
+                Decorator,
+                Sequence,
+                Selector,
+                Parallel,
+                UntilFalse,
+                UntilTrue,
+                ReturnTrue,
+                ReturnFalse,
+                Negate,
+                FactExists,
+                RemoveFact,
+                SetFactConst,
+                FactEqualsConst,
+                SetFactValue,
+                FactEqualsValue,
+                Decision,
+                Strategy,
+                MemSequence,
+                MemSelector,
+                MemUntilFalse,
+                MemUntilTrue,
+                ConcurrentParallel,
+                WaitForFact,
+                ParamLeaf
+            };
+            struct Entry {
+                Kind kind;
+                uint32_t next; // index one past the end of this subtree
+                uint32_t data; // index into the leaf, decorator or fact table, or state slot
+            };
+            struct LeafEntry {
+                BaseNode::NodeTick tick;
+                std::vector<std::string> params;
+            };
+            struct ParamLeafEntry {
+                BaseNode::NodeParamTick tick;
+                LeafParams params;
+            };
+            struct ParallelEntry {
+                uint32_t successThreshold;
+                uint32_t failureThreshold;
+                uint32_t firstSlot; // one state slot per child, holding its finished status
+            };
+            struct DecoratorEntry {
+                BaseNode::NodeDecorate decorate;
+                std::vector<std::string> params;
+                NodePtr child; // handle to the compiled child, for the decorator function
+            };
+
+            CompiledTree(CompositeMode mode) : m_mode(mode), m_stateCount(0) {}
+            CompiledTree(const CompiledTree&) = delete;
+            CompiledTree& operator=(const CompiledTree&) = delete;
+
+            bool append(Node const & node);
+            Status tick(Tree* tree, uint32_t index) const;
+            // ticks children in order while they return proceed, returning
+            // exhausted after the last one; resume, if set, holds the running child
+            Status tickChildren(Tree* tree, uint32_t index, Status proceed, Status exhausted, uint32_t* resume) const;
+            uint32_t& state(Tree* tree, uint32_t slot) const;
+            Status tickParallel(Tree* tree, uint32_t index) const;
+
+            std::vector<Entry> m_nodes;
+            std::vector<LeafEntry> m_leaves;
+            std::vector<ParamLeafEntry> m_paramLeaves;
+            std::vector<DecoratorEntry> m_decorators;
+            std::vector<FactOperands> m_facts;
+            std::vector<ParallelEntry> m_parallels;
+            CompositeMode m_mode;
+            uint32_t m_stateCount; // state slots each Tree needs to run this
+        };
+    }
+}
+
+namespace {
+    using CompiledTree = ofxAI::BehaviourTree::CompiledTree;
+    using Kind = CompiledTree::Kind;
+
+    // stands in for a compiled subtree where decorator functions expect a node
+    class CompiledChildNode : public BaseNode {
+    public:
+        CompiledChildNode(std::string const & ref, const CompiledTree* compiled, uint32_t index)
+            : BaseNode(ref), m_compiled(compiled), m_index(index) {}
+        virtual Status tick(Tree* tree) override {
+            return m_compiled->tick(tree, m_index);
+        }
+    protected:
+        const CompiledTree* m_compiled;
+        uint32_t m_index;
+    };
+
+    std::map<std::string, Kind> compiledKinds = {
+        {Sequence::name, Kind::Sequence},
+        {Selector::name, Kind::Selector},
+        {Parallel::name, Kind::Parallel},
+        {ConcurrentParallel::name, Kind::ConcurrentParallel},
+        {UntilFalse::name, Kind::UntilFalse},
+        {UntilTrue::name, Kind::UntilTrue},
+        {ReturnTrue::name, Kind::ReturnTrue},
+        {ReturnFalse::name, Kind::ReturnFalse},
+        {Negate::name, Kind::Negate},
+        {FactExists::name, Kind::FactExists},
+        {WaitForFact::name, Kind::WaitForFact},
+        {RemoveFact::name, Kind::RemoveFact},
+        {SetFactConst::name, Kind::SetFactConst},
+        {FactEqualsConst::name, Kind::FactEqualsConst},
+        {SetFactValue::name, Kind::SetFactValue},
+        {FactEqualsValue::name, Kind::FactEqualsValue},
+        {Decision::name, Kind::Decision},
+        {Strategy::name, Kind::Strategy},
+        {MemSequence::name, Kind::MemSequence},
+        {MemSelector::name, Kind::MemSelector},
     };
 }
 
 
 
 inline ofxAI::BehaviourTree::Tree::Tree()
-    : Tree(std::make_shared<DictBlackboard>())
+    : Tree(std::make_shared<SlotBlackboard>())
 {}
 
 ofxAI::BehaviourTree::Tree::Tree(const Node & tree)
@@ -449,43 +779,92 @@ ofxAI::BehaviourTree::Tree::Tree(const Node & tree)
 }
 
 ofxAI::BehaviourTree::Tree::Tree(BlackboardPtr ptr)
-    : m_blackboard(ptr) {}
+    : m_blackboard(ptr), m_tick(0), m_activeScopes(nullptr), m_taskPool(nullptr) {}
 
 ofxAI::BehaviourTree::Tree::Tree(const Node & tree, BlackboardPtr ptr)
     : Tree(ptr) {
     loadTree(tree);
 }
 
+ofxAI::BehaviourTree::Tree::Tree(CompiledTreePtr tree)
+    : Tree() {
+    loadTree(tree);
+}
+
+ofxAI::BehaviourTree::Tree::Tree(CompiledTreePtr tree, BlackboardPtr ptr)
+    : Tree(ptr) {
+    loadTree(tree);
+}
+
 ofxAI::BehaviourTree::Status ofxAI::BehaviourTree::Tree::tick() {
-    if (!m_root)
+    thread_local ScopeStack scratch;
+    return tick(scratch);
+}
+
+ofxAI::BehaviourTree::Status ofxAI::BehaviourTree::Tree::tick(ScopeStack & scratch) {
+    if (!m_compiled)
         return Status::Invalid;
-    return m_root->tick(this);
+    ActiveScopes active = { &scratch, scratch.size() };
+    ActiveScopes* outer = m_activeScopes;
+    m_activeScopes = &active;
+    ++m_tick;
+    auto status = m_compiled->tick(this, 0);
+    // drop anything a node pushed and didn't pop
+    while (scratch.size() > active.base)
+        scratch.pop_back();
+    m_activeScopes = outer;
+    return status;
+}
+
+void ofxAI::BehaviourTree::Tree::reset() {
+    for (auto& state : m_state)
+        state.value = 0;
 }
 
 
-bool ofxAI::BehaviourTree::Tree::loadTree(const Node & root) {
-    m_root = createNode(root);
-    return !!m_root;
+bool ofxAI::BehaviourTree::Tree::loadTree(const Node & root, CompositeMode mode) {
+    return loadTree(compile(root, mode));
+}
+
+bool ofxAI::BehaviourTree::Tree::loadTree(CompiledTreePtr tree) {
+    m_compiled = tree;
+    m_state.assign(m_compiled ? m_compiled->m_stateCount : 0, { 0, 0 });
+    m_tick = 0;
+    return !!m_compiled;
 }
 
 bool ofxAI::BehaviourTree::Tree::getScopedVar(const std::string & varName, std::string & output) const {
+    if (m_activeScopes && (m_activeScopes->stack->size() > m_activeScopes->base))
+        return m_activeScopes->stack->back()->getScopeVar(varName, output);
     if (m_scopeStack.empty())
         return false;
-    return m_scopeStack.top()->getScopeVar(varName, output);
+    return m_scopeStack.back()->getScopeVar(varName, output);
 }
 
 void ofxAI::BehaviourTree::Tree::pushScope(NodeScopePtr scope) {
-    m_scopeStack.push(std::move(scope));
+    if (m_activeScopes)
+        m_activeScopes->stack->push_back(std::move(scope));
+    else
+        m_scopeStack.push_back(std::move(scope));
 }
 
 void ofxAI::BehaviourTree::Tree::popScope() {
-    m_scopeStack.pop();
+    if (m_activeScopes && (m_activeScopes->stack->size() > m_activeScopes->base))
+        m_activeScopes->stack->pop_back();
+    else if (!m_scopeStack.empty())
+        m_scopeStack.pop_back();
 }
 
 ofxAI::BehaviourTree::BaseNode::NodePtr ofxAI::BehaviourTree::Tree::createNode(const Node & node) {
     if (node.leaf()) {
         return std::make_unique<LeafNode>(node.ref(), node.leaf(), node.params());
     }
+    if (node.paramLeaf()) {
+        LeafParams params;
+        if (!LeafParams::parse(node.schema(), node.params(), params))
+            return BaseNode::NodePtr();
+        return std::make_unique<ParamLeafNode>(node.ref(), node.paramLeaf(), std::move(params));
+    }
     if (node.decorator()) {
         return std::make_unique<DecoratorNode>(
             node.ref(),
@@ -511,6 +890,350 @@ ofxAI::BehaviourTree::BaseNode::NodePtr ofxAI::BehaviourTree::Tree::createNode(c
     return BaseNode::NodePtr();
 }
 
+ofxAI::BehaviourTree::Tree::CompiledTreePtr ofxAI::BehaviourTree::Tree::compile(const Node & root, CompositeMode mode) {
+    auto compiled = std::make_shared<CompiledTree>(mode);
+    if (!compiled->append(root))
+        return CompiledTreePtr();
+    return compiled;
+}
+
+bool ofxAI::BehaviourTree::CompiledTree::append(const Node & node) {
+    uint32_t index = (uint32_t)m_nodes.size();
+    m_nodes.push_back({ Kind::Invalid, index + 1, 0 });
+
+    Kind kind = Kind::Invalid;
+    uint32_t data = 0;
+    if (node.leaf()) {
+        kind = Kind::Leaf;
+        data = (uint32_t)m_leaves.size();
+        m_leaves.push_back({ node.leaf(), node.params() });
+    }
+    else if (node.paramLeaf()) {
+        LeafParams params;
+        if (LeafParams::parse(node.schema(), node.params(), params)) {
+            kind = Kind::ParamLeaf;
+            data = (uint32_t)m_paramLeaves.size();
+            m_paramLeaves.push_back({ node.paramLeaf(), std::move(params) });
+        }
+    }
+    else if (node.decorator()) {
+        kind = Kind::Decorator;
+        data = (uint32_t)m_decorators.size();
+        NodePtr child;
+        if (!node.children().empty())
+            child = std::make_unique<CompiledChildNode>(node.children()[0].ref(), this, index + 1);
+        m_decorators.push_back({ node.decorator(), node.params(), std::move(child) });
+    }
+    else {
+        auto found = compiledKinds.find(node.name());
+        if (found != compiledKinds.end())
+            kind = found->second;
+        if (m_mode == CompositeMode::Memory) {
+            switch (kind) {
+            case Kind::Sequence: kind = Kind::MemSequence; break;
+            case Kind::Selector: kind = Kind::MemSelector; break;
+            case Kind::UntilFalse: kind = Kind::MemUntilFalse; break;
+            case Kind::UntilTrue: kind = Kind::MemUntilTrue; break;
+            default: break;
+            }
+        }
+    }
+
+    auto& params = node.params();
+    auto& values = node.values();
+    switch (kind) {
+    case Kind::FactExists:
+    case Kind::WaitForFact:
+    case Kind::RemoveFact:
+        if (params.empty()) {
+            kind = Kind::Invalid;
+            break;
+        }
+        data = (uint32_t)m_facts.size();
+        m_facts.emplace_back(params[0]);
+        break;
+    case Kind::SetFactConst:
+    case Kind::FactEqualsConst:
+        if (params.size() < 2) {
+            kind = Kind::Invalid;
+            break;
+        }
+        data = (uint32_t)m_facts.size();
+        m_facts.emplace_back(params[0], params[1]);
+        break;
+    case Kind::SetFactValue:
+    case Kind::FactEqualsValue:
+        if (params.empty() || values.empty()) {
+            kind = Kind::Invalid;
+            break;
+        }
+        data = (uint32_t)m_facts.size();
+        m_facts.emplace_back(params[0], std::string(), values[0]);
+        break;
+    case Kind::Decorator:
+    case Kind::ReturnTrue:
+    case Kind::ReturnFalse:
+    case Kind::Negate:
+        // decorators only ever tick their first child
+        if (!node.children().empty())
+            append(node.children()[0]);
+        break;
+    case Kind::Decision:
+    case Kind::MemSequence:
+    case Kind::MemSelector:
+    case Kind::MemUntilFalse:
+    case Kind::MemUntilTrue:
+        data = m_stateCount++;
+        for (auto& child : node.children())
+            append(child);
+        break;
+    case Kind::Strategy:
+        if (node.children().size() != 2) {
+            kind = Kind::Invalid;
+            break;
+        }
+        append(node.children()[0]);
+        append(node.children()[1]);
+        break;
+    case Kind::Parallel:
+    case Kind::ConcurrentParallel:
+    {
+        uint32_t count = (uint32_t)node.children().size();
+        ParallelEntry parallel = { count, 1, m_stateCount };
+        if (params.size() >= 2) {
+            parallel.successThreshold = (uint32_t)std::atoi(params[0].c_str());
+            parallel.failureThreshold = (uint32_t)std::atoi(params[1].c_str());
+        }
+        data = (uint32_t)m_parallels.size();
+        m_parallels.push_back(parallel);
+        m_stateCount += count;
+        for (auto& child : node.children())
+            append(child);
+        break;
+    }
+    case Kind::Sequence:
+    case Kind::Selector:
+    case Kind::UntilFalse:
+    case Kind::UntilTrue:
+        for (auto& child : node.children())
+            append(child);
+        break;
+    default:
+        break;
+    }
+
+    m_nodes[index] = { kind, (uint32_t)m_nodes.size(), data };
+    return kind != Kind::Invalid;
+}
+
+ofxAI::BehaviourTree::Status ofxAI::BehaviourTree::CompiledTree::tick(Tree * tree, uint32_t index) const {
+    const Entry& entry = m_nodes[index];
+    uint32_t first = index + 1;
+    switch (entry.kind) {
+    case Kind::Leaf:
+    {
+        auto& leaf = m_leaves[entry.data];
+        return leaf.tick(tree, leaf.params);
+    }
+    case Kind::ParamLeaf:
+    {
+        auto& leaf = m_paramLeaves[entry.data];
+        return leaf.tick(tree, leaf.params);
+    }
+    case Kind::Decorator:
+    {
+        auto& decorator = m_decorators[entry.data];
+        return decorator.decorate(tree, decorator.child.get(), decorator.params);
+    }
+    case Kind::Sequence:
+        return tickChildren(tree, index, Status::Success, Status::Success, nullptr);
+    case Kind::Selector:
+        return tickChildren(tree, index, Status::Failure, Status::Failure, nullptr);
+    case Kind::UntilFalse:
+        return tickChildren(tree, index, Status::Success, Status::Running, nullptr);
+    case Kind::UntilTrue:
+        return tickChildren(tree, index, Status::Failure, Status::Running, nullptr);
+    case Kind::MemSequence:
+        return tickChildren(tree, index, Status::Success, Status::Success, &state(tree, entry.data));
+    case Kind::MemSelector:
+        return tickChildren(tree, index, Status::Failure, Status::Failure, &state(tree, entry.data));
+    case Kind::MemUntilFalse:
+        return tickChildren(tree, index, Status::Success, Status::Running, &state(tree, entry.data));
+    case Kind::MemUntilTrue:
+        return tickChildren(tree, index, Status::Failure, Status::Running, &state(tree, entry.data));
+    case Kind::Parallel:
+    case Kind::ConcurrentParallel:
+        return tickParallel(tree, index);
+    case Kind::ReturnTrue:
+    case Kind::ReturnFalse:
+    case Kind::Negate:
+    {
+        if (first == entry.next)
+            return Status::Invalid;
+        auto status = tick(tree, first);
+        if ((status != Status::Success) && (status != Status::Failure))
+            return status;
+        if (entry.kind == Kind::ReturnTrue)
+            return Status::Success;
+        if (entry.kind == Kind::ReturnFalse)
+            return Status::Failure;
+        return status == Status::Success
+            ? Status::Failure
+            : Status::Success;
+    }
+    case Kind::FactExists:
+        return m_facts[entry.data].exists(tree->m_blackboard.get());
+    case Kind::WaitForFact:
+        return m_facts[entry.data].wait(tree->m_blackboard.get());
+    case Kind::RemoveFact:
+        return m_facts[entry.data].remove(tree->m_blackboard.get());
+    case Kind::SetFactConst:
+        return m_facts[entry.data].setConst(tree, tree->m_blackboard.get());
+    case Kind::FactEqualsConst:
+        return m_facts[entry.data].equalsConst(tree, tree->m_blackboard.get());
+    case Kind::SetFactValue:
+        return m_facts[entry.data].setValue(tree, tree->m_blackboard.get());
+    case Kind::FactEqualsValue:
+        return m_facts[entry.data].equalsValue(tree, tree->m_blackboard.get());
+    case Kind::Decision:
+    {
+        // the slot holds the running strategy's index + 1, or 0
+        uint32_t& current = state(tree, entry.data);
+        if (current) {
+            uint32_t condition = current;
+            auto result = tick(tree, m_nodes[condition].next);
+            if (result != Status::Running)
+                current = 0;
+            return result;
+        }
+        for (uint32_t strategy = first; strategy < entry.next; strategy = m_nodes[strategy].next) {
+            if (m_nodes[strategy].kind != Kind::Strategy)
+                return Status::Invalid;
+            uint32_t condition = strategy + 1;
+            auto status = tick(tree, condition);
+            if (status == Status::Success) {
+                auto result = tick(tree, m_nodes[condition].next);
+                if (result == Status::Running)
+                    current = condition;
+                return result;
+            }
+            else if (status != Status::Failure) {
+                return status;
+            }
+        }
+        return Status::Invalid;
+    }
+    default:
+        return Status::Invalid;
+    }
+}
+
+ofxAI::BehaviourTree::Status ofxAI::BehaviourTree::CompiledTree::tickChildren(
+    Tree * tree,
+    uint32_t index,
+    Status proceed,
+    Status exhausted,
+    uint32_t* resume) const {
+    const Entry& entry = m_nodes[index];
+    if (index + 1 == entry.next)
+        return Status::Invalid;
+    uint32_t child = (resume && *resume) ? *resume : index + 1;
+    for (; child < entry.next; child = m_nodes[child].next) {
+        auto status = tick(tree, child);
+        if (status == proceed)
+            continue;
+        if (resume)
+            *resume = (status == Status::Running) ? child : 0;
+        return status;
+    }
+    if (resume)
+        *resume = 0;
+    return exhausted;
+}
+
+ofxAI::BehaviourTree::Status ofxAI::BehaviourTree::CompiledTree::tickParallel(Tree * tree, uint32_t index) const {
+    const Entry& entry = m_nodes[index];
+    const ParallelEntry& parallel = m_parallels[entry.data];
+    if (index + 1 == entry.next)
+        return Status::Invalid;
+
+    // children still running, and where to store their status this tick
+    struct Pending {
+        uint32_t child;
+        uint32_t* finished;
+        Status status;
+    };
+    Pending local[16];
+    std::vector<Pending> overflow;
+    Pending* pending = local;
+    size_t count = 0;
+    size_t pendingCount = 0;
+    for (uint32_t child = index + 1; child < entry.next; child = m_nodes[child].next)
+        count++;
+    if (count > 16) {
+        overflow.resize(count);
+        pending = overflow.data();
+    }
+
+    uint32_t slot = parallel.firstSlot;
+    for (uint32_t child = index + 1; child < entry.next; child = m_nodes[child].next) {
+        // Invalid is never stored, so a zero slot means still running
+        uint32_t& finished = state(tree, slot++);
+        if (!finished)
+            pending[pendingCount++] = { child, &finished, Status::Invalid };
+    }
+
+    if ((entry.kind == Kind::ConcurrentParallel) && (pendingCount > 1)) {
+        struct Context {
+            const CompiledTree* compiled;
+            Tree* tree;
+            Pending* pending;
+        } context = { this, tree, pending };
+        TaskPool& pool = tree->m_taskPool ? *tree->m_taskPool : TaskPool::shared();
+        pool.parallelFor(pendingCount, 1, [&context](size_t i) {
+            auto& item = context.pending[i];
+            item.status = context.compiled->tick(context.tree, item.child);
+        });
+    }
+    else {
+        for (size_t i = 0; i < pendingCount; i++)
+            pending[i].status = tick(tree, pending[i].child);
+    }
+
+    bool invalid = false;
+    for (size_t i = 0; i < pendingCount; i++) {
+        auto status = pending[i].status;
+        if ((status == Status::Success) || (status == Status::Failure))
+            *pending[i].finished = (uint32_t)status;
+        invalid |= (status == Status::Invalid);
+    }
+
+    size_t nSuccess = 0;
+    size_t nFailure = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        auto finished = (Status)tree->m_state[parallel.firstSlot + i].value;
+        nSuccess += (finished == Status::Success);
+        nFailure += (finished == Status::Failure);
+    }
+    auto result = invalid
+        ? Status::Invalid
+        : parallelStatus(nSuccess, nFailure, count, parallel.successThreshold, parallel.failureThreshold);
+    if (result != Status::Running) {
+        for (uint32_t i = 0; i < count; i++)
+            tree->m_state[parallel.firstSlot + i].value = 0;
+    }
+    return result;
+}
+
+uint32_t & ofxAI::BehaviourTree::CompiledTree::state(Tree * tree, uint32_t slot) const {
+    auto& state = tree->m_state[slot];
+    // not ticked on the previous tick: whatever it was running got preempted
+    if (state.tick + 1 < tree->m_tick)
+        state.value = 0;
+    state.tick = tree->m_tick;
+    return state.value;
+}
+
 bool ofxAI::BehaviourTree::Blackboard::getFactRef(
     const std::string & factName,
     std::string& result,
@@ -548,3 +1271,343 @@ inline bool ofxAI::BehaviourTree::NodeScope::getScopeVar(const std::string & key
     value = found->second;
     return true;
 }
+
+ofxAI::BehaviourTree::FactId ofxAI::BehaviourTree::FactTable::intern(const std::string & factName) {
+    FactId fact = find(factName);
+    if (fact != InvalidFact)
+        return fact;
+    auto& symbols = factSymbols();
+    std::unique_lock<std::shared_mutex> lock(symbols.mutex);
+    auto found = symbols.ids.find(factName);
+    if (found != symbols.ids.end())
+        return found->second;
+    size_t count = symbols.count.load(std::memory_order_relaxed);
+    size_t chunk, offset;
+    FactSymbols::locate(count, chunk, offset);
+    if (!offset)
+        symbols.chunks[chunk].reset(new std::string[FactSymbols::FirstChunk << chunk]);
+    symbols.chunks[chunk][offset] = factName;
+    fact = (FactId)count;
+    symbols.ids.emplace(factName, fact);
+    symbols.count.store(count + 1, std::memory_order_release);
+    return fact;
+}
+
+ofxAI::BehaviourTree::FactId ofxAI::BehaviourTree::FactTable::find(const std::string & factName) {
+    auto& symbols = factSymbols();
+    std::shared_lock<std::shared_mutex> lock(symbols.mutex);
+    auto found = symbols.ids.find(factName);
+    if (found == symbols.ids.end())
+        return InvalidFact;
+    return found->second;
+}
+
+const std::string & ofxAI::BehaviourTree::FactTable::name(FactId fact) {
+    static const std::string empty;
+    auto& symbols = factSymbols();
+    if (fact >= symbols.count.load(std::memory_order_acquire))
+        return empty;
+    size_t chunk, offset;
+    FactSymbols::locate(fact, chunk, offset);
+    return symbols.chunks[chunk][offset];
+}
+
+size_t ofxAI::BehaviourTree::FactTable::size() {
+    return factSymbols().count.load(std::memory_order_acquire);
+}
+
+void ofxAI::BehaviourTree::Blackboard::setFact(FactId fact, const std::string & data) {
+    setFact(FactTable::name(fact), data);
+}
+
+bool ofxAI::BehaviourTree::Blackboard::getFact(FactId fact, std::string & factData) const {
+    return getFact(FactTable::name(fact), factData);
+}
+
+void ofxAI::BehaviourTree::Blackboard::removeFact(FactId fact) {
+    removeFact(FactTable::name(fact));
+}
+
+bool ofxAI::BehaviourTree::Blackboard::factExists(FactId fact) const {
+    return factExists(FactTable::name(fact));
+}
+
+void ofxAI::BehaviourTree::Blackboard::setValue(FactId fact, const Value & value) {
+    setFact(fact, value.toString());
+}
+
+bool ofxAI::BehaviourTree::Blackboard::getValue(FactId fact, Value & value) const {
+    std::string data;
+    if (!getFact(fact, data))
+        return false;
+    value = Value(data);
+    return true;
+}
+
+void ofxAI::BehaviourTree::SlotBlackboard::setFact(const std::string & factName, const std::string & data) {
+    setFact(FactTable::intern(factName), data);
+}
+
+bool ofxAI::BehaviourTree::SlotBlackboard::getFact(const std::string & factName, std::string & factData) const {
+    return getFact(FactTable::find(factName), factData);
+}
+
+void ofxAI::BehaviourTree::SlotBlackboard::removeFact(const std::string & factName) {
+    removeFact(FactTable::find(factName));
+}
+
+bool ofxAI::BehaviourTree::SlotBlackboard::factExists(const std::string & factName) const {
+    return factExists(FactTable::find(factName));
+}
+
+void ofxAI::BehaviourTree::SlotBlackboard::setFact(FactId fact, const std::string & data) {
+    setValue(fact, Value(data));
+}
+
+bool ofxAI::BehaviourTree::SlotBlackboard::getFact(FactId fact, std::string & factData) const {
+    const Value* found = findValue(fact);
+    return found && found->get(factData);
+}
+
+void ofxAI::BehaviourTree::SlotBlackboard::removeFact(FactId fact) {
+    if (fact >= m_slots.size())
+        return;
+    m_slots[fact] = Value();
+}
+
+bool ofxAI::BehaviourTree::SlotBlackboard::factExists(FactId fact) const {
+    return (fact < m_slots.size()) && !m_slots[fact].empty();
+}
+
+void ofxAI::BehaviourTree::SlotBlackboard::setValue(FactId fact, const Value & value) {
+    if (fact == InvalidFact)
+        return;
+    if (fact >= m_slots.size())
+        m_slots.resize(fact + 1);
+    m_slots[fact] = value;
+}
+
+bool ofxAI::BehaviourTree::SlotBlackboard::getValue(FactId fact, Value & value) const {
+    const Value* found = findValue(fact);
+    if (!found)
+        return false;
+    value = *found;
+    return true;
+}
+
+const ofxAI::BehaviourTree::Value * ofxAI::BehaviourTree::SlotBlackboard::findValue(FactId fact) const {
+    if ((fact >= m_slots.size()) || m_slots[fact].empty())
+        return nullptr;
+    return &m_slots[fact];
+}
+
+void ofxAI::BehaviourTree::SlotBlackboard::reserve(size_t factCount) {
+    if (factCount > m_slots.size())
+        m_slots.resize(factCount);
+}
+
+bool ofxAI::BehaviourTree::LeafParams::parse(ParamSchema const & schema, std::vector<std::string> const & params, LeafParams & parsed) {
+    if (schema.size() != params.size())
+        return false;
+    parsed.m_values.clear();
+    parsed.m_values.reserve(params.size());
+    for (size_t i = 0; i < params.size(); i++) {
+        Value text(params[i]);
+        switch (schema[i]) {
+        case Value::Type::Bool:
+        {
+            bool value;
+            if (!text.get(value))
+                return false;
+            parsed.m_values.emplace_back(value);
+            break;
+        }
+        case Value::Type::Int:
+        {
+            int value;
+            if (!text.get(value))
+                return false;
+            parsed.m_values.emplace_back(value);
+            break;
+        }
+        case Value::Type::Float:
+        {
+            float value;
+            if (!text.get(value))
+                return false;
+            parsed.m_values.emplace_back(value);
+            break;
+        }
+        case Value::Type::Vector:
+        {
+            // the form Value::toString() writes
+            std::istringstream in(params[i]);
+            Value::Vector value;
+            if (!(in >> value.x >> value.y >> value.z) || !(in >> std::ws).eof())
+                return false;
+            parsed.m_values.emplace_back(value);
+            break;
+        }
+        case Value::Type::Handle:
+        {
+            char* end = nullptr;
+            unsigned long long id = std::strtoull(params[i].c_str(), &end, 10);
+            if (params[i].empty() || (*end != '\0'))
+                return false;
+            parsed.m_values.emplace_back(Value::Handle{ id });
+            break;
+        }
+        case Value::Type::String:
+            parsed.m_values.push_back(std::move(text));
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+// slots and snapshot records hold many of these
+static_assert(sizeof(ofxAI::BehaviourTree::Value) <= 24, "Value should stay three words");
+
+bool ofxAI::BehaviourTree::Value::get(bool & value) const {
+    switch (m_type) {
+    case Type::Bool: value = m_bool; return true;
+    case Type::Int: value = m_int != 0; return true;
+    case Type::Float: value = m_float != 0.0f; return true;
+    case Type::String:
+        if ((*m_string == "true") || (*m_string == "1")) {
+            value = true;
+            return true;
+        }
+        if ((*m_string == "false") || (*m_string == "0")) {
+            value = false;
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+bool ofxAI::BehaviourTree::Value::get(int & value) const {
+    switch (m_type) {
+    case Type::Bool: value = m_bool ? 1 : 0; return true;
+    case Type::Int: value = m_int; return true;
+    case Type::Float: value = (int)m_float; return true;
+    case Type::String:
+    {
+        // only facts stored through the string interface get parsed
+        char* end = nullptr;
+        long parsed = std::strtol(m_string->c_str(), &end, 10);
+        if (m_string->empty() || (*end != '\0'))
+            return false;
+        value = (int)parsed;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool ofxAI::BehaviourTree::Value::get(float & value) const {
+    switch (m_type) {
+    case Type::Bool: value = m_bool ? 1.0f : 0.0f; return true;
+    case Type::Int: value = (float)m_int; return true;
+    case Type::Float: value = m_float; return true;
+    case Type::String:
+    {
+        char* end = nullptr;
+        float parsed = std::strtof(m_string->c_str(), &end);
+        if (m_string->empty() || (*end != '\0'))
+            return false;
+        value = parsed;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool ofxAI::BehaviourTree::Value::get(Vector & value) const {
+    if (m_type != Type::Vector)
+        return false;
+    value = m_vector;
+    return true;
+}
+
+bool ofxAI::BehaviourTree::Value::get(Handle & value) const {
+    if (m_type != Type::Handle)
+        return false;
+    value = m_handle;
+    return true;
+}
+
+bool ofxAI::BehaviourTree::Value::get(std::string & value) const {
+    if (m_type == Type::Empty)
+        return false;
+    if (m_type == Type::String)
+        value = *m_string;
+    else
+        value = toString();
+    return true;
+}
+
+std::string ofxAI::BehaviourTree::Value::toString() const {
+    switch (m_type) {
+    case Type::Bool:
+        return m_bool ? "true" : "false";
+    case Type::Int:
+        return std::to_string(m_int);
+    case Type::Float:
+    {
+        std::ostringstream out;
+        out << m_float;
+        return out.str();
+    }
+    case Type::Vector:
+    {
+        std::ostringstream out;
+        out << m_vector.x << ' ' << m_vector.y << ' ' << m_vector.z;
+        return out.str();
+    }
+    case Type::Handle:
+        return std::to_string(m_handle.id);
+    case Type::String:
+        return *m_string;
+    default:
+        return std::string();
+    }
+}
+
+bool ofxAI::BehaviourTree::Value::operator==(Value const & other) const {
+    if (m_type == other.m_type) {
+        switch (m_type) {
+        case Type::Empty: return true;
+        case Type::Bool: return m_bool == other.m_bool;
+        case Type::Int: return m_int == other.m_int;
+        case Type::Float: return m_float == other.m_float;
+        case Type::Vector:
+            return (m_vector.x == other.m_vector.x) &&
+                (m_vector.y == other.m_vector.y) &&
+                (m_vector.z == other.m_vector.z);
+        case Type::Handle: return m_handle.id == other.m_handle.id;
+        case Type::String: return *m_string == *other.m_string;
+        }
+    }
+    // facts set as strings compare against typed constants by their text
+    if ((m_type == Type::String) || (other.m_type == Type::String)) {
+        if ((m_type == Type::Empty) || (other.m_type == Type::Empty))
+            return false;
+        return toString() == other.toString();
+    }
+    float lhs, rhs;
+    switch (m_type) {
+    case Type::Bool:
+    case Type::Int:
+    case Type::Float:
+        return get(lhs) && other.get(rhs) && (lhs == rhs);
+    default:
+        return false;
+    }
+}
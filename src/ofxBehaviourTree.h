@@ -3,8 +3,12 @@
 #include <string>
 #include <memory>
 #include <vector>
-#include <stack>
 #include <map>
+#include <cstdint>
+#include <new>
+#include <cassert>
+#include <type_traits>
+#include <limits>
 
 namespace ofxAI {
     namespace BehaviourTree {
@@ -15,8 +19,189 @@ namespace ofxAI {
             Running
         };
 
+        /*
+         * How composites treat a child that returned Running on the
+         * previous tick: Reactive composites start over from their first
+         * child on every tick, re-evaluating the conditions before it;
+         * Memory composites resume from the running child.
+         */
+        enum class CompositeMode {
+            Reactive,
+            Memory
+        };
+
         class Tree;
 
+        /*
+         * Fact IDs: fact names interned into a process-wide symbol table,
+         * so nodes can address blackboard facts by index instead of
+         * comparing strings on every tick. Names are never removed, so
+         * name() and size() do not lock; find() shares a lock with other
+         * lookups, and intern() only locks others out to add a name.
+         */
+        using FactId = uint32_t;
+        const FactId InvalidFact = FactId(-1);
+
+        class FactTable {
+        public:
+            // returns the ID for a fact name, registering it if needed
+            static FactId intern(const std::string& factName);
+            // returns the ID for a fact name, or InvalidFact if it was never interned
+            static FactId find(const std::string& factName);
+            // returns the name an ID was interned from
+            static const std::string& name(FactId fact);
+            // amount of interned facts - every valid ID is below this
+            static size_t size();
+        };
+
+        /*
+         * Value: small tagged value held in blackboard slots.
+         * Booleans, numbers, vectors and handles are stored inline, so
+         * setting, reading or comparing them never allocates or parses;
+         * strings, kept for facts set through the string interface, live
+         * on the heap, so a Value stays 24 bytes whatever it holds.
+         * Integers of any type are stored as Int; those out of its range
+         * are stored as Float, as doubles are.
+         */
+        class Value {
+        public:
+            enum class Type : uint8_t {
+                Empty,
+                Bool,
+                Int,
+                Float,
+                Vector,
+                Handle,
+                String
+            };
+            struct Vector {
+                float x, y, z;
+            };
+            // opaque reference to a game object (entity ID, pointer, ...)
+            struct Handle {
+                uint64_t id;
+            };
+
+            Value() : m_type(Type::Empty) {}
+            Value(bool value) : m_type(Type::Bool) { m_bool = value; }
+            Value(int value) : m_type(Type::Int) { m_int = value; }
+            template <typename T, typename std::enable_if<std::is_integral<T>::value &&
+                !std::is_same<T, bool>::value && !std::is_same<T, int>::value, int>::type = 0>
+            Value(T value) {
+                if (fitsInt(value)) {
+                    m_type = Type::Int;
+                    m_int = (int)value;
+                }
+                else {
+                    m_type = Type::Float;
+                    m_float = (float)value;
+                }
+            }
+            Value(float value) : m_type(Type::Float) { m_float = value; }
+            Value(double value) : m_type(Type::Float) { m_float = (float)value; }
+            Value(Vector const & value) : m_type(Type::Vector) { m_vector = value; }
+            Value(Handle value) : m_type(Type::Handle) { m_handle = value; }
+            Value(std::string const & value) : m_type(Type::String) { m_string = new std::string(value); }
+            Value(const char* value) : m_type(Type::String) { m_string = new std::string(value); }
+
+            Value(Value const & other) : m_type(Type::Empty) { copy(other); }
+            Value(Value&& other) noexcept : m_type(Type::Empty) { move(other); }
+            Value& operator=(Value const & other) {
+                if (this != &other)
+                    copy(other);
+                return *this;
+            }
+            Value& operator=(Value&& other) noexcept {
+                if (this != &other)
+                    move(other);
+                return *this;
+            }
+            ~Value() { clear(); }
+
+            Type type() const { return m_type; }
+            bool empty() const { return m_type == Type::Empty; }
+
+            // raw access to String values, reusing the storage of the
+            // string this value held before; text() is empty for other types
+            std::string const & text() const { return (m_type == Type::String) ? *m_string : noText(); }
+            void assignText(const char* text, size_t length) {
+                if (m_type == Type::String) {
+                    m_string->assign(text, length);
+                    return;
+                }
+                clear();
+                m_string = new std::string(text, length);
+                m_type = Type::String;
+            }
+
+            // typed reads - numeric types convert between each other,
+            // only values that were stored as strings get parsed
+            bool get(bool& value) const;
+            bool get(int& value) const;
+            bool get(float& value) const;
+            bool get(Vector& value) const;
+            bool get(Handle& value) const;
+            bool get(std::string& value) const;
+            std::string toString() const;
+
+            bool operator==(Value const & other) const;
+            bool operator!=(Value const & other) const { return !(*this == other); }
+        protected:
+            template <typename T>
+            static bool fitsInt(T value) {
+                using Limits = std::numeric_limits<int>;
+                if (std::is_signed<T>::value)
+                    return ((intmax_t)value >= Limits::min()) && ((intmax_t)value <= Limits::max());
+                return (uintmax_t)value <= (uintmax_t)Limits::max();
+            }
+            static std::string const & noText() {
+                static const std::string none;
+                return none;
+            }
+            void clear() {
+                if (m_type == Type::String)
+                    delete m_string;
+                m_type = Type::Empty;
+            }
+            void copy(Value const & other) {
+                if (other.m_type == Type::String) {
+                    assignText(other.m_string->data(), other.m_string->size());
+                    return;
+                }
+                clear();
+                take(other);
+            }
+            void move(Value& other) {
+                clear();
+                take(other);
+                other.m_type = Type::Empty;
+            }
+            // copies the other value's member, taking over its string
+            void take(Value const & other) {
+                switch (other.m_type) {
+                case Type::Bool: m_bool = other.m_bool; break;
+                case Type::Int: m_int = other.m_int; break;
+                case Type::Float: m_float = other.m_float; break;
+                case Type::Vector: m_vector = other.m_vector; break;
+                case Type::Handle: m_handle = other.m_handle; break;
+                case Type::String: m_string = other.m_string; break;
+                case Type::Empty: break;
+                }
+                m_type = other.m_type;
+            }
+
+            Type m_type;
+            // zeroed through its largest member
+            union {
+                bool m_bool;
+                int m_int;
+                float m_float;
+                Vector m_vector = {};
+                Handle m_handle;
+                std::string* m_string;
+            };
+        };
+
         class Blackboard {
         public:
             virtual ~Blackboard() {}
@@ -24,9 +209,157 @@ namespace ofxAI {
             virtual bool getFact(const std::string& factName, std::string& factData) const = 0;
             virtual void removeFact(const std::string& factName) = 0;
             virtual bool factExists(const std::string& factName) const = 0;
+
+            // ID-based access; by default forwards to the string-keyed
+            // methods, slot-backed blackboards override these instead.
+            // Subclasses overriding one half bring the other back in with
+            // using-declarations, as SlotBlackboard does
+            virtual void setFact(FactId fact, const std::string& data);
+            virtual bool getFact(FactId fact, std::string& factData) const;
+            virtual void removeFact(FactId fact);
+            virtual bool factExists(FactId fact) const;
+
+            // typed access; by default values go through their string form,
+            // blackboards that store Values directly override these
+            virtual void setValue(FactId fact, const Value& value);
+            virtual bool getValue(FactId fact, Value& value) const;
+            // stored value, or nullptr if absent or not stored as a Value
+            virtual const Value* findValue(FactId) const { return nullptr; }
+
+            template <typename T>
+            void setFact(FactId fact, T const & value) {
+                setValue(fact, Value(value));
+            }
+            template <typename T>
+            bool getFact(FactId fact, T& value) const {
+                if (const Value* found = findValue(fact))
+                    return found->get(value);
+                Value temp;
+                return getValue(fact, temp) && temp.get(value);
+            }
+
             bool getFactRef(const std::string& factName, std::string& result, const Tree* tree) const;
         };
 
+        /*
+         * Slot blackboard: stores facts in a dense array indexed by FactId,
+         * so ID-based queries are a single indexed load.
+         * The string-keyed interface interns the name and uses the same slots.
+         */
+        class SlotBlackboard : public Blackboard {
+        public:
+            using Blackboard::setFact;
+            using Blackboard::getFact;
+            using Blackboard::removeFact;
+            using Blackboard::factExists;
+
+            virtual void setFact(const std::string& factName, const std::string& data) override;
+            virtual bool getFact(const std::string& factName, std::string& factData) const override;
+            virtual void removeFact(const std::string& factName) override;
+            virtual bool factExists(const std::string& factName) const override;
+
+            virtual void setFact(FactId fact, const std::string& data) override;
+            virtual bool getFact(FactId fact, std::string& factData) const override;
+            virtual void removeFact(FactId fact) override;
+            virtual bool factExists(FactId fact) const override;
+
+            virtual void setValue(FactId fact, const Value& value) override;
+            virtual bool getValue(FactId fact, Value& value) const override;
+            virtual const Value* findValue(FactId fact) const override;
+
+            // pre-allocates slots for every fact interned so far
+            void reserve() { reserve(FactTable::size()); }
+            void reserve(size_t factCount);
+        protected:
+            // empty values mark absent facts
+            std::vector<Value> m_slots;
+        };
+
+
+        /*
+         * Inline function: a fixed-size stand-in for std::function that
+         * stores its callable in place. Only trivially copyable callables
+         * of up to Capacity bytes fit - function pointers, and lambdas
+         * capturing pointers, references or numbers - so making, copying
+         * and calling one never allocates, and a call is one indirect
+         * call through a plain function pointer.
+         *
+         * Leaves and decorators used to be std::functions, and ones
+         * capturing a std::string, a shared_ptr or another std::function
+         * by value no longer compile, stopping at the static_assert below.
+         * Capture a pointer to an object that outlives the tree instead,
+         * or move string arguments into the node's params, which the
+         * function is handed on every tick. Calling an empty inline
+         * function asserts, where a std::function would throw.
+         */
+        template <typename Signature, size_t Capacity = 3 * sizeof(void*)>
+        class InlineFunction;
+
+        template <typename R, typename... Args, size_t Capacity>
+        class InlineFunction<R(Args...), Capacity> {
+        public:
+            InlineFunction() : m_invoke(nullptr) {}
+            InlineFunction(std::nullptr_t) : m_invoke(nullptr) {}
+            template <typename F, typename = typename std::enable_if<
+                !std::is_same<F, InlineFunction>::value &&
+                std::is_convertible<decltype(std::declval<F&>()(std::declval<Args>()...)), R>::value>::type>
+            InlineFunction(F function) : m_invoke(nullptr) {
+                static_assert(std::is_trivially_copyable<F>::value,
+                              "inline functions only hold trivially copyable callables; capture pointers instead of objects");
+                static_assert(sizeof(F) <= Capacity, "callable too large for this inline function");
+                static_assert(alignof(F) <= alignof(void*), "callable aligned beyond a pointer");
+                if (isNull(function))
+                    return;
+                new (m_storage) F(function);
+                m_invoke = [](void* storage, Args... args) -> R {
+                    return (*static_cast<F*>(storage))(std::forward<Args>(args)...);
+                };
+            }
+
+            R operator()(Args... args) const {
+                assert(m_invoke && "calling an empty inline function");
+                return m_invoke(m_storage, std::forward<Args>(args)...);
+            }
+            explicit operator bool() const { return m_invoke != nullptr; }
+        protected:
+            // null function pointers make empty functions, as they do std::functions
+            template <typename F>
+            static bool isNull(F* function) { return function == nullptr; }
+            template <typename F>
+            static bool isNull(F const &) { return false; }
+
+            R (*m_invoke)(void*, Args...);
+            alignas(void*) mutable unsigned char m_storage[Capacity];
+        };
+
+        /*
+         * Leaf parameters parsed ahead of time. A leaf made with a
+         * ParamSchema has its params converted to Values of the types the
+         * schema lists once, when its tree is built, and gets them as
+         * LeafParams on every tick - reading a number is a load rather
+         * than a parse. Vectors are written "x y z". Typed params are
+         * taken literally; scope and indirect references are not resolved.
+         */
+        using ParamSchema = std::vector<Value::Type>;
+
+        class LeafParams {
+        public:
+            // false unless there is one param for every type in the
+            // schema, and each of them parses
+            static bool parse(ParamSchema const & schema, std::vector<std::string> const & params, LeafParams& parsed);
+
+            size_t size() const { return m_values.size(); }
+            Value const & operator[](size_t index) const { return m_values[index]; }
+            // reads a param as the type the schema gave it
+            template <typename T>
+            T get(size_t index) const {
+                T value = T();
+                m_values[index].get(value);
+                return value;
+            }
+        protected:
+            std::vector<Value> m_values;
+        };
 
         class BaseNode {
         public:
@@ -38,8 +371,10 @@ namespace ofxAI {
 
             using NodePtr = std::unique_ptr<BaseNode>;
             using NodeVector = std::vector<NodePtr>;
-            using NodeTick = std::function<Status(Tree*, const std::vector<std::string>&)>;
-            using NodeDecorate = std::function<Status(Tree*, BaseNode*, const std::vector<std::string>&)>;
+            // leaf and decorator functions are inline functions, see above
+            using NodeTick = InlineFunction<Status(Tree*, const std::vector<std::string>&)>;
+            using NodeDecorate = InlineFunction<Status(Tree*, BaseNode*, const std::vector<std::string>&)>;
+            using NodeParamTick = InlineFunction<Status(Tree*, const LeafParams&)>;
         };
 
         /*
@@ -49,37 +384,71 @@ namespace ofxAI {
         struct Node {
             Node(const BaseNode::NodeTick& leaf) : m_leaf(leaf) {}
             Node(const BaseNode::NodeDecorate& decorator, const Node& child)
-                : m_decorator(decorator)
-                , m_children({ child }) {
-            }
+                : m_children({ child })
+                , m_decorator(decorator) {
+            }
+            // named leaves and decorators can be saved with a VM program,
+            // and are looked up by their name when it is loaded again
+            Node(std::string const & name, const BaseNode::NodeTick& leaf) : m_name(name), m_leaf(leaf) {}
+            Node(std::string const & name, const BaseNode::NodeDecorate& decorator, const Node& child)
+                : m_children({ child })
+                , m_name(name)
+                , m_decorator(decorator) {
+            }
+            // leaves whose params are parsed by 'schema' when the tree is built
+            Node(ParamSchema const & schema, const BaseNode::NodeParamTick& leaf, std::initializer_list<std::string> params)
+                : m_params(params), m_paramLeaf(leaf), m_schema(schema) {}
+            Node(std::string const & name, ParamSchema const & schema, const BaseNode::NodeParamTick& leaf,
+                 std::initializer_list<std::string> params)
+                : m_name(name), m_params(params), m_paramLeaf(leaf), m_schema(schema) {}
             std::string const & name() const { return m_name; }
             std::string const & ref() const { return m_ref; }
             std::vector<Node> const & children() const { return m_children; }
             std::vector<std::string> const & params() const { return m_params; }
             BaseNode::NodeTick const & leaf() const { return m_leaf; }
             BaseNode::NodeDecorate const & decorator() const { return m_decorator; }
+            BaseNode::NodeParamTick const & paramLeaf() const { return m_paramLeaf; }
+            ParamSchema const & schema() const { return m_schema; }
+            std::vector<Value> const & values() const { return m_values; }
         protected:
             Node() {}
             Node(std::string leaf, std::string const & ref) : m_name(leaf), m_ref(ref) {}
             Node(std::string const & composite, std::string const & ref, std::initializer_list<Node> children)
-                : m_name(composite)
-                , m_children(children) {
+                : m_children(children)
+                , m_name(composite)
+                , m_ref(ref) {
+            }
+            Node(std::string const & composite, std::string const & ref, std::vector<Node> const & children)
+                : m_children(children)
+                , m_name(composite)
+                , m_ref(ref) {
             }
             Node(std::string const & composite, std::string const & ref, std::initializer_list<Node> children, std::initializer_list<std::string> params)
-                : m_name(composite)
-                , m_children(children)
+                : m_children(children)
+                , m_name(composite)
+                , m_ref(ref)
                 , m_params(params) {
             }
             Node(std::string const & leaf, std::string const & ref, std::initializer_list<std::string> params)
                 : m_name(leaf)
+                , m_ref(ref)
                 , m_params(params) {
             }
+            Node(std::string const & leaf, std::string const & ref, std::initializer_list<std::string> params, std::initializer_list<Value> values)
+                : m_name(leaf)
+                , m_ref(ref)
+                , m_params(params)
+                , m_values(values) {
+            }
             std::vector<Node> m_children;
             std::string m_name;
             std::string m_ref;
             std::vector<std::string> m_params;
+            std::vector<Value> m_values;
             BaseNode::NodeTick m_leaf;
             BaseNode::NodeDecorate m_decorator;
+            BaseNode::NodeParamTick m_paramLeaf;
+            ParamSchema m_schema;
         };
 
 
@@ -90,7 +459,7 @@ namespace ofxAI {
          * Success.
          */
         struct Sequence : public Node {
-            static constexpr char *name = "Sequence";
+            static constexpr const char *name = "Sequence";
             Sequence(std::initializer_list<Node> children)
                 : Sequence("", children) {
             }
@@ -107,7 +476,7 @@ namespace ofxAI {
          * Failure.
          */
         struct Selector : public Node {
-            static constexpr char *name = "Selector";
+            static constexpr const char *name = "Selector";
             Selector(std::initializer_list<Node> children)
                 : Selector("", children) {
             }
@@ -117,21 +486,53 @@ namespace ofxAI {
         };
 
 
+        /*
+         * Memory sequence: Like Sequence, but when a child returns Running
+         * the next tick resumes from that child instead of the first one.
+         */
+        struct MemSequence : public Node {
+            static constexpr const char *name = "MemSequence";
+            MemSequence(std::initializer_list<Node> children)
+                : MemSequence("", children) {
+            }
+            MemSequence(std::string const & ref, std::initializer_list<Node> children)
+                : Node(name, ref, children) {
+            }
+        };
+
+
+        /*
+         * Memory selector: Like Selector, but when a child returns Running
+         * the next tick resumes from that child instead of the first one.
+         */
+        struct MemSelector : public Node {
+            static constexpr const char *name = "MemSelector";
+            MemSelector(std::initializer_list<Node> children)
+                : MemSelector("", children) {
+            }
+            MemSelector(std::string const & ref, std::initializer_list<Node> children)
+                : Node(name, ref, children) {
+            }
+        };
+
+
         /*
          * Parallel node: Runs every child node, collecting the amount of
          * nodes that returned Success (nSuccess) or Failure (nFailure).
+         * Children that already returned Success or Failure are not
+         * ticked again until the Parallel node itself finishes.
          * If any children return Invalid, return Invalid.
-         * If nSuccess >= threshold, return Success.
-         * If nFailure > children.size()-threshold, return Failure.
+         * If nSuccess >= successThreshold, return Success.
+         * If nFailure >= failureThreshold, return Failure.
+         * If every child finished without reaching either, return Failure.
          * Return Running otherwise.
+         * Given a single threshold, Failure is returned as soon as
+         * nFailure > children.size()-threshold.
          */
         struct Parallel : public Node {
-            static constexpr char *name = "Parallel";
+            static constexpr const char *name = "Parallel";
             Parallel(std::string const & ref, size_t successThreshold, size_t failureThreshold, std::initializer_list<Node> children)
-                : Node(name, ref, children, {
-                    std::to_string(successThreshold),
-                    std::to_string(failureThreshold)
-                }) {
+                : Parallel(name, ref, successThreshold, failureThreshold, children) {
             }
             Parallel(size_t successThreshold, size_t failureThreshold, std::initializer_list<Node> children)
                 : Parallel("", successThreshold, failureThreshold, children) {
@@ -140,7 +541,7 @@ namespace ofxAI {
                 : Parallel(ref, children.size(), 1, children) {
             }
             Parallel(std::string const & ref, size_t threshold, std::initializer_list<Node> children)
-                : Parallel(ref, threshold, children.size() - threshold, children) {
+                : Parallel(ref, threshold, children.size() - threshold + 1, children) {
             }
             Parallel(std::initializer_list<Node> children)
                 : Parallel("", children) {
@@ -148,6 +549,46 @@ namespace ofxAI {
             Parallel(size_t threshold, std::initializer_list<Node> children)
                 : Parallel("", threshold, children) {
             }
+        protected:
+            Parallel(const char* nodeName, std::string const & ref, size_t successThreshold, size_t failureThreshold, std::initializer_list<Node> children)
+                : Node(nodeName, ref, children, {
+                    std::to_string(successThreshold),
+                    std::to_string(failureThreshold)
+                }) {
+            }
+        };
+
+
+        /*
+         * Concurrent parallel: A Parallel node whose unfinished children
+         * are ticked concurrently on the tree's TaskPool (see
+         * Tree::setTaskPool), so expensive leaf queries overlap. The
+         * calling thread ticks children too while it waits.
+         * Children run on other threads against the same Tree, so they
+         * must be thread-safe, must not push scopes, and may only write
+         * blackboard facts that already have storage (see
+         * SlotBlackboard::reserve).
+         */
+        struct ConcurrentParallel : public Parallel {
+            static constexpr const char *name = "ConcurrentParallel";
+            ConcurrentParallel(std::string const & ref, size_t successThreshold, size_t failureThreshold, std::initializer_list<Node> children)
+                : Parallel(name, ref, successThreshold, failureThreshold, children) {
+            }
+            ConcurrentParallel(size_t successThreshold, size_t failureThreshold, std::initializer_list<Node> children)
+                : ConcurrentParallel("", successThreshold, failureThreshold, children) {
+            }
+            ConcurrentParallel(std::string const & ref, std::initializer_list<Node> children)
+                : ConcurrentParallel(ref, children.size(), 1, children) {
+            }
+            ConcurrentParallel(std::string const & ref, size_t threshold, std::initializer_list<Node> children)
+                : ConcurrentParallel(ref, threshold, children.size() - threshold + 1, children) {
+            }
+            ConcurrentParallel(std::initializer_list<Node> children)
+                : ConcurrentParallel("", children) {
+            }
+            ConcurrentParallel(size_t threshold, std::initializer_list<Node> children)
+                : ConcurrentParallel("", threshold, children) {
+            }
         };
 
 
@@ -158,7 +599,7 @@ namespace ofxAI {
          * Returns Invalid if any child returns Invalid.
          */
         struct FirstReturn : public Node {
-            static constexpr char *name = "FirstReturn";
+            static constexpr const char *name = "FirstReturn";
             FirstReturn(std::initializer_list<Node> children)
                 : FirstReturn("", children) {
             }
@@ -175,7 +616,7 @@ namespace ofxAI {
          * Other results are unaffected.
          */
         struct ReturnTrue : public Node {
-            static constexpr char *name = "ReturnTrue";
+            static constexpr const char *name = "ReturnTrue";
             ReturnTrue(std::string const& ref, const Node& child)
                 : Node(name, ref, { child }) {
             }
@@ -191,7 +632,7 @@ namespace ofxAI {
          * Other results are unaffected.
          */
         struct ReturnFalse : public Node {
-            static constexpr char *name = "ReturnFalse";
+            static constexpr const char *name = "ReturnFalse";
             ReturnFalse(std::string const& ref, const Node& child)
                 : Node(name, ref, { child }) {
             }
@@ -207,7 +648,7 @@ namespace ofxAI {
          * Other results are unaffected.
          */
         struct Negate : public Node {
-            static constexpr char *name = "Negate";
+            static constexpr const char *name = "Negate";
             Negate(std::string const& ref, const Node& child)
                 : Node(name, ref, { child }) {
             }
@@ -222,7 +663,7 @@ namespace ofxAI {
          * in the current blackboard, Failure otherwise.
          */
         struct FactExists : public Node {
-            static constexpr char *name = "FactExists";
+            static constexpr const char *name = "FactExists";
             FactExists(std::string const & ref, const std::string& fact)
                 : Node(name, ref, { fact }) {
             }
@@ -232,12 +673,30 @@ namespace ofxAI {
         };
 
 
+        /*
+         * Wait for fact: Returns Success once a given fact is present
+         * in the current blackboard, Running until then.
+         * Under the VM, the thread is parked until the fact is set
+         * instead of checking it on every tick; reactive composites
+         * above it are not re-evaluated while it waits.
+         */
+        struct WaitForFact : public Node {
+            static constexpr const char *name = "WaitForFact";
+            WaitForFact(std::string const & ref, const std::string& fact)
+                : Node(name, ref, { fact }) {
+            }
+            WaitForFact(const std::string& fact)
+                : WaitForFact("", fact) {
+            }
+        };
+
+
         /*
          * Remove fact: Removes a fact from the current blackboard,
          * returning Success.
          */
         struct RemoveFact : public Node {
-            static constexpr char *name = "RemoveFact";
+            static constexpr const char *name = "RemoveFact";
             RemoveFact(std::string const & ref, const std::string& fact)
                 : Node(name, ref, { fact }) {
             }
@@ -252,7 +711,7 @@ namespace ofxAI {
          * returning Success.
          */
         struct SetFactConst : public Node {
-            static constexpr char *name = "SetFactConst";
+            static constexpr const char *name = "SetFactConst";
             SetFactConst(std::string const& ref, const std::string& fact, const std::string& constant)
                 : Node(name, ref, { fact, constant }) {
             }
@@ -267,7 +726,7 @@ namespace ofxAI {
          * has a specific value
          */
         struct FactEqualsConst : public Node {
-            static constexpr char *name = "FactEqualsConst";
+            static constexpr const char *name = "FactEqualsConst";
             FactEqualsConst(std::string const& ref, const std::string& fact, const std::string& constant)
                 : Node(name, ref, { fact, constant }) {
             }
@@ -276,11 +735,41 @@ namespace ofxAI {
             }
         };
 
+
+        /*
+         * Set fact value: Sets a typed fact value in the blackboard,
+         * returning Success.
+         */
+        struct SetFactValue : public Node {
+            static constexpr const char *name = "SetFactValue";
+            SetFactValue(std::string const& ref, const std::string& fact, const Value& value)
+                : Node(name, ref, { fact }, { value }) {
+            }
+            SetFactValue(const std::string& fact, const Value& value)
+                : SetFactValue("", fact, value) {
+            }
+        };
+
+
+        /*
+         * Fact equals value: Checks if a fact in the blackboard
+         * has a specific typed value, without going through strings
+         */
+        struct FactEqualsValue : public Node {
+            static constexpr const char *name = "FactEqualsValue";
+            FactEqualsValue(std::string const& ref, const std::string& fact, const Value& value)
+                : Node(name, ref, { fact }, { value }) {
+            }
+            FactEqualsValue(const std::string& fact, const Value& value)
+                : FactEqualsValue("", fact, value) {
+            }
+        };
+
         /*
          * Run children nodes until they return true
          */
         struct UntilTrue : public Node {
-            static constexpr char *name = "UntilTrue";
+            static constexpr const char *name = "UntilTrue";
             UntilTrue(std::string const& ref, std::initializer_list<Node> children)
                 : Node(name, ref, children) {
             }
@@ -292,7 +781,7 @@ namespace ofxAI {
          * Run children nodes until they return false
          */
         struct UntilFalse : public Node {
-            static constexpr char *name = "UntilFalse";
+            static constexpr const char *name = "UntilFalse";
             UntilFalse(std::string const& ref, std::initializer_list<Node> children)
                 : Node(name, ref, children) {
             }
@@ -304,7 +793,7 @@ namespace ofxAI {
          * Run children nodes unconditionally
          */
         struct AlwaysRun : public Node {
-            static constexpr char *name = "AlwaysRun";
+            static constexpr const char *name = "AlwaysRun";
             AlwaysRun(std::string const& ref, std::initializer_list<Node> children)
                 : Node(name, ref, children) {
             }
@@ -313,8 +802,12 @@ namespace ofxAI {
             }
         };
 
+        /*
+         * Strategy: a condition/action pair, only meaningful as a child
+         * of a Decision node.
+         */
         struct Strategy : public Node {
-            static constexpr char *name = "Strategy";
+            static constexpr const char *name = "Strategy";
             Strategy(std::string const & ref, Node const & condition, Node const & action)
                 : Node(name, ref, { condition, action }) {
             }
@@ -323,13 +816,21 @@ namespace ofxAI {
             }
         };
 
+        /*
+         * Decision node: Runs the action of the first strategy whose
+         * condition returns Success, returning the action's status.
+         * While that action returns Running it keeps being ticked on the
+         * following ticks, without re-evaluating the conditions.
+         * Returns a condition's status if it is neither Success nor
+         * Failure, and Invalid if no condition succeeds.
+         */
         struct Decision : public Node {
-            static constexpr char *name = "Decision";
-            Decision(std::string const & ref, std::initializer_list<Decision> decisions)
-                : Node(name, ref, (std::initializer_list<Node>&)decisions) {
+            static constexpr const char *name = "Decision";
+            Decision(std::string const & ref, std::initializer_list<Strategy> strategies)
+                : Node(name, ref, std::vector<Node>(strategies.begin(), strategies.end())) {
             }
-            Decision(std::initializer_list<Decision> decisions)
-                : Decision("", decisions) {
+            Decision(std::initializer_list<Strategy> strategies)
+                : Decision("", strategies) {
             }
         };
 
@@ -342,33 +843,81 @@ namespace ofxAI {
             std::map<std::string, std::string> m_values;
         };
 
+        /*
+         * Compiled tree: a Node description flattened into one contiguous
+         * array of nodes in depth-first order, ticked without virtual calls.
+         * Built by Tree::compile / Tree::loadTree, and immutable once built:
+         * running state lives in each Tree, so one compiled tree can be
+         * shared by any number of agents.
+         */
+        class CompiledTree;
+        class TaskPool;
+
         class Tree {
         public:
             using BlackboardPtr = std::shared_ptr<Blackboard>;
             using NodeScopePtr = std::unique_ptr<NodeScope>;
+            using CompiledTreePtr = std::shared_ptr<const CompiledTree>;
+            using ScopeStack = std::vector<NodeScopePtr>;
 
             Tree();
             Tree(Node const & tree);
             Tree(BlackboardPtr ptr);
             Tree(Node const & tree, BlackboardPtr ptr);
+            Tree(CompiledTreePtr tree);
+            Tree(CompiledTreePtr tree, BlackboardPtr ptr);
 
 
             BlackboardPtr getBlackboard() {
                 return m_blackboard;
             }
+            CompiledTreePtr getCompiledTree() const {
+                return m_compiled;
+            }
 
+            // scopes pushed while ticking go on a scratch stack owned by the
+            // ticking thread; the first overload uses a thread-local one
             Status tick();
-
-            bool loadTree(const Node& root);
+            Status tick(ScopeStack& scratch);
+            // aborts running nodes, so the next tick starts from scratch
+            void reset();
+            // pool ConcurrentParallel nodes tick their children on;
+            // nullptr, the default, stands for TaskPool::shared()
+            void setTaskPool(TaskPool* pool) { m_taskPool = pool; }
+            TaskPool* getTaskPool() const { return m_taskPool; }
+
+            bool loadTree(const Node& root, CompositeMode mode = CompositeMode::Reactive);
+            bool loadTree(CompiledTreePtr tree);
             bool getScopedVar(const std::string& varName, std::string& output) const;
             void pushScope(NodeScopePtr scope);
             void popScope();
             static BaseNode::NodePtr createNode(Node const & node);
+            // in Memory mode every Sequence, Selector, UntilTrue and UntilFalse
+            // resumes from its running child
+            static CompiledTreePtr compile(Node const & root, CompositeMode mode = CompositeMode::Reactive);
         protected:
-            BaseNode::NodePtr m_root;
+            // state slot of a stateful node, stamped with the tick that last
+            // touched it - a node skipped for a tick was preempted and starts over
+            struct NodeState {
+                uint32_t value;
+                uint32_t tick;
+            };
+            // scratch scope stack lent to the tree for the current tick
+            struct ActiveScopes {
+                ScopeStack* stack;
+                size_t base;
+            };
+
+            // per-agent state: everything else is shared through m_compiled
+            CompiledTreePtr m_compiled;
             BlackboardPtr m_blackboard;
-            std::stack<NodeScopePtr> m_scopeStack;
+            ScopeStack m_scopeStack; // scopes pushed between ticks
+            std::vector<NodeState> m_state;
+            uint32_t m_tick;
+            ActiveScopes* m_activeScopes;
+            TaskPool* m_taskPool;
             friend class NodeScope;
+            friend class CompiledTree;
         };
     }
 }
@@ -0,0 +1,140 @@
+#include "ofxBehaviourTreePool.h"
+#include <algorithm>
+
+namespace {
+    // index of the pool worker running on this thread, if any
+    thread_local size_t currentWorker = size_t(-1);
+    thread_local const void* currentPool = nullptr;
+}
+
+ofxAI::BehaviourTree::TaskPool::TaskPool(size_t workers)
+    : m_pending(0)
+    , m_stop(false) {
+    if (!workers) {
+        size_t hardware = std::thread::hardware_concurrency();
+        workers = hardware > 1 ? hardware - 1 : 1;
+    }
+    for (size_t i = 0; i < workers; i++)
+        m_queues.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < workers; i++)
+        m_threads.emplace_back([this, i]() { work(i); });
+}
+
+ofxAI::BehaviourTree::TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void ofxAI::BehaviourTree::TaskPool::parallelFor(size_t count, size_t grain, Task const & task) {
+    if (!count)
+        return;
+    if (!grain)
+        grain = 1;
+    Batch batch;
+    batch.task = &task;
+    batch.remaining = count;
+
+    // count the chunks in before publishing them, then deal them out
+    // round-robin, starting with our own queue
+    size_t chunks = (count + grain - 1) / grain;
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_pending += chunks;
+    }
+    size_t self = (currentPool == this) ? currentWorker : size_t(-1);
+    size_t queue = (self < m_queues.size()) ? self : 0;
+    for (size_t begin = 0; begin < count; begin += grain) {
+        Range range = { &batch, begin, std::min(begin + grain, count) };
+        {
+            std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+            m_queues[queue]->ranges.push_back(range);
+        }
+        queue = (queue + 1) % m_queues.size();
+    }
+    m_wake.notify_all();
+
+    // help out until every chunk of this batch is done
+    while (batch.remaining.load(std::memory_order_acquire)) {
+        if (!runOne(self))
+            std::this_thread::yield();
+    }
+}
+
+ofxAI::BehaviourTree::TaskPool & ofxAI::BehaviourTree::TaskPool::shared() {
+    static TaskPool pool;
+    return pool;
+}
+
+bool ofxAI::BehaviourTree::TaskPool::runOne(size_t self) {
+    Range range = { nullptr, 0, 0 };
+    size_t queues = m_queues.size();
+    if (self < queues) {
+        auto& own = *m_queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.ranges.empty()) {
+            range = own.ranges.back();
+            own.ranges.pop_back();
+        }
+    }
+    for (size_t i = 0; !range.batch && (i < queues); i++) {
+        size_t victim = (self < queues) ? (self + 1 + i) % queues : i;
+        if (victim == self)
+            continue;
+        auto& other = *m_queues[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.ranges.empty()) {
+            range = other.ranges.front();
+            other.ranges.pop_front();
+        }
+    }
+    if (!range.batch)
+        return false;
+    m_pending--;
+    for (size_t index = range.begin; index < range.end; index++)
+        (*range.batch->task)(index);
+    // last access to the batch - its owner may return right after this
+    range.batch->remaining.fetch_sub(range.end - range.begin, std::memory_order_release);
+    return true;
+}
+
+void ofxAI::BehaviourTree::TaskPool::work(size_t self) {
+    currentWorker = self;
+    currentPool = this;
+    for (;;) {
+        if (runOne(self))
+            continue;
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this]() { return m_stop || (m_pending > 0); });
+        if (m_stop)
+            return;
+    }
+}
+
+ofxAI::BehaviourTree::AgentPool::AgentPool(Tree::CompiledTreePtr tree, TaskPool & pool)
+    : m_tree(tree)
+    , m_pool(pool)
+    , m_grain(64) {
+}
+
+size_t ofxAI::BehaviourTree::AgentPool::addAgent() {
+    return addAgent(std::make_shared<SlotBlackboard>());
+}
+
+size_t ofxAI::BehaviourTree::AgentPool::addAgent(Tree::BlackboardPtr blackboard) {
+    m_agents.emplace_back(m_tree, blackboard);
+    m_agents.back().setTaskPool(&m_pool);
+    m_results.push_back(Status::Invalid);
+    return m_agents.size() - 1;
+}
+
+std::vector<ofxAI::BehaviourTree::Status> const & ofxAI::BehaviourTree::AgentPool::tick() {
+    m_pool.parallelFor(m_agents.size(), m_grain, [this](size_t index) {
+        m_results[index] = m_agents[index].tick();
+    });
+    return m_results;
+}
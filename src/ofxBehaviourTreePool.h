@@ -0,0 +1,103 @@
+#pragma once
+#include "ofxBehaviourTree.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace ofxAI {
+    namespace BehaviourTree {
+
+        /*
+         * Task pool: a fixed set of worker threads that run index ranges of
+         * parallelFor calls. Every worker owns a queue of ranges; it pops
+         * from the back of its own queue and steals from the front of the
+         * others' once it runs dry. The thread calling parallelFor helps
+         * with the work until all of it is done, so calls may nest.
+         */
+        class TaskPool {
+        public:
+            using Task = std::function<void(size_t index)>;
+
+            // 0 workers: one per hardware thread, minus the calling thread
+            explicit TaskPool(size_t workers = 0);
+            ~TaskPool();
+            TaskPool(const TaskPool&) = delete;
+            TaskPool& operator=(const TaskPool&) = delete;
+
+            size_t workers() const { return m_threads.size(); }
+
+            // runs task(i) for every i in [0, count), in chunks of grain
+            // indices, returning once every call has finished
+            void parallelFor(size_t count, size_t grain, Task const & task);
+
+            static TaskPool& shared();
+        protected:
+            struct Batch {
+                const Task* task;
+                std::atomic<size_t> remaining;
+            };
+            struct Range {
+                Batch* batch;
+                size_t begin;
+                size_t end;
+            };
+            struct Queue {
+                std::mutex mutex;
+                std::deque<Range> ranges;
+            };
+
+            bool runOne(size_t self);
+            void work(size_t self);
+
+            std::vector<std::unique_ptr<Queue>> m_queues;
+            std::vector<std::thread> m_threads;
+            std::atomic<size_t> m_pending;
+            std::mutex m_sleepMutex;
+            std::condition_variable m_wake;
+            bool m_stop;
+        };
+
+
+        /*
+         * Agent pool: a batch of agents sharing one compiled tree, ticked
+         * together across a TaskPool. Results are stored by agent index,
+         * so they come out in the same order whichever thread ran them.
+         * ConcurrentParallel nodes of the agents run on the same pool.
+         *
+         * Each agent is ticked by a single thread at a time, and scopes
+         * pushed while ticking go on that thread's own scratch stack.
+         * Blackboards are not synchronized: giving every agent its own
+         * SlotBlackboard (the default) is safe, sharing one blackboard
+         * between agents is only safe if it does its own locking.
+         * String-keyed fact access hashes the name under FactTable's
+         * shared lock, so leaves should use FactIds on the hot path.
+         */
+        class AgentPool {
+        public:
+            AgentPool(Tree::CompiledTreePtr tree, TaskPool& pool = TaskPool::shared());
+
+            // returns the new agent's index
+            size_t addAgent();
+            size_t addAgent(Tree::BlackboardPtr blackboard);
+
+            Tree& getAgent(size_t index) { return m_agents[index]; }
+            size_t size() const { return m_agents.size(); }
+
+            // agents handed to each task; smaller balances better, larger
+            // spends less time on scheduling
+            void setGrain(size_t grain) { m_grain = grain ? grain : 1; }
+
+            // ticks every agent once, returning their statuses by index
+            std::vector<Status> const & tick();
+            std::vector<Status> const & getResults() const { return m_results; }
+        protected:
+            Tree::CompiledTreePtr m_tree;
+            TaskPool& m_pool;
+            std::vector<Tree> m_agents;
+            std::vector<Status> m_results;
+            size_t m_grain;
+        };
+    }
+}
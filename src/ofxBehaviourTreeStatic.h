@@ -0,0 +1,274 @@
+#pragma once
+#include "ofxBehaviourTree.h"
+#include <array>
+#include <tuple>
+#include <utility>
+
+namespace ofxAI {
+    namespace BehaviourTree {
+
+        /*
+         * Static trees: the Node builder DSL as types, for the few trees
+         * that run on so many agents that the per-node dispatch of a
+         * CompiledTree shows up. A tree is written as one type:
+         *
+         *     using Guard = Static::Tree<
+         *         Static::Selector<
+         *             Static::Sequence<BT_STATIC_LEAF(canSee), BT_STATIC_LEAF(attack)>,
+         *             Static::Negate<BT_STATIC_LEAF(isHurt)>,
+         *             BT_STATIC_LEAF(patrol)>>;
+         *
+         * and every tick resolves at compile time, so the compiler can
+         * inline the whole tree into Tree::tick(). Leaves are functions
+         * or default-constructible functors taking the context passed to
+         * tick() - usually the agent - and returning a Status or a bool,
+         * where true is Success.
+         *
+         * Nodes behave as their Node DSL namesakes do in a CompiledTree,
+         * preemption of memory composites included. A Static::Tree holds
+         * nothing but their running state, so it costs a few bytes per
+         * agent and never allocates. There are no refs, named leaves,
+         * decorator functions or fact nodes; leaves read the blackboard
+         * themselves.
+         */
+        namespace Static {
+
+            // Static::Leaf calling 'function'
+#define BT_STATIC_LEAF(function) ::ofxAI::BehaviourTree::Static::Leaf<decltype(&function), &function>
+
+            // state slot of a stateful node, stamped with the tick that
+            // last touched it like the ones of a Tree
+            struct Slot {
+                uint32_t value = 0;
+                uint32_t tick = 0;
+            };
+
+            // nodes without running state
+            struct NoState {};
+
+            inline uint32_t& touch(Slot& slot, uint32_t now) {
+                // not ticked on the previous tick: whatever it was running got preempted
+                if (slot.tick + 1 < now)
+                    slot.value = 0;
+                slot.tick = now;
+                return slot.value;
+            }
+
+            inline Status toStatus(Status status) { return status; }
+            inline Status toStatus(bool success) { return success ? Status::Success : Status::Failure; }
+
+            /*
+             * Leaf: calls a function taking the context, such as
+             * Status canSee(Agent&). Written BT_STATIC_LEAF(canSee), as
+             * C++14 needs the function's type spelled out.
+             */
+            template <typename F, F Function>
+            struct Leaf {
+                using State = NoState;
+                template <typename Context>
+                static Status tick(Context& context, State&, uint32_t) {
+                    return toStatus(Function(context));
+                }
+            };
+
+            /*
+             * Functor leaf: calls a default-constructed F with the context.
+             */
+            template <typename F>
+            struct Functor {
+                using State = NoState;
+                template <typename Context>
+                static Status tick(Context& context, State&, uint32_t) {
+                    return toStatus(F()(context));
+                }
+            };
+
+            namespace detail {
+                // ticks children I onwards, skipping those before 'first',
+                // while they return Proceed, setting 'stopped' to the one
+                // that did not
+                template <Status Proceed, size_t I, typename... Children>
+                struct TickChildren {
+                    template <typename Context, typename States>
+                    static Status tick(Context&, States&, uint32_t, size_t, size_t&) {
+                        return Proceed;
+                    }
+                };
+
+                template <Status Proceed, size_t I, typename Child, typename... Rest>
+                struct TickChildren<Proceed, I, Child, Rest...> {
+                    template <typename Context, typename States>
+                    static Status tick(Context& context, States& states, uint32_t now, size_t first, size_t& stopped) {
+                        if (I >= first) {
+                            Status status = Child::tick(context, std::get<I>(states), now);
+                            if (status != Proceed) {
+                                stopped = I;
+                                return status;
+                            }
+                        }
+                        return TickChildren<Proceed, I + 1, Rest...>::tick(context, states, now, first, stopped);
+                    }
+                };
+
+                template <Status Proceed, Status Exhausted, typename... Children>
+                struct Composite {
+                    static_assert(sizeof...(Children) > 0, "composites need at least one child");
+                    using State = std::tuple<typename Children::State...>;
+                    template <typename Context>
+                    static Status tick(Context& context, State& state, uint32_t now) {
+                        size_t stopped = sizeof...(Children);
+                        auto status = TickChildren<Proceed, 0, Children...>::tick(context, state, now, 0, stopped);
+                        return stopped == sizeof...(Children) ? Exhausted : status;
+                    }
+                };
+
+                // resumes from the child that returned Running on the previous tick
+                template <Status Proceed, Status Exhausted, typename... Children>
+                struct MemComposite {
+                    static_assert(sizeof...(Children) > 0, "composites need at least one child");
+                    struct State {
+                        Slot resume;
+                        std::tuple<typename Children::State...> children;
+                    };
+                    template <typename Context>
+                    static Status tick(Context& context, State& state, uint32_t now) {
+                        uint32_t& resume = touch(state.resume, now);
+                        size_t stopped = sizeof...(Children);
+                        auto status =
+                            TickChildren<Proceed, 0, Children...>::tick(context, state.children, now, resume, stopped);
+                        if (stopped == sizeof...(Children)) {
+                            resume = 0;
+                            return Exhausted;
+                        }
+                        resume = (status == Status::Running) ? (uint32_t)stopped : 0;
+                        return status;
+                    }
+                };
+
+                // Success and Failure go through Map, the rest is returned as is
+                template <typename Map, typename Child>
+                struct Decorator {
+                    using State = typename Child::State;
+                    template <typename Context>
+                    static Status tick(Context& context, State& state, uint32_t now) {
+                        auto status = Child::tick(context, state, now);
+                        if ((status != Status::Success) && (status != Status::Failure))
+                            return status;
+                        return Map::map(status);
+                    }
+                };
+
+                struct Succeed {
+                    static Status map(Status) { return Status::Success; }
+                };
+                struct Fail {
+                    static Status map(Status) { return Status::Failure; }
+                };
+                struct Invert {
+                    static Status map(Status status) {
+                        return status == Status::Success ? Status::Failure : Status::Success;
+                    }
+                };
+            }
+
+            template <typename... Children>
+            struct Sequence : detail::Composite<Status::Success, Status::Success, Children...> {};
+            template <typename... Children>
+            struct Selector : detail::Composite<Status::Failure, Status::Failure, Children...> {};
+            template <typename... Children>
+            struct UntilFalse : detail::Composite<Status::Success, Status::Running, Children...> {};
+            template <typename... Children>
+            struct UntilTrue : detail::Composite<Status::Failure, Status::Running, Children...> {};
+
+            template <typename... Children>
+            struct MemSequence : detail::MemComposite<Status::Success, Status::Success, Children...> {};
+            template <typename... Children>
+            struct MemSelector : detail::MemComposite<Status::Failure, Status::Failure, Children...> {};
+            template <typename... Children>
+            struct MemUntilFalse : detail::MemComposite<Status::Success, Status::Running, Children...> {};
+            template <typename... Children>
+            struct MemUntilTrue : detail::MemComposite<Status::Failure, Status::Running, Children...> {};
+
+            template <typename Child>
+            struct ReturnTrue : detail::Decorator<detail::Succeed, Child> {};
+            template <typename Child>
+            struct ReturnFalse : detail::Decorator<detail::Fail, Child> {};
+            template <typename Child>
+            struct Negate : detail::Decorator<detail::Invert, Child> {};
+
+            /*
+             * Parallel node with explicit thresholds; children that
+             * finished are not ticked again until the node does.
+             */
+            template <size_t SuccessThreshold, size_t FailureThreshold, typename... Children>
+            struct Parallel {
+                static_assert(sizeof...(Children) > 0, "composites need at least one child");
+                static const size_t Count = sizeof...(Children);
+                struct State {
+                    std::array<Slot, Count> finished;   // Success or Failure, 0 while running
+                    std::tuple<typename Children::State...> children;
+                };
+                template <typename Context>
+                static Status tick(Context& context, State& state, uint32_t now) {
+                    bool invalid = false;
+                    tickAll(context, state, now, invalid, std::index_sequence_for<Children...>());
+                    size_t nSuccess = 0;
+                    size_t nFailure = 0;
+                    for (auto& slot : state.finished) {
+                        nSuccess += (slot.value == (uint32_t)Status::Success);
+                        nFailure += (slot.value == (uint32_t)Status::Failure);
+                    }
+                    Status result = Status::Running;
+                    if (invalid)
+                        result = Status::Invalid;
+                    else if (nSuccess >= SuccessThreshold)
+                        result = Status::Success;
+                    else if ((nFailure >= FailureThreshold) || (nSuccess + nFailure == Count))
+                        result = Status::Failure;
+                    if (result != Status::Running) {
+                        for (auto& slot : state.finished)
+                            slot.value = 0;
+                    }
+                    return result;
+                }
+            protected:
+                template <typename Context, size_t... I>
+                static void tickAll(Context& context, State& state, uint32_t now, bool& invalid, std::index_sequence<I...>) {
+                    // in order, as the elements of an initializer list are
+                    int ticked[] = { (tickOne<I, Children>(context, state, now, invalid), 0)... };
+                    (void)ticked;
+                }
+                template <size_t I, typename Child, typename Context>
+                static void tickOne(Context& context, State& state, uint32_t now, bool& invalid) {
+                    uint32_t& finished = touch(state.finished[I], now);
+                    if (finished)
+                        return;
+                    auto status = Child::tick(context, std::get<I>(state.children), now);
+                    if ((status == Status::Success) || (status == Status::Failure))
+                        finished = (uint32_t)status;
+                    invalid |= (status == Status::Invalid);
+                }
+            };
+
+            /*
+             * Per-agent instance of a static tree: the running state of
+             * its nodes, and the tick counter preemption is judged by.
+             */
+            template <typename Root>
+            class Tree {
+            public:
+                template <typename Context>
+                Status tick(Context& context) {
+                    return Root::tick(context, m_state, ++m_tick);
+                }
+                // aborts running nodes, so the next tick starts from scratch
+                void reset() {
+                    m_state = typename Root::State();
+                }
+            protected:
+                typename Root::State m_state = {};
+                uint32_t m_tick = 0;
+            };
+        }
+    }
+}
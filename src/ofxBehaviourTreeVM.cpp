@@ -1,170 +1,853 @@
 #include "ofxBehaviourTreeVM.h"
+#include "ofxBehaviourTreeVMVerifier.h"
+#if BTVM_PROFILE
+#include "ofxBehaviourTreeVMProfiler.h"
+#endif
+
+// Programs are verified when they are linked, so the interpreter trusts
+// them and skips all per-instruction checks. Checked builds, the default
+// without NDEBUG, still bounds-check the program counter and opcodes.
+#ifndef BTVM_CHECKED
+#ifdef NDEBUG
+#define BTVM_CHECKED 0
+#else
+#define BTVM_CHECKED 1
+#endif
+#endif
+
+// Leaf and decorator calls, and instruction counts, go through the VM's
+// profiler in profiling builds; otherwise they are plain calls and the
+// counting compiles away. Both need 'profiler' in scope.
+#if BTVM_PROFILE
+#define BTVM_COUNT(pc, opcode) if (profiler) profiler->countInstruction((pc), (opcode))
+#define BTVM_RUN_LEAF(leaf) \
+    (profiler ? profiler->runLeaf((leaf), thread, blackboard) : m_leaves[leaf](thread, blackboard))
+#define BTVM_RUN_DECORATOR(decorator) \
+    (profiler ? profiler->runDecorator((decorator), thread, blackboard) : m_decoratorNodes[decorator](thread, blackboard))
+#else
+#define BTVM_COUNT(pc, opcode)
+#define BTVM_RUN_LEAF(leaf) m_leaves[leaf](thread, blackboard)
+#define BTVM_RUN_DECORATOR(decorator) m_decoratorNodes[decorator](thread, blackboard)
+#endif
 
 namespace {
-    template <size_t opcode_val, typename u_type, typename s_type>
-    struct vm_opcode {
-        using op_type = s_type;
-        static constexpr op_type opcode = opcode_val;
-        using successor = vm_opcode<opcode_val + 1, u_type, s_type>;
-    };
 
-    template <size_t opcode_val>
-    using btvm_opcode = vm_opcode<opcode_val, uint16_t, int16_t>;
+    // instructions run between reads of the clock when running against
+    // a deadline
+    const size_t ClockInterval = 256;
 
-    const std::string empty_str;
+    ofxAI::BTVM::Status parallelStatus(size_t nSuccess, size_t nFailure, size_t count,
+                                       size_t successThreshold, size_t failureThreshold) {
+        using ofxAI::BTVM::Status;
+        if (nSuccess >= successThreshold)
+            return Status::Success;
+        if (nFailure >= failureThreshold)
+            return Status::Failure;
+        if (nSuccess + nFailure == count)
+            return Status::Failure;
+        return Status::Running;
+    }
 }
 
 namespace ofxAI {
     namespace BTVM {
-        struct BehaviorTreeVMProgram {
-
-            using bt_runner = std::function<Status(BehaviorTreeVMThread*, DictBlackboard*)>;
-            using bt_decorator = std::function<Status(BehaviorTreeVMThread*, DictBlackboard*)>;
-
-            struct ops {
-                using run = btvm_opcode<0>;     // run the specified leaf node
-                using run_thr = run::successor;     // run from specified stream
-                using run_dec = run_thr::successor; // run a decorator
-                using bra_f = run_dec::successor; // branch if current value is Failure
-                using bra_t = bra_f::successor;   // branch if current value is Success
-                using set_f = bra_t::successor;   // set Failure
-                using set_t = set_f::successor;   // set Success
-                using neg = set_t::successor;   // swap between Failure<->Success
-                using chk_fact = neg::successor;     // check if fact with string (pc+1) is present in the blackboard
-                using rm_fact = chk_fact::successor; // remove blackboard fact with string (pc+1)
-                using dbg_break = rm_fact::successor; // break mid-tree for debugging
-                using log = dbg_break::successor; // output a string along with the current state
-            };
 
-            using op_type = ops::run::op_type;
-            std::vector<op_type> m_program;
-            std::vector<bt_runner> m_leaves;
-            std::vector<bt_decorator> m_decoratorNodes;
-            std::vector<std::string> m_stringTable;
+        bool BehaviorTreeVMProgram::eval(BehaviorTreeVM* vm, BehaviorTreeVMThread * thread, DictBlackboard * blackboard) const {
+#if BTVM_CHECKED
+            if (!vm || !thread || !blackboard || (thread->m_pc < 0) || ((size_t)thread->m_pc >= codeSize()))
+                return false;
+#endif
+            const op_type* code = this->code() + thread->m_pc;
+#if BTVM_PROFILE
+            BehaviorTreeVMProfiler* profiler = vm->m_profiler;
+#endif
+            BTVM_COUNT(thread->m_pc, code[0]);
+            switch (code[0]) {
+            case ops::run::opcode:
+                return settle(vm, thread, BTVM_RUN_LEAF(code[1]), 2);
+            case ops::run_bra_f::opcode:
+            case ops::run_bra_t::opcode:
+            {
+                Status status = BTVM_RUN_LEAF(code[1]);
+                Status taken = (code[0] == ops::run_bra_f::opcode) ? Status::Failure : Status::Success;
+                if (status == taken) {
+                    thread->m_current = status;
+                    thread->m_pc += code[2];
+                    return true;
+                }
+                return settle(vm, thread, status, 3);
+            }
+            case ops::run_thr::opcode:
+                return settle(vm, thread, vm->runThread(code[1]), 2);
+            case ops::run_dec::opcode:
+                return settle(vm, thread, BTVM_RUN_DECORATOR(code[1]), 2);
+            case ops::rsm_thr::opcode:
+            {
+                if (!vm->threadInProgress(code[1])) {
+                    thread->m_pc += 3;
+                    return true;
+                }
+                Status status = vm->runThread(code[1]);
+                if ((status == Status::Success) || (status == Status::Failure)) {
+                    thread->m_current = status;
+                    thread->m_pc += code[2];
+                    return true;
+                }
+                return settle(vm, thread, status, 3);
+            }
+            case ops::run_par::opcode:
+                return settle(vm, thread, vm->runParallel(code[1], code[2], code[3], code[4]), 5);
 
-            Status eval(BehaviorTreeVM* vm, BehaviorTreeVMThread * thread, DictBlackboard * blackboard) {
-                if (!thread || !blackboard)
-                    return Status::Invalid;
+            case ops::bra_f::opcode:
+                if (thread->m_current == Status::Failure) {
+                    thread->m_pc += code[1];
+                }
+                else {
+                    thread->m_pc += 2;
+                }
+                return true;
+            case ops::bra_t::opcode:
+                if (thread->m_current == Status::Success) {
+                    thread->m_pc += code[1];
+                }
+                else {
+                    thread->m_pc += 2;
+                }
+                return true;
+            case ops::jmp::opcode:
+                thread->m_pc += code[1];
+                return true;
+            case ops::call::opcode:
+#if BTVM_CHECKED
+                if (thread->m_callDepth >= BehaviorTreeVMThread::MaxCallDepth) {
+                    thread->m_current = Status::Invalid;
+                    return false;
+                }
+#endif
+                thread->m_returns[thread->m_callDepth++] = (int32_t)(thread->m_pc + 2);
+                thread->m_pc += code[1];
+                return true;
+            case ops::ret::opcode:
+#if BTVM_CHECKED
+                if (thread->m_callDepth == 0) {
+                    thread->m_current = Status::Invalid;
+                    return false;
+                }
+#endif
+                thread->m_pc = thread->m_returns[--thread->m_callDepth];
+                return true;
+            case ops::set_f::opcode:
+                thread->m_current = Status::Failure;
+                thread->m_pc++;
+                return true;
+            case ops::set_t::opcode:
+                thread->m_current = Status::Success;
+                thread->m_pc++;
+                return true;
+            case ops::set_r::opcode:
+                thread->m_current = Status::Running;
+                thread->m_pc++;
+                yield(vm, thread);
+                return false;
+            case ops::neg::opcode:
+                thread->m_current =
+                    (thread->m_current == Status::Failure ? Status::Success :
+                    (thread->m_current == Status::Success ? Status::Failure :
+                        thread->m_current));
+                thread->m_pc++;
+                return true;
+            case ops::chk_fact::opcode:
+                if (blackboard->hasFact(m_factIds[code[1]]))
+                    thread->m_current = Status::Success;
+                else
+                    thread->m_current = Status::Failure;
+                thread->m_pc += 2;
+                return true;
+            case ops::rm_fact::opcode:
+                blackboard->removeFact(m_factIds[code[1]]);
+                thread->m_current = Status::Success;
+                thread->m_pc += 2;
+                return true;
+            case ops::wait_fact::opcode:
+                if (blackboard->hasFact(m_factIds[code[1]])) {
+                    thread->m_current = Status::Success;
+                    thread->m_pc += 2;
+                    return true;
+                }
+                thread->m_current = vm->waitForFact(thread, m_factIds[code[1]]);
+                return false;
+            case ops::set_fact::opcode:
+                blackboard->setValue(m_factIds[code[1]], m_constants[code[2]]);
+                thread->m_current = Status::Success;
+                thread->m_pc += 3;
+                return true;
+            case ops::eq_fact::opcode:
+            {
+                const BehaviourTree::Value* value = blackboard->findValue(m_factIds[code[1]]);
+                if (!value) {
+                    thread->m_current = Status::Invalid;
+                    return false;
+                }
+                thread->m_current = (*value == m_constants[code[2]]) ? Status::Success : Status::Failure;
+                thread->m_pc += 3;
+                return true;
+            }
+            case ops::end::opcode:
+                return false;
+            case ops::set_i::opcode:
+            default:
                 thread->m_current = Status::Invalid;
-                op_type op = m_program[thread->m_pc];
-                switch (op) {
-                case ops::run::opcode:
-                    thread->m_current = m_leaves[m_program[thread->m_pc + 1]](thread, blackboard);
-                    if ((thread->m_current == Status::Failure) ||
-                        (thread->m_current == Status::Success) ||
-                        (thread->m_current == Status::Running)) {
-                        thread->m_pc += 2;
-                        return Status::Running;
-                    }
-                    else {
-                        return thread->m_current;
-                    }
-                case ops::run_thr::opcode:
-                {
-                    auto& other_thread = vm->m_threads[m_program[thread->m_pc + 1]];
-                    eval(vm, &other_thread, blackboard);
-                    thread->m_current = other_thread.m_current;
-                    if (thread->m_current != Status::Invalid) {
-                        thread->m_pc += 2;
-                        return Status::Running;
+                return false;
+            }
+        }
+
+        const char* BehaviorTreeVMProgram::mnemonic(op_type opcode) {
+            static const char* const names[] = {
+                "run", "run_thr", "run_dec", "bra_f", "bra_t", "set_f", "set_t", "neg",
+                "chk_fact", "rm_fact", "dbg_break", "log", "jmp", "set_r", "set_i", "end",
+                "rsm_thr", "run_par", "wait_fact", "set_fact", "eq_fact", "run_bra_f", "run_bra_t",
+                "call", "ret"
+            };
+            static_assert(sizeof(names) / sizeof(names[0]) == OpcodeCount, "every opcode needs a name");
+            if ((opcode < 0) || ((size_t)opcode >= OpcodeCount))
+                return nullptr;
+            return names[opcode];
+        }
+
+        std::string const & BehaviorTreeVMProgram::sourceRef(size_t pc) const {
+            static const std::string none;
+            auto after = std::upper_bound(m_sourceMap.begin(), m_sourceMap.end(), pc,
+                [](size_t pc, SourceLocation const & location) { return pc < location.pc; });
+            return (after == m_sourceMap.begin()) ? none : (after - 1)->ref;
+        }
+
+        bool BehaviorTreeVMProgram::link() {
+            m_factIds.clear();
+            for (auto& str : m_stringTable)
+                m_factIds.push_back(BehaviourTree::FactTable::intern(str));
+            if (!m_image) {
+                m_code = m_program.data();
+                m_codeSize = m_program.size();
+            }
+            m_verified = BehaviorTreeVMVerifier::verify(*this);
+            m_instructionStarts = BehaviorTreeVMVerifier::instructionStarts(*this);
+            return m_verified;
+        }
+
+        // The interpreter loop keeps the program counter and the current
+        // value in locals, and only writes them back to the thread before
+        // calling out and once it stops. Where the compiler supports
+        // taking the address of labels every instruction jumps straight to
+        // the next one's handler; elsewhere, or when BTVM_COMPUTED_GOTO is
+        // defined to 0, it falls back to a switch.
+#ifndef BTVM_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define BTVM_COMPUTED_GOTO 1
+#else
+#define BTVM_COMPUTED_GOTO 0
+#endif
+#endif
+
+// Every instruction takes one unit of fuel; a thread that runs out asks
+// the VM for more, and stops before the instruction once the budget is
+// spent. Threads called from here run on the same fuel.
+#define BTVM_FUEL()                                                         \
+            if (!fuel && !(fuel = vm->refuel()))                            \
+                goto preempt;                                               \
+            fuel--;
+#define BTVM_CALL(call)                                                     \
+            thread->m_pc = pc - code;                                       \
+            vm->m_fuel = fuel;                                              \
+            current = (call);                                               \
+            fuel = vm->m_fuel
+// Decorators cannot tell a preempted child from a running one, and
+// parallels would have to run some children twice to pick up where they
+// stopped, so both run to the end and are charged for it afterwards.
+#define BTVM_CALL_WHOLE(call)                                               \
+            thread->m_pc = pc - code;                                       \
+            vm->m_fuel = BehaviorTreeVM::Unlimited;                         \
+            current = (call);                                               \
+            fuel = vm->charge(fuel, BehaviorTreeVM::Unlimited - vm->m_fuel)
+
+#if BTVM_COMPUTED_GOTO
+#define BTVM_OP(op) op_##op: BTVM_FUEL() BTVM_COUNT(pc - code, ops::op::opcode);
+#define BTVM_INVALID op_invalid:
+#if BTVM_CHECKED
+#define BTVM_NEXT() \
+            goto *(((size_t)(pc - code) < size) && ((uint16_t)*pc < opCount) ? dispatch[*pc] : &&op_invalid)
+#else
+#define BTVM_NEXT() goto *dispatch[*pc]
+#endif
+#else
+#define BTVM_OP(op) case ops::op::opcode: BTVM_FUEL() BTVM_COUNT(pc - code, ops::op::opcode);
+#define BTVM_INVALID default:
+#define BTVM_NEXT() continue
+#endif
+
+// Success and Failure move on by 'size', Running yields, anything else stops
+#define BTVM_SETTLE(size)                                                   \
+            if ((current == Status::Success) || (current == Status::Failure)) { \
+                pc += (size);                                               \
+                BTVM_NEXT();                                                \
+            }                                                               \
+            if (current == Status::Running)                                 \
+                goto yield;                                                 \
+            goto stop
+
+        Status BehaviorTreeVMProgram::execute(BehaviorTreeVM* vm, BehaviorTreeVMThread * thread, DictBlackboard * blackboard) const {
+            if (m_native)
+                return m_native(*this, vm, thread, blackboard);
+            const op_type* code = this->code();
+#if BTVM_CHECKED
+            const size_t size = codeSize();
+#endif
+            const op_type* pc = code + thread->m_pc;
+            Status current = thread->m_current;
+            size_t fuel = vm->m_fuel;
+            bool reactive = m_threadEntries[vm->getThreadIndex(thread)].mode == BehaviourTree::CompositeMode::Reactive;
+#if BTVM_PROFILE
+            BehaviorTreeVMProfiler* profiler = vm->m_profiler;
+#endif
+
+#if BTVM_COMPUTED_GOTO
+            static const void* const dispatch[] = {
+                &&op_run, &&op_run_thr, &&op_run_dec, &&op_bra_f, &&op_bra_t,
+                &&op_set_f, &&op_set_t, &&op_neg, &&op_chk_fact, &&op_rm_fact,
+                &&op_invalid, &&op_invalid, // dbg_break, log
+                &&op_jmp, &&op_set_r, &&op_invalid, &&op_end, &&op_rsm_thr,
+                &&op_run_par, &&op_wait_fact, &&op_set_fact, &&op_eq_fact,
+                &&op_run_bra_f, &&op_run_bra_t, &&op_call, &&op_ret
+            };
+#if BTVM_CHECKED
+            const uint16_t opCount = sizeof(dispatch) / sizeof(dispatch[0]);
+#endif
+            static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == OpcodeCount,
+                "every opcode needs a dispatch entry");
+            BTVM_NEXT();
+#else
+            for (;;) {
+#if BTVM_CHECKED
+                if ((size_t)(pc - code) >= size)
+                    goto invalid;
+#endif
+                switch (*pc) {
+#endif
+                BTVM_OP(run)
+                    BTVM_CALL(BTVM_RUN_LEAF(pc[1]));
+                    BTVM_SETTLE(2);
+                BTVM_OP(run_bra_f)
+                    BTVM_CALL(BTVM_RUN_LEAF(pc[1]));
+                    if (current == Status::Failure) {
+                        pc += pc[2];
+                        BTVM_NEXT();
                     }
-                    else {
-                        return thread->m_current;
+                    BTVM_SETTLE(3);
+                BTVM_OP(run_bra_t)
+                    BTVM_CALL(BTVM_RUN_LEAF(pc[1]));
+                    if (current == Status::Success) {
+                        pc += pc[2];
+                        BTVM_NEXT();
                     }
-                }
-                case ops::run_dec::opcode:
-                    thread->m_current = m_leaves[m_program[thread->m_pc + 1]](thread, blackboard);
-                    if ((thread->m_current == Status::Failure) ||
-                        (thread->m_current == Status::Success) ||
-                        (thread->m_current == Status::Running)) {
-                        thread->m_pc += 2;
-                        return Status::Running;
+                    BTVM_SETTLE(3);
+                BTVM_OP(run_thr)
+                    BTVM_CALL(vm->runThread(pc[1]));
+                    BTVM_SETTLE(2);
+                BTVM_OP(run_dec)
+                    BTVM_CALL_WHOLE(BTVM_RUN_DECORATOR(pc[1]));
+                    BTVM_SETTLE(2);
+                BTVM_OP(rsm_thr)
+                    if (!vm->threadInProgress(pc[1])) {
+                        pc += 3;
+                        BTVM_NEXT();
                     }
-                    else {
-                        return thread->m_current;
+                    BTVM_CALL(vm->runThread(pc[1]));
+                    if ((current == Status::Success) || (current == Status::Failure)) {
+                        pc += pc[2];
+                        BTVM_NEXT();
                     }
-
-                case ops::bra_f::opcode:
-                    if (thread->m_current == Status::Failure) {
-                        op_type off = m_program[thread->m_pc + 1];
-                        thread->m_pc += off;
+                    BTVM_SETTLE(3);
+                BTVM_OP(run_par)
+                    BTVM_CALL_WHOLE(vm->runParallel(pc[1], pc[2], pc[3], pc[4]));
+                    BTVM_SETTLE(5);
+                BTVM_OP(bra_f)
+                    pc += (current == Status::Failure) ? pc[1] : 2;
+                    BTVM_NEXT();
+                BTVM_OP(bra_t)
+                    pc += (current == Status::Success) ? pc[1] : 2;
+                    BTVM_NEXT();
+                BTVM_OP(jmp)
+                    pc += pc[1];
+                    BTVM_NEXT();
+                BTVM_OP(call)
+#if BTVM_CHECKED
+                    if (thread->m_callDepth >= BehaviorTreeVMThread::MaxCallDepth) {
+                        current = Status::Invalid;
+                        goto stop;
                     }
-                    else {
-                        thread->m_pc += 2;
+#endif
+                    thread->m_returns[thread->m_callDepth++] = (int32_t)(pc + 2 - code);
+                    pc += pc[1];
+                    BTVM_NEXT();
+                BTVM_OP(ret)
+#if BTVM_CHECKED
+                    if (thread->m_callDepth == 0) {
+                        current = Status::Invalid;
+                        goto stop;
                     }
-                    return Status::Running;
-                case ops::bra_t::opcode:
-                    if (thread->m_current == Status::Success) {
-                        op_type off = m_program[thread->m_pc + 1];
-                        thread->m_pc += off;
+#endif
+                    pc = code + thread->m_returns[--thread->m_callDepth];
+                    BTVM_NEXT();
+                BTVM_OP(set_f)
+                    current = Status::Failure;
+                    pc++;
+                    BTVM_NEXT();
+                BTVM_OP(set_t)
+                    current = Status::Success;
+                    pc++;
+                    BTVM_NEXT();
+                BTVM_OP(set_r)
+                    current = Status::Running;
+                    pc++;
+                    goto yield;
+                BTVM_OP(neg)
+                    if (current == Status::Failure)
+                        current = Status::Success;
+                    else if (current == Status::Success)
+                        current = Status::Failure;
+                    pc++;
+                    BTVM_NEXT();
+                BTVM_OP(chk_fact)
+                    current = blackboard->hasFact(m_factIds[pc[1]]) ? Status::Success : Status::Failure;
+                    pc += 2;
+                    BTVM_NEXT();
+                BTVM_OP(rm_fact)
+                    blackboard->removeFact(m_factIds[pc[1]]);
+                    current = Status::Success;
+                    pc += 2;
+                    BTVM_NEXT();
+                BTVM_OP(wait_fact)
+                    if (blackboard->hasFact(m_factIds[pc[1]])) {
+                        current = Status::Success;
+                        pc += 2;
+                        BTVM_NEXT();
                     }
-                    else {
-                        thread->m_pc += 2;
+                    current = vm->waitForFact(thread, m_factIds[pc[1]]);
+                    goto stop;
+                BTVM_OP(set_fact)
+                    blackboard->setValue(m_factIds[pc[1]], m_constants[pc[2]]);
+                    current = Status::Success;
+                    pc += 3;
+                    BTVM_NEXT();
+                BTVM_OP(eq_fact)
+                {
+                    const BehaviourTree::Value* value = blackboard->findValue(m_factIds[pc[1]]);
+                    if (!value) {
+                        current = Status::Invalid;
+                        goto stop;
                     }
-                    return Status::Running;
-                case ops::set_f::opcode:
-                    thread->m_current = Status::Failure;
-                    thread->m_pc++;
-                    return Status::Running;
-                case ops::set_t::opcode:
-                    thread->m_current = Status::Success;
-                    thread->m_pc++;
-                    return Status::Running;
-                case ops::neg::opcode:
-                    thread->m_current =
-                        (thread->m_current == Status::Failure ? Status::Success :
-                        (thread->m_current == Status::Success ? Status::Failure :
-                            thread->m_current));
-                    thread->m_pc++;
-                    return Status::Running;
-                case ops::chk_fact::opcode:
-                    if (blackboard->hasFact(m_stringTable[thread->m_pc + 1]))
-                        thread->m_current = Status::Success;
-                    else
-                        thread->m_current = Status::Failure;
-                    thread->m_pc += 2;
-                    return Status::Running;
-                case ops::rm_fact::opcode:
-                    blackboard->removeFact(m_stringTable[thread->m_pc + 1]);
-                    thread->m_current = Status::Success;
-                    thread->m_pc += 2;
-                    return Status::Running;
-                default:
-                    return Status::Invalid;
+                    current = (*value == m_constants[pc[2]]) ? Status::Success : Status::Failure;
+                    pc += 3;
+                    BTVM_NEXT();
+                }
+                BTVM_OP(end)
+                    goto stop;
+                BTVM_INVALID
+#if BTVM_CHECKED && !BTVM_COMPUTED_GOTO
+                invalid:
+#endif
+                    current = Status::Invalid;
+                    goto stop;
+#if !BTVM_COMPUTED_GOTO
                 }
             }
-        };
+#endif
 
+        preempt:
+            // parked on this instruction until the VM resumes it
+            thread->m_saved = current;
+            current = Status::Suspended;
+            goto stop;
+        yield:
+            if (reactive) {
+                pc = code + thread->m_threadStart;
+                thread->m_callDepth = 0;
+            }
+        stop:
+            thread->m_pc = pc - code;
+            thread->m_current = current;
+            vm->m_fuel = fuel;
+            return current;
+        }
 
-        Status BehaviorTreeVMThread::step(BehaviorTreeVM * vm) {
-            if (!vm)
-                return Status::Invalid;
+#undef BTVM_SETTLE
+#undef BTVM_CALL
+#undef BTVM_CALL_WHOLE
+#undef BTVM_FUEL
+#undef BTVM_NEXT
+#undef BTVM_INVALID
+#undef BTVM_OP
+
+        // stores the result of a leaf, decorator or thread: Success and
+        // Failure move on to the next instruction, Running yields, and
+        // Suspended parks the thread on this instruction so it runs again
+        // once woken up. Invalid ends the thread.
+        bool BehaviorTreeVMProgram::settle(BehaviorTreeVM* vm, BehaviorTreeVMThread * thread, Status status, off_t size) const {
+            thread->m_current = status;
+            switch (status) {
+            case Status::Success:
+            case Status::Failure:
+                thread->m_pc += size;
+                return true;
+            case Status::Running:
+                yield(vm, thread);
+                return false;
+            default:
+                return false;
+            }
+        }
+
+        void BehaviorTreeVMProgram::yield(BehaviorTreeVM* vm, BehaviorTreeVMThread * thread) const {
+            size_t index = thread - vm->m_threads.data();
+            if (m_threadEntries[index].mode == BehaviourTree::CompositeMode::Reactive) {
+                thread->m_pc = (off_t)thread->m_threadStart;
+                thread->m_callDepth = 0;
+            }
+        }
+
+
+        bool BehaviorTreeVMThread::step(BehaviorTreeVM * vm) {
+            if (!vm || !vm->m_program)
+                return false;
             return vm->m_program->eval(vm, this, &vm->blackboard);
         }
 
         void BehaviorTreeVMThread::reset() {
             m_pc = (off_t)m_threadStart;
             m_current = Status::Invalid;
+            m_saved = Status::Suspended;
+            m_callDepth = 0;
+        }
+
+
+        BehaviorTreeVM::BehaviorTreeVM()
+            : m_host(BehaviourTree::Tree::BlackboardPtr(BehaviourTree::Tree::BlackboardPtr(), &blackboard))
+            , m_tick(0)
+            , m_active(NoThread)
+            , m_fuel(Unlimited)
+            , m_instructions(0)
+            , m_deadline(Clock::time_point::max())
+            , m_outOfBudget(false)
+            , m_preempted(false)
+            , m_resume(NoThread)
+            , m_instructionsRun(0) {
+            blackboard.setListener([this](BehaviourTree::FactId fact) {
+                factChanged(fact);
+            });
         }
 
-        bool DictBlackboard::hasFact(const std::string & fact) const {
-            return m_board.find(fact) != m_board.end();
+        BehaviorTreeVM::BehaviorTreeVM(ProgramPtr program)
+            : BehaviorTreeVM() {
+            load(program);
+        }
+
+        void BehaviorTreeVM::load(ProgramPtr program) {
+            if (program && !program->m_verified)
+                program = ProgramPtr();
+            m_program = program;
+#if BTVM_PROFILE
+            if (m_profiler && (m_profiler->getProgram() != m_program))
+                m_profiler = nullptr;
+#endif
+            m_threads.assign(program ? program->m_threadEntries.size() : 0, BehaviorTreeVMThread());
+            for (size_t i = 0; i < m_threads.size(); i++) {
+                auto& thread = m_threads[i];
+                thread.m_threadStart = program->m_threadEntries[i].start;
+                thread.m_vm = this;
+                thread.m_tick = 0;
+                thread.m_parent = NoThread;
+                thread.reset();
+            }
+            m_ready.clear();
+            m_next.clear();
+            m_factWaiters.clear();
+            m_preempted = false;
+            m_resume = NoThread;
+            // give every fact the program names a slot up front
+            blackboard.reserve();
+            for (size_t i = 0; i < m_threads.size() && i < program->m_roots; i++)
+                m_ready.push_back(i);
         }
 
-        const std::string & DictBlackboard::getFact(const std::string & fact) const {
-            auto found = m_board.find(fact);
-            if (found == m_board.end())
-                return empty_str;
-            return found->second;
+#if BTVM_PROFILE
+        void BehaviorTreeVM::setProfiler(BehaviorTreeVMProfiler* profiler) {
+            m_profiler = (profiler && (profiler->getProgram() == m_program)) ? profiler : nullptr;
         }
+#endif
 
-        void DictBlackboard::removeFact(const std::string & fact) {
-            m_board.erase(fact);
+        void BehaviorTreeVM::reset() {
+            load(m_program);
         }
 
-        void DictBlackboard::setFact(const std::string & fact, const std::string & data) {
-            m_board[fact] = data;
+        Status BehaviorTreeVM::run() {
+            return run(Unlimited);
+        }
+
+        Status BehaviorTreeVM::run(size_t instructions, Clock::time_point deadline) {
+            if (m_threads.empty())
+                return Status::Invalid;
+            // without a deadline the whole budget goes to the first root
+            m_fuel = (deadline == Clock::time_point::max()) ? instructions : 0;
+            m_instructions = instructions - m_fuel;
+            m_deadline = deadline;
+            m_outOfBudget = false;
+            // roots woken up while this runs get their turn straight away
+            while (!m_ready.empty() && !m_outOfBudget) {
+                size_t root = m_ready.front();
+                if (beginRoot(root)) {
+                    m_program->execute(this, &m_threads[root], &blackboard);
+                    if (m_outOfBudget && resumeLater(root)) {
+                        // carries on with this root's tick next time
+                        m_active = NoThread;
+                        m_ready.push_front(root);
+                        m_resume = root;
+                    } else
+                        endRoot(root);
+                }
+            }
+            m_instructionsRun = instructions - (m_instructions + m_fuel);
+            m_preempted = !m_ready.empty();
+            // outside of runs, threads run without a budget
+            m_fuel = Unlimited;
+            m_instructions = 0;
+            m_deadline = Clock::time_point::max();
+            m_outOfBudget = false;
+            if (!m_preempted)
+                std::swap(m_ready, m_next);
+            return m_threads[0].m_current;
+        }
+
+        bool BehaviorTreeVM::beginRoot(size_t root) {
+            if (m_ready.empty() || (m_ready.front() != root))
+                return false;
+            m_ready.pop_front();
+            // every root keeps its own time, which stands still while
+            // it is parked, and while its tick is interrupted
+            m_tick = m_threads[root].m_tick + (root == m_resume ? 0 : 1);
+            m_resume = NoThread;
+            if (!enterThread(root))
+                return false;
+            m_active = root;
+            return true;
+        }
+
+        void BehaviorTreeVM::endRoot(size_t root) {
+            m_active = NoThread;
+            if (m_threads[root].m_current != Status::Suspended)
+                m_next.push_back(root);
+        }
+
+        void BehaviorTreeVM::wake(size_t index) {
+            forgetWaits(index);
+            while (index < m_threads.size()) {
+                auto& thread = m_threads[index];
+                if (thread.m_current != Status::Suspended)
+                    return;
+                // picks up again from the instruction it parked on
+                thread.m_current = Status::Running;
+                if (index < m_program->m_roots) {
+                    m_ready.push_back(index);
+                    return;
+                }
+                index = thread.m_parent;
+            }
+        }
+
+        size_t BehaviorTreeVM::refuel() {
+            if (m_outOfBudget || !m_instructions ||
+                ((m_deadline != Clock::time_point::max()) && (Clock::now() >= m_deadline))) {
+                m_outOfBudget = true;
+                return 0;
+            }
+            size_t fuel = (m_deadline != Clock::time_point::max()) ? std::min(m_instructions, ClockInterval) : m_instructions;
+            m_instructions -= fuel;
+            return fuel;
+        }
+
+        size_t BehaviorTreeVM::charge(size_t fuel, size_t instructions) {
+            if (instructions <= fuel)
+                return fuel - instructions;
+            m_instructions -= std::min(m_instructions, instructions - fuel);
+            return 0;
+        }
+
+        bool BehaviorTreeVM::resumeLater(size_t root) {
+            bool resumed = false;
+            for (size_t i = 0; i < m_threads.size(); i++) {
+                if (m_threads[i].m_saved == Status::Suspended)
+                    continue;
+                for (size_t index = i; (index < m_threads.size()) && (m_threads[index].m_current == Status::Suspended);
+                     index = m_threads[index].m_parent) {
+                    auto& thread = m_threads[index];
+                    thread.m_current = Status::Running;
+                    // callers start over with the instruction that ran
+                    // this one, which sets the current value anyway
+                    if (thread.m_saved == Status::Suspended)
+                        thread.m_saved = Status::Invalid;
+                    resumed |= index == root;
+                }
+            }
+            return resumed;
+        }
+
+        Status BehaviorTreeVM::waitForFact(BehaviorTreeVMThread * thread, const std::string & fact) {
+            return waitForFact(thread, BehaviourTree::FactTable::intern(fact));
+        }
+
+        Status BehaviorTreeVM::waitForFact(BehaviorTreeVMThread * thread, BehaviourTree::FactId fact) {
+            size_t index = getThreadIndex(thread);
+            auto waiters = m_factWaiters.equal_range(fact);
+            for (auto waiter = waiters.first; waiter != waiters.second; ++waiter) {
+                if (waiter->second == index)
+                    return Status::Suspended;
+            }
+            m_factWaiters.emplace(fact, index);
+            return Status::Suspended;
+        }
+
+        void BehaviorTreeVM::forgetWaits(size_t index) {
+            for (auto waiter = m_factWaiters.begin(); waiter != m_factWaiters.end();) {
+                if (waiter->second == index)
+                    waiter = m_factWaiters.erase(waiter);
+                else
+                    ++waiter;
+            }
+        }
+
+        void BehaviorTreeVM::factChanged(BehaviourTree::FactId fact) {
+            auto waiters = m_factWaiters.equal_range(fact);
+            if (waiters.first == waiters.second)
+                return;
+            std::vector<size_t> threads;
+            for (auto waiter = waiters.first; waiter != waiters.second; ++waiter)
+                threads.push_back(waiter->second);
+            m_factWaiters.erase(waiters.first, waiters.second);
+            for (auto thread : threads)
+                wake(thread);
+        }
+
+        Status BehaviorTreeVM::runThread(size_t index) {
+            // verified programs never do this, but leaves can call in
+            if (isRunning(index))
+                return Status::Invalid;
+            // running a thread the budget stopped is free, so every run
+            // gets back to where the last one stopped, however deep
+            if ((m_threads[index].m_saved != Status::Suspended) && (m_fuel != Unlimited))
+                m_fuel++;
+            if (!enterThread(index))
+                return Status::Suspended;
+            size_t active = m_active;
+            m_active = index;
+            m_program->execute(this, &m_threads[index], &blackboard);
+            m_active = active;
+            return m_threads[index].m_current;
+        }
+
+        bool BehaviorTreeVM::enterThread(size_t index) {
+            auto& thread = m_threads[index];
+            bool stale = isStale(thread);
+            thread.m_tick = m_tick;
+            thread.m_parent = m_active;
+            if ((thread.m_current == Status::Suspended) && !stale)
+                return false;
+            if ((thread.m_current != Status::Running) || stale) {
+                // a thread parked on a fact gets here once abandoned
+                if (thread.m_current == Status::Suspended)
+                    forgetWaits(index);
+                thread.reset();
+            }
+            else if (thread.m_saved != Status::Suspended) {
+                // preempted: picks up with the current value it had
+                thread.m_current = thread.m_saved;
+                thread.m_saved = Status::Suspended;
+            }
+            return true;
+        }
+
+        // threads left out of the previous tick were abandoned by whoever
+        // ran them, so whatever they were in the middle of is dropped
+        bool BehaviorTreeVM::isStale(BehaviorTreeVMThread const & thread) const {
+            return thread.m_tick + 1 < m_tick;
+        }
+
+        bool BehaviorTreeVM::isRunning(size_t index) const {
+            for (size_t active = m_active; active < m_threads.size(); active = m_threads[active].m_parent) {
+                if (active == index)
+                    return true;
+            }
+            return false;
+        }
+
+        bool BehaviorTreeVM::threadInProgress(size_t index) const {
+            auto& thread = m_threads[index];
+            return ((thread.m_current == Status::Running) || (thread.m_current == Status::Suspended)) &&
+                !isStale(thread);
+        }
+
+        Status BehaviorTreeVM::runParallel(size_t first, size_t count, size_t successThreshold, size_t failureThreshold) {
+            size_t nSuccess = 0, nFailure = 0;
+            bool invalid = false, running = false;
+            for (size_t i = first; i < first + count; i++) {
+                auto& child = m_threads[i];
+                Status status = child.m_current;
+                // children that finished earlier keep their result until
+                // the whole parallel is done
+                if (isStale(child) || ((status != Status::Success) && (status != Status::Failure)))
+                    status = runThread(i);
+                else
+                    child.m_tick = m_tick;
+                switch (status) {
+                case Status::Success: nSuccess++; break;
+                case Status::Failure: nFailure++; break;
+                case Status::Running: running = true; break;
+                case Status::Suspended: break;
+                default: invalid = true; break;
+                }
+            }
+            Status status = invalid ? Status::Invalid :
+                parallelStatus(nSuccess, nFailure, count, successThreshold, failureThreshold);
+            if (status == Status::Running) {
+                // every unfinished child is parked
+                return running ? Status::Running : Status::Suspended;
+            }
+            // forget finished results; children still running are left
+            // as they are, like their nodes in the tree
+            for (size_t i = first; i < first + count; i++) {
+                auto& child = m_threads[i];
+                if ((child.m_current == Status::Success) || (child.m_current == Status::Failure))
+                    child.reset();
+            }
+            return status;
+        }
+
+
+        std::string DictBlackboard::getFact(const std::string & fact) const {
+            std::string data;
+            getFact(fact, data);
+            return data;
+        }
+
+        void DictBlackboard::removeFact(BehaviourTree::FactId fact) {
+            if (!hasFact(fact))
+                return;
+            SlotBlackboard::removeFact(fact);
+            if (m_listener)
+                m_listener(fact);
+        }
+
+        void DictBlackboard::setValue(BehaviourTree::FactId fact, const BehaviourTree::Value & value) {
+            SlotBlackboard::setValue(fact, value);
+            if (m_listener && (fact != BehaviourTree::InvalidFact))
+                m_listener(fact);
         }
     }
 }
-
@@ -1,10 +1,21 @@
 #pragma once
+#include "ofxBehaviourTree.h"
 #include <functional>
 #include <vector>
 #include <map>
 #include <string>
 #include <algorithm>
 #include <memory>
+#include <deque>
+#include <chrono>
+
+// Instrumented builds: with BTVM_PROFILE defined to 1, VMs report every
+// instruction and leaf call to their BehaviorTreeVMProfiler. It changes
+// the layout of BehaviorTreeVM, so it has to be the same for the whole
+// build.
+#ifndef BTVM_PROFILE
+#define BTVM_PROFILE 0
+#endif
 
 namespace ofxAI {
     namespace BTVM {
@@ -17,38 +28,338 @@ namespace ofxAI {
             Suspended
         };
 
-        class DictBlackboard {
+        /*
+         * VM blackboard: facts live in a dense slot array indexed by
+         * FactId, so fact instructions are a single indexed load. Every
+         * change is reported to the VM, which wakes threads waiting on it.
+         * It doubles as the blackboard of the VM's host tree, so leaves
+         * compiled from behaviour tree nodes see the same facts.
+         */
+        class DictBlackboard final : public BehaviourTree::SlotBlackboard {
         public:
-            bool hasFact(const std::string& fact) const;
-            const std::string& getFact(const std::string& fact) const;
-            void removeFact(const std::string& fact);
-            void setFact(const std::string& fact, const std::string& data);
+            using BehaviourTree::SlotBlackboard::getFact;
+            using BehaviourTree::SlotBlackboard::removeFact;
+
+            bool hasFact(const std::string& fact) const { return factExists(fact); }
+            bool hasFact(BehaviourTree::FactId fact) const {
+                return (fact < m_slots.size()) && !m_slots[fact].empty();
+            }
+            // string form of a fact, empty if it is absent
+            std::string getFact(const std::string& fact) const;
+
+            virtual void removeFact(BehaviourTree::FactId fact) override;
+            virtual void setValue(BehaviourTree::FactId fact, const BehaviourTree::Value& value) override;
+
+            // called whenever a fact is set or removed
+            using FactListener = std::function<void(BehaviourTree::FactId fact)>;
+            void setListener(FactListener listener) { m_listener = listener; }
         protected:
-            std::map<std::string, std::string> m_board;
+            FactListener m_listener;
+            friend class BehaviorTreeVMSnapshot;
         };
 
         class BehaviorTreeVM;
+        class BehaviorTreeVMProfiler;
+        class BehaviorTreeVMSnapshot;
+        struct BehaviorTreeVMNative;
 
+        /*
+         * VM thread: a program counter into the VM's program plus the
+         * current value register. When a thread stops, m_current tells
+         * why: Success, Failure or Invalid when it finished, Running when
+         * it yielded, Suspended when it is parked. A thread stopped by
+         * the VM's budget is parked too, and keeps its current value in
+         * m_saved until it is entered again. Calls into shared code push
+         * where they return to on the thread's own return stack.
+         */
         struct BehaviorTreeVMThread {
-            Status step(BehaviorTreeVM* vm);
+            // deepest nesting of calls a program may make
+            static const size_t MaxCallDepth = 8;
+
+            // executes one instruction, returning false once the thread stopped
+            bool step(BehaviorTreeVM* vm);
             void reset();
             off_t m_pc;
             size_t m_threadStart;
             Status m_current;
+            BehaviorTreeVM* m_vm; // owner, for leaves compiled from tree nodes
+            uint32_t m_tick;      // last tick of its root this thread was entered on
+            size_t m_parent;      // thread that last ran this one, if any
+            Status m_saved;       // current value of a preempted thread, Suspended otherwise
+            uint32_t m_callDepth;
+            int32_t m_returns[MaxCallDepth];
+        };
+
+
+        template <size_t opcode_val, typename u_type, typename s_type>
+        struct vm_opcode {
+            using op_type = s_type;
+            static constexpr op_type opcode = opcode_val;
+            using successor = vm_opcode<opcode_val + 1, u_type, s_type>;
         };
 
+        template <size_t opcode_val>
+        using btvm_opcode = vm_opcode<opcode_val, uint16_t, int16_t>;
+
+        /*
+         * VM program: bytecode plus the leaf, decorator, string and thread
+         * tables it refers to. Operands follow their opcode inline; branch
+         * offsets are relative to the branch instruction.
+         * Programs are immutable once built and can be shared between VMs.
+         */
+        struct BehaviorTreeVMProgram {
+
+            using bt_runner = std::function<Status(BehaviorTreeVMThread*, DictBlackboard*)>;
+            using bt_decorator = std::function<Status(BehaviorTreeVMThread*, DictBlackboard*)>;
+            using native_runner = Status (*)(BehaviorTreeVMProgram const &, BehaviorTreeVM*, BehaviorTreeVMThread*, DictBlackboard*);
+
+            struct ops {
+                using run = btvm_opcode<0>;     // run the specified leaf node
+                using run_thr = run::successor;     // run from specified stream
+                using run_dec = run_thr::successor; // run a decorator
+                using bra_f = run_dec::successor; // branch if current value is Failure
+                using bra_t = bra_f::successor;   // branch if current value is Success
+                using set_f = bra_t::successor;   // set Failure
+                using set_t = set_f::successor;   // set Success
+                using neg = set_t::successor;   // swap between Failure<->Success
+                using chk_fact = neg::successor;     // check if fact with string (pc+1) is present in the blackboard
+                using rm_fact = chk_fact::successor; // remove blackboard fact with string (pc+1)
+                using dbg_break = rm_fact::successor; // break mid-tree for debugging
+                using log = dbg_break::successor; // output a string along with the current state
+                using jmp = log::successor;     // branch unconditionally
+                using set_r = jmp::successor;   // set Running and yield, resuming at the next instruction
+                using set_i = set_r::successor; // set Invalid, ending the thread
+                using end = set_i::successor;   // end the thread with the current value
+                using rsm_thr = end::successor; // if thread (pc+1) is still running, run it and branch by (pc+2)
+                using run_par = rsm_thr::successor; // run (pc+2) threads from (pc+1), succeeding/failing once (pc+3)/(pc+4) of them do
+                using wait_fact = run_par::successor; // Success once fact with string (pc+1) is present, parking the thread until then
+                using set_fact = wait_fact::successor; // set fact with string (pc+1) to constant (pc+2)
+                using eq_fact = set_fact::successor;   // check if fact with string (pc+1) equals constant (pc+2), Invalid if absent
+                using run_bra_f = eq_fact::successor;  // run leaf (pc+1), then branch by (pc+2) if it failed
+                using run_bra_t = run_bra_f::successor; // run leaf (pc+1), then branch by (pc+2) if it succeeded
+                using call = run_bra_t::successor;     // run the shared code at offset (pc+1), returning to the next instruction
+                using ret = call::successor;           // return to the instruction after the last call
+            };
+
+            using op_type = ops::run::op_type;
+            static const size_t OpcodeCount = ops::ret::opcode + 1;
+
+            // name of an opcode, nullptr if there is no such opcode
+            static const char* mnemonic(op_type opcode);
+
+            // entry point of a thread, and how it treats yields: Reactive
+            // threads start over on their next run, Memory threads resume
+            struct ThreadEntry {
+                size_t start;
+                BehaviourTree::CompositeMode mode;
+            };
+
+            // what a leaf or decorator was built from, so saved programs
+            // can look their functions up again by name
+            struct Symbol {
+                enum class Kind : uint8_t {
+                    Leaf,       // NodeTick registered under 'name'
+                    Decorator,  // NodeDecorate registered under 'name', child runs thread 'child'
+                    Node        // built-in node 'name' run by its tree implementation
+                };
+                Kind kind;
+                std::string name;
+                std::string ref;
+                std::vector<std::string> params;
+                std::vector<BehaviourTree::Value> values;
+                size_t child;
+            };
+
+            // the ref of the node instructions from 'pc' up to the next
+            // location's pc were compiled from
+            struct SourceLocation {
+                size_t pc;
+                std::string ref;
+            };
 
-        struct BehaviorTreeVMProgram;
+            std::vector<op_type> m_program;
+            std::vector<bt_runner> m_leaves;
+            std::vector<bt_decorator> m_decoratorNodes;
+            std::vector<Symbol> m_leafSymbols;
+            std::vector<Symbol> m_decoratorSymbols;
+            // sorted by pc; code no node with a ref was compiled from has
+            // an empty ref, or no location at all
+            std::vector<SourceLocation> m_sourceMap;
+            std::vector<std::string> m_stringTable;
+            std::vector<BehaviourTree::Value> m_constants;
+            // fact instructions name their fact by string table index;
+            // link() resolves every string to its blackboard slot
+            std::vector<BehaviourTree::FactId> m_factIds;
+            std::vector<ThreadEntry> m_threadEntries;
+            // threads [0, m_roots) are run by the VM every tick, the
+            // others only when an instruction runs them
+            size_t m_roots = 1;
+            // the code the VM runs: m_program, or the bytecode of the
+            // image the program was loaded from, kept alive by m_image
+            const op_type* m_code = nullptr;
+            size_t m_codeSize = 0;
+            std::shared_ptr<const void> m_image;
+            // set by link() once the program passed the verifier
+            bool m_verified = false;
+            // set by link(): whether an instruction starts at each pc,
+            // which restored snapshots are checked against
+            std::vector<bool> m_instructionStarts;
+            // the program compiled to C++ by BehaviorTreeVMCodegen, which
+            // execute() runs in place of the bytecode
+            native_runner m_native = nullptr;
 
+            // resolves fact names and the code once the tables are filled
+            // in, then verifies the program; VMs only load programs that
+            // linked successfully
+            bool link();
+            const op_type* code() const { return m_code ? m_code : m_program.data(); }
+            size_t codeSize() const { return m_code ? m_codeSize : m_program.size(); }
+            // ref of the node the instruction at pc was compiled from,
+            // empty if the source map does not name one
+            std::string const & sourceRef(size_t pc) const;
+
+            // executes the instruction at the thread's pc, returning false
+            // once the thread stopped
+            bool eval(BehaviorTreeVM* vm, BehaviorTreeVMThread * thread, DictBlackboard * blackboard) const;
+            // executes instructions until the thread yields, parks or
+            // finishes, returning the status it stopped with
+            Status execute(BehaviorTreeVM* vm, BehaviorTreeVMThread * thread, DictBlackboard * blackboard) const;
+        protected:
+            bool settle(BehaviorTreeVM* vm, BehaviorTreeVMThread * thread, Status status, off_t size) const;
+            void yield(BehaviorTreeVM* vm, BehaviorTreeVMThread * thread) const;
+        };
+
+
+        /*
+         * VM: runs a program's root threads once per tick, from a queue of
+         * ready threads. Roots that yield or finish are queued up again
+         * for the next tick; roots that end up Suspended are parked, and
+         * cost nothing until something wakes them up. Parked threads are
+         * woken by wake(), or by a change to the fact they wait on.
+         * Wakeups may come early, so leaves that suspend should check
+         * what they wait for again when they are run. Like everything
+         * else here, wake() is for the thread running the VM; other
+         * threads push wakeups to a BehaviorTreeVMWakeQueue instead.
+         *
+         * A run can be given a budget of instructions, a deadline, or
+         * both. Once it is spent the VM stops before the next instruction,
+         * leaving the tick unfinished, and the next run carries on from
+         * there before any root starts a new tick. Leaves, decorators and
+         * parallels are not interrupted, so a deadline can be overrun by
+         * the longest of them.
+         */
         class BehaviorTreeVM {
         public:
+            using ProgramPtr = std::shared_ptr<const BehaviorTreeVMProgram>;
+            using Clock = std::chrono::steady_clock;
+            static const size_t NoThread = size_t(-1);
+            static const size_t Unlimited = size_t(-1);
+
+            BehaviorTreeVM();
+            BehaviorTreeVM(ProgramPtr program);
+            BehaviorTreeVM(const BehaviorTreeVM&) = delete;
+            BehaviorTreeVM& operator=(const BehaviorTreeVM&) = delete;
+
+            // loads a program, with every thread starting from scratch;
+            // programs that did not link are not loaded
+            void load(ProgramPtr program);
+            ProgramPtr getProgram() const { return m_program; }
+            // aborts running and parked threads, keeping the blackboard
+            void reset();
+
+            // runs every ready root thread until it yields, parks or
+            // finishes, returning the status of thread 0
+            Status run();
+            // as run(), but stops once 'instructions' instructions have
+            // run or the deadline has passed
+            Status run(size_t instructions, Clock::time_point deadline = Clock::time_point::max());
+            // the last run stopped on its budget, before the tick finished
+            bool preempted() const { return m_preempted; }
+            // instructions executed by the last run
+            size_t getInstructionsRun() const { return m_instructionsRun; }
+            // every root thread is parked
+            bool idle() const { return m_ready.empty(); }
+
+            Status getStatus(size_t thread = 0) const { return m_threads[thread].m_current; }
+            size_t getThreadIndex(BehaviorTreeVMThread const * thread) const { return thread - m_threads.data(); }
+
+            // wakes a parked thread up, along with the threads parked
+            // while running it
+            void wake(size_t thread);
+            // for leaves: parks the thread until the fact is set or removed,
+            // returning Suspended; waking the thread any other way stops
+            // the wait
+            Status waitForFact(BehaviorTreeVMThread* thread, const std::string& fact);
+            Status waitForFact(BehaviorTreeVMThread* thread, BehaviourTree::FactId fact);
+
+            // runs a thread until it stops, as run_thr does: a thread that
+            // yielded last time resumes (Memory) or starts over (Reactive).
+            // A thread that is already running returns Invalid
+            Status runThread(size_t thread);
+
+            // tree handed to leaves compiled from behaviour tree nodes
+            BehaviourTree::Tree& getHostTree() { return m_host; }
+
+#if BTVM_PROFILE
+            // profiles everything this VM runs from now on; the profiler
+            // has to be for the VM's program, and is dropped when another
+            // program is loaded
+            void setProfiler(BehaviorTreeVMProfiler* profiler);
+            BehaviorTreeVMProfiler* getProfiler() const { return m_profiler; }
+#endif
 
             DictBlackboard blackboard;
         protected:
-            std::shared_ptr<BehaviorTreeVMProgram> m_program;
+            // prepares a thread to run, returning false if it stays parked
+            bool enterThread(size_t thread);
+            // take the root at the front of the ready queue in and out of
+            // running; beginRoot returns false if it is not there or parked
+            bool beginRoot(size_t root);
+            void endRoot(size_t root);
+            bool isStale(BehaviorTreeVMThread const & thread) const;
+            bool threadInProgress(size_t thread) const;
+            // whether the thread is the one being run or one of its callers
+            bool isRunning(size_t thread) const;
+            Status runParallel(size_t first, size_t count, size_t successThreshold, size_t failureThreshold);
+            void factChanged(BehaviourTree::FactId fact);
+            // drops the facts a thread waits for, once it is woken or
+            // starts over
+            void forgetWaits(size_t thread);
+            // instructions the running thread may execute before asking
+            // again, 0 once the budget is spent
+            size_t refuel();
+            // takes instructions run without checking the budget out of
+            // it, returning the fuel left
+            size_t charge(size_t fuel, size_t instructions);
+            // puts the threads the budget stopped, and their callers, back
+            // to Running, returning whether 'root' is one of them
+            bool resumeLater(size_t root);
+
+            ProgramPtr m_program;
             std::vector<BehaviorTreeVMThread> m_threads;
+            BehaviourTree::Tree m_host;
+            uint32_t m_tick;   // tick of the root thread being run
+            size_t m_active;   // thread being run
+            std::deque<size_t> m_ready;
+            std::deque<size_t> m_next;
+            std::multimap<BehaviourTree::FactId, size_t> m_factWaiters;
+            // budget of the current run: m_fuel is what the running thread
+            // has left, m_instructions what is left besides
+            size_t m_fuel;
+            size_t m_instructions;
+            Clock::time_point m_deadline;
+            bool m_outOfBudget;
+            bool m_preempted;
+            size_t m_resume;   // root preempted in the middle of its tick
+            size_t m_instructionsRun;
+#if BTVM_PROFILE
+            BehaviorTreeVMProfiler* m_profiler = nullptr;
+#endif
             friend struct BehaviorTreeVMProgram;
             friend struct BehaviorTreeVMThread;
+            friend class BehaviorTreeVMBatch;
+            friend class BehaviorTreeVMSnapshot;
+            friend struct BehaviorTreeVMNative;
         };
 
     }
@@ -0,0 +1,356 @@
+#include "ofxBehaviourTreeVMBatch.h"
+#include <cstdint>
+
+#ifndef BTVM_BATCH_AVX2
+#if defined(__AVX2__)
+#define BTVM_BATCH_AVX2 1
+#else
+#define BTVM_BATCH_AVX2 0
+#endif
+#endif
+
+#ifndef BTVM_BATCH_SSE2
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define BTVM_BATCH_SSE2 1
+#else
+#define BTVM_BATCH_SSE2 0
+#endif
+#endif
+
+#if BTVM_BATCH_AVX2
+#include <immintrin.h>
+#elif BTVM_BATCH_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // agents ticked together, few enough that their VMs stay in cache,
+    // and a lane mask still fits in a uint32_t
+    const size_t Tile = 32;
+    // below this many lanes, stepping them together costs more than
+    // running them one by one
+    const size_t MinLanes = 8;
+    // shared instructions per lane that pay for setting the lanes up
+    const size_t MinShared = 16;
+    // ticks a tile whose lanes split up too early runs agent by agent
+    const uint32_t Backoff = 63;
+
+    using ofxAI::BTVM::Status;
+    const int32_t SuccessLane = (int32_t)Status::Success;
+    const int32_t FailureLane = (int32_t)Status::Failure;
+
+    inline uint32_t laneBit(size_t begin, size_t lane) {
+        return 1u << (lane - begin);
+    }
+    inline size_t countLanes(uint32_t lanes) {
+        size_t count = 0;
+        for (; lanes; lanes &= lanes - 1)
+            count++;
+        return count;
+    }
+
+    // a block of lanes, and the few operations the SIMD steps need;
+    // comparisons set every bit of the lanes that match, and mask()
+    // does the same for the lanes with a bit set in 'lanes'
+#if BTVM_BATCH_AVX2
+    const size_t Width = 8;
+    using Block = __m256i;
+    inline Block load(const int32_t* lanes) { return _mm256_loadu_si256((const __m256i*)lanes); }
+    inline void store(int32_t* lanes, Block value) { _mm256_storeu_si256((__m256i*)lanes, value); }
+    inline Block splat(int32_t value) { return _mm256_set1_epi32(value); }
+    inline Block equal(Block a, Block b) { return _mm256_cmpeq_epi32(a, b); }
+    inline Block both(Block a, Block b) { return _mm256_and_si256(a, b); }
+    inline Block either(Block a, Block b) { return _mm256_or_si256(a, b); }
+    inline Block flip(Block a, Block b) { return _mm256_xor_si256(a, b); }
+    inline Block select(Block mask, Block a, Block b) { return _mm256_blendv_epi8(b, a, mask); }
+    inline uint32_t bits(Block mask) { return (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(mask)); }
+    inline Block mask(uint32_t lanes) {
+        const __m256i bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int32_t)lanes), bit), bit);
+    }
+#elif BTVM_BATCH_SSE2
+    const size_t Width = 4;
+    using Block = __m128i;
+    inline Block load(const int32_t* lanes) { return _mm_loadu_si128((const __m128i*)lanes); }
+    inline void store(int32_t* lanes, Block value) { _mm_storeu_si128((__m128i*)lanes, value); }
+    inline Block splat(int32_t value) { return _mm_set1_epi32(value); }
+    inline Block equal(Block a, Block b) { return _mm_cmpeq_epi32(a, b); }
+    inline Block both(Block a, Block b) { return _mm_and_si128(a, b); }
+    inline Block either(Block a, Block b) { return _mm_or_si128(a, b); }
+    inline Block flip(Block a, Block b) { return _mm_xor_si128(a, b); }
+    inline Block select(Block mask, Block a, Block b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+    inline uint32_t bits(Block mask) { return (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(mask)); }
+    inline Block mask(uint32_t lanes) {
+        const __m128i bit = _mm_setr_epi32(1, 2, 4, 8);
+        return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int32_t)lanes), bit), bit);
+    }
+#else
+    const size_t Width = 1;
+    using Block = int32_t;
+    inline Block load(const int32_t* lanes) { return *lanes; }
+    inline void store(int32_t* lanes, Block value) { *lanes = value; }
+    inline Block splat(int32_t value) { return value; }
+    inline Block equal(Block a, Block b) { return -(int32_t)(a == b); }
+    inline Block both(Block a, Block b) { return a & b; }
+    inline Block either(Block a, Block b) { return a | b; }
+    inline Block flip(Block a, Block b) { return a ^ b; }
+    inline Block select(Block mask, Block a, Block b) { return (mask & a) | (~mask & b); }
+    inline uint32_t bits(Block mask) { return (uint32_t)mask & 1; }
+    inline Block mask(uint32_t lanes) { return -(int32_t)(lanes & 1); }
+#endif
+    const uint32_t BlockLanes = (uint32_t)((1ull << Width) - 1);
+}
+
+ofxAI::BTVM::BehaviorTreeVMBatch::BehaviorTreeVMBatch(ProgramPtr program)
+    : m_program(program) {
+}
+
+size_t ofxAI::BTVM::BehaviorTreeVMBatch::addAgent() {
+    m_agents.push_back(std::make_unique<BehaviorTreeVM>(m_program));
+    m_results.push_back(Status::Invalid);
+    return m_agents.size() - 1;
+}
+
+std::vector<ofxAI::BTVM::Status> const & ofxAI::BTVM::BehaviorTreeVMBatch::run() {
+    if (!m_program || m_program->m_threadEntries.empty()) {
+        std::fill(m_results.begin(), m_results.end(), Status::Invalid);
+        return m_results;
+    }
+    if (m_program->m_native) {
+        // native code only starts from the points a thread can stop at,
+        // not from wherever the lanes split up
+        for (size_t i = 0; i < m_agents.size(); i++)
+            m_results[i] = m_agents[i]->run();
+        return m_results;
+    }
+    size_t lanes = (m_agents.size() + Width - 1) / Width * Width;
+    m_current.resize(lanes);
+    m_backoff.resize((lanes + Tile - 1) / Tile);
+    for (size_t begin = 0; begin < lanes; begin += Tile)
+        runTile(begin, std::min(begin + Tile, lanes));
+    return m_results;
+}
+
+// runs one tick for the agents in [begin, end)
+void ofxAI::BTVM::BehaviorTreeVMBatch::runTile(size_t begin, size_t end) {
+    size_t agents = std::min(end, m_agents.size());
+    uint32_t& backoff = m_backoff[begin / Tile];
+    if (backoff) {
+        backoff--;
+        for (size_t i = begin; i < agents; i++)
+            m_results[i] = m_agents[i]->run();
+        return;
+    }
+    m_groups.clear();
+    size_t started = 0;
+    for (size_t i = begin; i < agents; i++) {
+        auto& vm = *m_agents[i];
+        auto& thread = vm.m_threads[0];
+        if (!vm.beginRoot(0)) {
+            // any other roots that are ready still run
+            m_results[i] = vm.run();
+            continue;
+        }
+        // roots start over at the same pc; memory roots that pick up
+        // somewhere else start a group of their own
+        m_current[i] = (int32_t)thread.m_current;
+        join(laneBit(begin, i), thread.m_pc);
+        started++;
+    }
+
+    using ops = BehaviorTreeVMProgram::ops;
+    const auto* code = m_program->code();
+    // lane instructions the SIMD steps did
+    size_t shared = 0;
+    while (!m_groups.empty()) {
+        uint32_t live = m_groups.back().live;
+        off_t pc = m_groups.back().pc;
+        m_groups.pop_back();
+        size_t lanes = countLanes(live);
+        while (lanes >= MinLanes) {
+            switch (code[pc]) {
+            case ops::set_t::opcode:
+                setCurrent(begin, end, live, Status::Success);
+                shared += lanes;
+                pc++;
+                break;
+            case ops::set_f::opcode:
+                setCurrent(begin, end, live, Status::Failure);
+                shared += lanes;
+                pc++;
+                break;
+            case ops::neg::opcode:
+                negate(begin, end, live);
+                shared += lanes;
+                pc++;
+                break;
+            case ops::jmp::opcode:
+                pc += code[pc + 1];
+                break;
+            // fact instructions call out to each lane's blackboard, but
+            // all go on to the next instruction
+            case ops::chk_fact::opcode:
+                checkFacts(begin, end, live, m_program->m_factIds[code[pc + 1]]);
+                pc += 2;
+                break;
+            case ops::rm_fact::opcode:
+                for (size_t i = begin; i < end; i++) {
+                    if (live & laneBit(begin, i))
+                        m_agents[i]->blackboard.removeFact(m_program->m_factIds[code[pc + 1]]);
+                }
+                setCurrent(begin, end, live, Status::Success);
+                pc += 2;
+                break;
+            case ops::set_fact::opcode:
+                for (size_t i = begin; i < end; i++) {
+                    if (live & laneBit(begin, i))
+                        m_agents[i]->blackboard.setValue(m_program->m_factIds[code[pc + 1]], m_program->m_constants[code[pc + 2]]);
+                }
+                setCurrent(begin, end, live, Status::Success);
+                pc += 3;
+                break;
+            case ops::bra_t::opcode:
+            case ops::bra_f::opcode:
+            {
+                Status when = (code[pc] == ops::bra_t::opcode) ? Status::Success : Status::Failure;
+                uint32_t taken = matching(begin, end, when) & live;
+                shared += lanes;
+                if (taken == live)
+                    pc += code[pc + 1];
+                else if (!taken)
+                    pc += 2;
+                else {
+                    // the lanes that fall through wait their turn
+                    join(live & ~taken, pc + 2);
+                    live = taken;
+                    lanes = countLanes(live);
+                    pc += code[pc + 1];
+                }
+                break;
+            }
+            default:
+                pc = stepLanes(begin, end, live, pc);
+                lanes = countLanes(live);
+                break;
+            }
+        }
+        finishLanes(begin, end, live, pc);
+    }
+    // lanes that split up before sharing enough to pay for it run one by
+    // one for a while, then get another go
+    if (shared < MinShared * started)
+        backoff = Backoff;
+}
+
+// adds the lanes to the group waiting at pc
+void ofxAI::BTVM::BehaviorTreeVMBatch::join(uint32_t lanes, off_t pc) {
+    for (auto& group : m_groups) {
+        if (group.pc == pc) {
+            group.live |= lanes;
+            return;
+        }
+    }
+    m_groups.push_back({ lanes, pc });
+}
+
+// the SIMD steps below leave lanes outside 'live' as they are; lanes of
+// other groups still need their current value
+void ofxAI::BTVM::BehaviorTreeVMBatch::setCurrent(size_t begin, size_t end, uint32_t live, Status status) {
+    int32_t* current = m_current.data();
+    const Block value = splat((int32_t)status);
+    for (size_t i = begin; i < end; i += Width) {
+        uint32_t lanes = (live >> (i - begin)) & BlockLanes;
+        if (lanes)
+            store(current + i, select(mask(lanes), value, load(current + i)));
+    }
+}
+
+void ofxAI::BTVM::BehaviorTreeVMBatch::negate(size_t begin, size_t end, uint32_t live) {
+    int32_t* current = m_current.data();
+    const Block success = splat(SuccessLane);
+    const Block failure = splat(FailureLane);
+    // Success ^ Failure, flipping one into the other
+    const Block swap = splat(SuccessLane ^ FailureLane);
+    for (size_t i = begin; i < end; i += Width) {
+        uint32_t lanes = (live >> (i - begin)) & BlockLanes;
+        if (!lanes)
+            continue;
+        Block status = load(current + i);
+        Block finished = either(equal(status, success), equal(status, failure));
+        store(current + i, flip(status, both(both(finished, mask(lanes)), swap)));
+    }
+}
+
+// sets the live lanes' current value by whether their blackboard has
+// the fact
+void ofxAI::BTVM::BehaviorTreeVMBatch::checkFacts(size_t begin, size_t end, uint32_t live, BehaviourTree::FactId fact) {
+    uint32_t found = 0;
+    for (size_t i = begin; i < end; i++) {
+        if ((live & laneBit(begin, i)) && m_agents[i]->blackboard.hasFact(fact))
+            found |= laneBit(begin, i);
+    }
+    setCurrent(begin, end, found, Status::Success);
+    setCurrent(begin, end, live & ~found, Status::Failure);
+}
+
+uint32_t ofxAI::BTVM::BehaviorTreeVMBatch::matching(size_t begin, size_t end, Status status) const {
+    const int32_t* current = m_current.data();
+    const Block value = splat((int32_t)status);
+    uint32_t lanes = 0;
+    for (size_t i = begin; i < end; i += Width)
+        lanes |= bits(equal(load(current + i), value)) << (i - begin);
+    return lanes;
+}
+
+// steps every live lane through the instruction at pc on its own VM,
+// returning where they got to. Lanes that stop there finish their tick;
+// lanes that end up somewhere else than the first one join the group
+// waiting there, and the others carry on together.
+off_t ofxAI::BTVM::BehaviorTreeVMBatch::stepLanes(size_t begin, size_t end, uint32_t& live, off_t pc) {
+    uint32_t stepped = 0;
+    off_t next = pc;
+    for (size_t i = begin; i < end; i++) {
+        if (!(live & laneBit(begin, i)))
+            continue;
+        auto& vm = *m_agents[i];
+        auto& thread = vm.m_threads[0];
+        thread.m_pc = pc;
+        thread.m_current = (Status)m_current[i];
+        if (!m_program->eval(&vm, &thread, &vm.blackboard)) {
+            // the thread holds where and how it stopped
+            vm.endRoot(0);
+            m_results[i] = vm.run();
+            continue;
+        }
+        m_current[i] = (int32_t)thread.m_current;
+        if (!stepped)
+            next = thread.m_pc;
+        if (thread.m_pc == next)
+            stepped |= laneBit(begin, i);
+        else
+            join(laneBit(begin, i), thread.m_pc);
+    }
+    live = stepped;
+    return next;
+}
+// finishes the tick of every live lane on its own VM, from pc
+void ofxAI::BTVM::BehaviorTreeVMBatch::finishLanes(size_t begin, size_t end, uint32_t& live, off_t pc) {
+    for (size_t i = begin; i < end; i++) {
+        if (!(live & laneBit(begin, i)))
+            continue;
+        auto& thread = m_agents[i]->m_threads[0];
+        thread.m_pc = pc;
+        thread.m_current = (Status)m_current[i];
+        finish(i);
+    }
+    live = 0;
+}
+
+// finishes the agent's tick from where its thread is, the way
+// BehaviorTreeVM::run would have carried on from there
+void ofxAI::BTVM::BehaviorTreeVMBatch::finish(size_t lane) {
+    auto& vm = *m_agents[lane];
+    m_program->execute(&vm, &vm.m_threads[0], &vm.blackboard);
+    vm.endRoot(0);
+    m_results[lane] = vm.run();
+}
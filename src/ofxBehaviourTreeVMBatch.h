@@ -0,0 +1,77 @@
+#pragma once
+#include "ofxBehaviourTreeVM.h"
+
+namespace ofxAI {
+    namespace BTVM {
+
+        /*
+         * VM batch: many agents running the same program, stepped in
+         * lockstep. The agents are ticked in tiles of 32; the root threads
+         * of a tile that start on the same instruction step through it
+         * together. Their current values are kept side by side, one lane
+         * per agent, and branches and the set_t/set_f/neg instructions
+         * are applied to all of them at once, eight at a time with AVX2
+         * or four with SSE2; instructions that call out (leaves, threads,
+         * facts) run lane by lane on each agent's own VM. Where the lanes
+         * disagree, at a branch or after an instruction that took them to
+         * different places, they split into groups by where they went;
+         * each group carries on in lockstep in turn, and lanes that reach
+         * an instruction another group waits at join it. Groups too small
+         * to pay for stepping together finish the tick agent by agent, as
+         * BehaviorTreeVM::run would. Roots other than thread 0 run on
+         * their own VM afterwards.
+         * Stepping lanes together only pays off when they share a fair
+         * number of SIMD instructions, as with long runs of decorators;
+         * trees that are mostly leaves and facts run at the speed of their
+         * call-outs either way, and tiles that share too little run agent
+         * by agent for a while before trying again. The AVX2 steps are
+         * only built with AVX2 enabled (-mavx2, /arch:AVX2). Programs with
+         * native code always run agent by agent.
+         */
+        class BehaviorTreeVMBatch {
+        public:
+            using ProgramPtr = BehaviorTreeVM::ProgramPtr;
+
+            BehaviorTreeVMBatch(ProgramPtr program);
+
+            // returns the new agent's index
+            size_t addAgent();
+            BehaviorTreeVM& getAgent(size_t index) { return *m_agents[index]; }
+            size_t size() const { return m_agents.size(); }
+
+            // runs one tick for every agent, returning their statuses by index
+            std::vector<Status> const & run();
+            std::vector<Status> const & getResults() const { return m_results; }
+        protected:
+            // lanes waiting at the same instruction
+            struct Group {
+                uint32_t live;
+                off_t pc;
+            };
+
+            void runTile(size_t begin, size_t end);
+            void join(uint32_t lanes, off_t pc);
+            void setCurrent(size_t begin, size_t end, uint32_t live, Status status);
+            void negate(size_t begin, size_t end, uint32_t live);
+            void checkFacts(size_t begin, size_t end, uint32_t live, BehaviourTree::FactId fact);
+            // lanes in [begin, end) whose current value is status, one bit each
+            uint32_t matching(size_t begin, size_t end, Status status) const;
+            // 'live' has a bit for every lane of the tile at begin in the
+            // group being stepped
+            off_t stepLanes(size_t begin, size_t end, uint32_t& live, off_t pc);
+            void finishLanes(size_t begin, size_t end, uint32_t& live, off_t pc);
+            void finish(size_t lane);
+
+            ProgramPtr m_program;
+            std::vector<std::unique_ptr<BehaviorTreeVM>> m_agents;
+            std::vector<Status> m_results;
+            // current value of every lane, padded to a whole number of
+            // SIMD blocks
+            std::vector<int32_t> m_current;
+            // ticks left that each tile runs agent by agent
+            std::vector<uint32_t> m_backoff;
+            // groups of the tile being run that wait their turn
+            std::vector<Group> m_groups;
+        };
+    }
+}
@@ -0,0 +1,376 @@
+#include "ofxBehaviourTreeVMCodegen.h"
+#include "ofxBehaviourTreeVMDisassembler.h"
+#include "ofxBehaviourTreeVMVerifier.h"
+
+namespace {
+    using ofxAI::BTVM::BehaviorTreeVMCodegen;
+    using ofxAI::BTVM::BehaviorTreeVMProgram;
+    using ofxAI::BTVM::BehaviorTreeVMVerifier;
+    using Symbol = BehaviorTreeVMProgram::Symbol;
+    using ops = BehaviorTreeVMProgram::ops;
+    using op_type = BehaviorTreeVMProgram::op_type;
+
+    // FNV-1a
+    class Hash {
+    public:
+        void add(const void* data, size_t size) {
+            auto bytes = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < size; i++) {
+                m_hash ^= bytes[i];
+                m_hash *= 0x100000001b3ull;
+            }
+        }
+        void add(uint64_t value) {
+            add(&value, sizeof(value));
+        }
+        void add(std::string const & str) {
+            add(str.size());
+            add(str.data(), str.size());
+        }
+        void add(Symbol const & symbol) {
+            add((uint64_t)symbol.kind);
+            add(symbol.name);
+            add(symbol.params.size());
+            for (auto& param : symbol.params)
+                add(param);
+        }
+        uint64_t value() const { return m_hash; }
+    protected:
+        uint64_t m_hash = 0xcbf29ce484222325ull;
+    };
+
+    std::string literal(std::string const & str) {
+        static const char digits[] = "01234567";
+        std::string text = "\"";
+        for (unsigned char c : str) {
+            if ((c == '"') || (c == '\\')) {
+                text += '\\';
+                text += (char)c;
+            }
+            else if ((c < 0x20) || (c >= 0x7f) || (c == '?')) {
+                // three octal digits, so the next character cannot extend it
+                text += '\\';
+                text += digits[(c >> 6) & 7];
+                text += digits[(c >> 3) & 7];
+                text += digits[c & 7];
+            }
+            else {
+                text += (char)c;
+            }
+        }
+        return text + "\"";
+    }
+
+    // instructions as comments, on one line and without a line splice
+    std::string comment(std::string text) {
+        for (auto& c : text) {
+            if ((c == '\n') || (c == '\r') || (c == '\\'))
+                c = ' ';
+        }
+        while (!text.empty() && (text.back() == ' '))
+            text.pop_back();
+        return text;
+    }
+
+    class Generator {
+    public:
+        Generator(BehaviorTreeVMProgram const & program, BehaviorTreeVMCodegen::Options const & options, std::ostream& out)
+            : m_program(program), m_options(options), m_out(out), m_code(program.code()) {}
+
+        void generate() {
+            m_out << "// Generated by BehaviorTreeVMCodegen from a program of " << m_program.codeSize()
+                  << " words. Do not edit.\n";
+            m_out << "#include \"ofxBehaviourTreeVMCodegen.h\"\n";
+            for (auto& include : m_options.includes)
+                m_out << "#include " << (include[0] == '<' ? include : "\"" + include + "\"") << "\n";
+            m_out << "\nnamespace {\n";
+            m_out << "    using ofxAI::BTVM::Status;\n";
+            m_out << "    using Native = ofxAI::BTVM::BehaviorTreeVMNative;\n";
+
+            // params of the leaves called directly
+            auto& symbols = m_program.m_leafSymbols;
+            for (size_t i = 0; i < symbols.size(); i++) {
+                if (direct(i).empty())
+                    continue;
+                m_out << "    const std::vector<std::string> leaf" << i << "Params = {";
+                for (size_t j = 0; j < symbols[i].params.size(); j++)
+                    m_out << (j ? ", " : " ") << literal(symbols[i].params[j]);
+                m_out << (symbols[i].params.empty() ? "};\n" : " };\n");
+            }
+
+            std::string body = instructions();
+            m_out << "\n    Status run(ofxAI::BTVM::BehaviorTreeVMProgram const & program, ofxAI::BTVM::BehaviorTreeVM* vm,\n"
+                  << "               ofxAI::BTVM::BehaviorTreeVMThread* thread, ofxAI::BTVM::DictBlackboard* blackboard) {\n"
+                  << "        // not every program calls leaves or uses facts\n"
+                  << "        (void)program;\n"
+                  << "        (void)blackboard;\n"
+                  << (m_facts ? "        auto& factIds = program.m_factIds;\n" : "")
+                  << "        Status current = thread->m_current;\n"
+                  << "        size_t fuel = Native::fuel(vm);\n"
+                  << "        off_t pc = thread->m_pc;\n";
+            if (m_resumes)
+                m_out << "    resume:\n";
+            m_out << "        switch (pc) {\n";
+            for (size_t pc : m_starts)
+                m_out << "        case " << pc << ": goto pc" << pc << ";\n";
+            m_out << "        default:\n"
+                  << "            current = Status::Invalid;\n"
+                  << "            goto stop;\n"
+                  << "        }\n";
+            m_out << body;
+            if (m_preempts) {
+                m_out << "    preempt:\n"
+                      << "        // parked on this instruction until the VM resumes it\n"
+                      << "        thread->m_saved = current;\n"
+                      << "        current = Status::Suspended;\n"
+                      << "        goto stop;\n";
+            }
+            if (m_yields) {
+                m_out << "    yield:\n"
+                      << "        if (program.m_threadEntries[vm->getThreadIndex(thread)].mode == ofxAI::BehaviourTree::CompositeMode::Reactive) {\n"
+                      << "            pc = (off_t)thread->m_threadStart;\n"
+                      << "            thread->m_callDepth = 0;\n"
+                      << "        }\n";
+            }
+            m_out << "    stop:\n"
+                  << "        thread->m_pc = pc;\n"
+                  << "        thread->m_current = current;\n"
+                  << "        Native::fuel(vm) = fuel;\n"
+                  << "        return current;\n"
+                  << "    }\n"
+                  << "}\n\n";
+            m_out << "extern const ofxAI::BTVM::BehaviorTreeVMNative " << m_options.symbol << ";\n";
+            m_out << "const ofxAI::BTVM::BehaviorTreeVMNative " << m_options.symbol << " = { 0x" << std::hex
+                  << BehaviorTreeVMCodegen::fingerprint(m_program) << std::dec << "ull, &run };\n";
+        }
+
+    protected:
+        // function a leaf is called through directly, empty if none
+        std::string direct(size_t leaf) const {
+            auto& symbols = m_program.m_leafSymbols;
+            if ((leaf >= symbols.size()) || (symbols[leaf].kind != Symbol::Kind::Leaf))
+                return std::string();
+            auto found = m_options.leaves.find(symbols[leaf].name);
+            return found != m_options.leaves.end() ? found->second : std::string();
+        }
+
+        std::string leafCall(size_t leaf) const {
+            std::string function = direct(leaf);
+            if (function.empty())
+                return "program.m_leaves[" + std::to_string(leaf) + "](thread, blackboard)";
+            return "static_cast<Status>(" + function + "(&vm->getHostTree(), leaf" + std::to_string(leaf) + "Params))";
+        }
+
+        std::string instructions() {
+            std::string text;
+            size_t size = m_program.codeSize();
+            for (size_t pc = 0; pc < size; pc += BehaviorTreeVMVerifier::instructionSize(m_code[pc])) {
+                m_starts.push_back(pc);
+                text += "    pc" + std::to_string(pc) + ": // " +
+                        comment(ofxAI::BTVM::BehaviorTreeVMDisassembler::instruction(m_program, pc)) + "\n";
+                text += instruction(pc);
+            }
+            return text;
+        }
+
+        std::string instruction(size_t pc) {
+            const op_type* code = m_code + pc;
+            std::string p = std::to_string(pc);
+            std::string next = std::to_string(pc + BehaviorTreeVMVerifier::instructionSize(code[0]));
+            auto target = [&](size_t operand) { return std::to_string((off_t)pc + code[operand]); };
+            auto fact = [&](size_t operand) {
+                m_facts = true;
+                return "factIds[" + std::to_string(code[operand]) + "]";
+            };
+
+            // set_i, like unknown opcodes, stops the thread without
+            // taking any fuel
+            if (code[0] == ops::set_i::opcode) {
+                return "        current = Status::Invalid;\n"
+                       "        pc = " + p + ";\n"
+                       "        goto stop;\n";
+            }
+
+            m_preempts = true;
+            std::string text = "        if (!fuel && !(fuel = Native::refuel(vm))) {\n"
+                               "            pc = " + p + ";\n"
+                               "            goto preempt;\n"
+                               "        }\n"
+                               "        fuel--;\n";
+            // threads called from here run on the same fuel
+            auto call = [&](std::string const & expression) {
+                return "        thread->m_pc = " + p + ";\n"
+                       "        Native::fuel(vm) = fuel;\n"
+                       "        current = " + expression + ";\n"
+                       "        fuel = Native::fuel(vm);\n";
+            };
+            // decorators and parallels run to the end and are charged
+            // for it afterwards
+            auto callWhole = [&](std::string const & expression) {
+                return "        thread->m_pc = " + p + ";\n"
+                       "        Native::fuel(vm) = ofxAI::BTVM::BehaviorTreeVM::Unlimited;\n"
+                       "        current = " + expression + ";\n"
+                       "        fuel = Native::charge(vm, fuel, ofxAI::BTVM::BehaviorTreeVM::Unlimited - Native::fuel(vm));\n";
+            };
+            // anything but Success and Failure stops here, Running yields
+            auto settle = [&](std::string const & indent) {
+                m_yields = true;
+                return indent + "if ((current != Status::Success) && (current != Status::Failure)) {\n" +
+                       indent + "    pc = " + p + ";\n" +
+                       indent + "    if (current == Status::Running)\n" +
+                       indent + "        goto yield;\n" +
+                       indent + "    goto stop;\n" +
+                       indent + "}\n";
+            };
+
+            switch (code[0]) {
+            case ops::run::opcode:
+                return text + call(leafCall(code[1])) + settle("        ");
+            case ops::run_bra_f::opcode:
+            case ops::run_bra_t::opcode:
+                return text + call(leafCall(code[1])) +
+                       "        if (current == Status::" +
+                       (code[0] == ops::run_bra_f::opcode ? "Failure" : "Success") + ")\n"
+                       "            goto pc" + target(2) + ";\n" +
+                       settle("        ");
+            case ops::run_thr::opcode:
+                return text + call("vm->runThread(" + std::to_string(code[1]) + ")") + settle("        ");
+            case ops::run_dec::opcode:
+                return text + callWhole("program.m_decoratorNodes[" + std::to_string(code[1]) + "](thread, blackboard)") +
+                       settle("        ");
+            case ops::rsm_thr::opcode:
+                m_yields = true;
+                return text + "        if (Native::threadInProgress(vm, " + std::to_string(code[1]) + ")) {\n" +
+                       call("vm->runThread(" + std::to_string(code[1]) + ")") +
+                       "            if ((current == Status::Success) || (current == Status::Failure))\n"
+                       "                goto pc" + target(2) + ";\n"
+                       "            pc = " + p + ";\n"
+                       "            if (current == Status::Running)\n"
+                       "                goto yield;\n"
+                       "            goto stop;\n"
+                       "        }\n";
+            case ops::run_par::opcode:
+                return text + callWhole("Native::runParallel(vm, " + std::to_string(code[1]) + ", " +
+                                        std::to_string(code[2]) + ", " + std::to_string(code[3]) + ", " +
+                                        std::to_string(code[4]) + ")") +
+                       settle("        ");
+            case ops::bra_f::opcode:
+            case ops::bra_t::opcode:
+                return text + "        if (current == Status::" +
+                       (code[0] == ops::bra_f::opcode ? "Failure" : "Success") + ")\n"
+                       "            goto pc" + target(1) + ";\n";
+            case ops::jmp::opcode:
+                return text + "        goto pc" + target(1) + ";\n";
+            case ops::call::opcode:
+                return text + "        thread->m_returns[thread->m_callDepth++] = " + next + ";\n"
+                       "        goto pc" + target(1) + ";\n";
+            case ops::ret::opcode:
+                m_resumes = true;
+                return text + "        pc = thread->m_returns[--thread->m_callDepth];\n"
+                       "        goto resume;\n";
+            case ops::set_f::opcode:
+                return text + "        current = Status::Failure;\n";
+            case ops::set_t::opcode:
+                return text + "        current = Status::Success;\n";
+            case ops::set_r::opcode:
+                m_yields = true;
+                return text + "        current = Status::Running;\n"
+                       "        pc = " + next + ";\n"
+                       "        goto yield;\n";
+            case ops::neg::opcode:
+                return text + "        if (current == Status::Failure)\n"
+                       "            current = Status::Success;\n"
+                       "        else if (current == Status::Success)\n"
+                       "            current = Status::Failure;\n";
+            case ops::chk_fact::opcode:
+                return text + "        current = blackboard->hasFact(" + fact(1) + ") ? Status::Success : Status::Failure;\n";
+            case ops::rm_fact::opcode:
+                return text + "        blackboard->removeFact(" + fact(1) + ");\n"
+                       "        current = Status::Success;\n";
+            case ops::wait_fact::opcode:
+                return text + "        if (blackboard->hasFact(" + fact(1) + "))\n"
+                       "            current = Status::Success;\n"
+                       "        else {\n"
+                       "            current = vm->waitForFact(thread, " + fact(1) + ");\n"
+                       "            pc = " + p + ";\n"
+                       "            goto stop;\n"
+                       "        }\n";
+            case ops::set_fact::opcode:
+                return text + "        blackboard->setValue(" + fact(1) + ", program.m_constants[" +
+                       std::to_string(code[2]) + "]);\n"
+                       "        current = Status::Success;\n";
+            case ops::eq_fact::opcode:
+                return text + "        if (const ofxAI::BehaviourTree::Value* value = blackboard->findValue(" + fact(1) + "))\n"
+                       "            current = (*value == program.m_constants[" + std::to_string(code[2]) +
+                       "]) ? Status::Success : Status::Failure;\n"
+                       "        else {\n"
+                       "            current = Status::Invalid;\n"
+                       "            pc = " + p + ";\n"
+                       "            goto stop;\n"
+                       "        }\n";
+            case ops::end::opcode:
+                return text + "        pc = " + p + ";\n"
+                       "        goto stop;\n";
+            default:
+                // verified programs have no other instructions
+                return text + "        current = Status::Invalid;\n"
+                       "        pc = " + p + ";\n"
+                       "        goto stop;\n";
+            }
+        }
+
+        BehaviorTreeVMProgram const & m_program;
+        BehaviorTreeVMCodegen::Options const & m_options;
+        std::ostream& m_out;
+        const op_type* m_code;
+        std::vector<size_t> m_starts;
+        bool m_preempts = false;
+        bool m_yields = false;
+        bool m_resumes = false;
+        bool m_facts = false;
+    };
+}
+
+bool ofxAI::BTVM::BehaviorTreeVMCodegen::generate(BehaviorTreeVMProgram const & program, Options const & options,
+                                                  std::ostream& out) {
+    if (!program.m_verified)
+        return false;
+    Generator generator(program, options, out);
+    generator.generate();
+    return !out.fail();
+}
+
+ofxAI::BTVM::BehaviorTreeVMCodegen::ProgramPtr ofxAI::BTVM::BehaviorTreeVMCodegen::bind(
+    BehaviorTreeVMProgram const & program,
+    BehaviorTreeVMNative const & native) {
+    if (!program.m_verified || !native.run || (native.fingerprint != fingerprint(program)))
+        return nullptr;
+    // the bound program keeps the tables and the code, which has to
+    // point at its own copy again
+    auto bound = std::make_shared<BehaviorTreeVMProgram>(program);
+    bound->m_native = native.run;
+    if (!bound->link())
+        return nullptr;
+    return bound;
+}
+
+uint64_t ofxAI::BTVM::BehaviorTreeVMCodegen::fingerprint(BehaviorTreeVMProgram const & program) {
+    Hash hash;
+    hash.add(program.codeSize());
+    hash.add(program.code(), program.codeSize() * sizeof(op_type));
+    hash.add(program.m_roots);
+    hash.add(program.m_threadEntries.size());
+    for (auto& thread : program.m_threadEntries) {
+        hash.add(thread.start);
+        hash.add((uint64_t)thread.mode);
+    }
+    hash.add(program.m_leaves.size());
+    hash.add(program.m_decoratorNodes.size());
+    hash.add(program.m_leafSymbols.size());
+    for (auto& symbol : program.m_leafSymbols)
+        hash.add(symbol);
+    hash.add(program.m_decoratorSymbols.size());
+    for (auto& symbol : program.m_decoratorSymbols)
+        hash.add(symbol);
+    return hash.value();
+}
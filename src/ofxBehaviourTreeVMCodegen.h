@@ -0,0 +1,77 @@
+#pragma once
+#include "ofxBehaviourTreeVM.h"
+#include <ostream>
+
+namespace ofxAI {
+    namespace BTVM {
+
+        /*
+         * What generated code defines for its program, and the parts of
+         * the VM it runs on. Generated code is the only user of the
+         * functions below.
+         */
+        struct BehaviorTreeVMNative {
+            uint64_t fingerprint;   // of the program the code was generated from
+            BehaviorTreeVMProgram::native_runner run;
+
+            static size_t& fuel(BehaviorTreeVM* vm) { return vm->m_fuel; }
+            static size_t refuel(BehaviorTreeVM* vm) { return vm->refuel(); }
+            static size_t charge(BehaviorTreeVM* vm, size_t fuel, size_t instructions) {
+                return vm->charge(fuel, instructions);
+            }
+            static bool threadInProgress(BehaviorTreeVM* vm, size_t thread) { return vm->threadInProgress(thread); }
+            static Status runParallel(BehaviorTreeVM* vm, size_t first, size_t count,
+                                      size_t successThreshold, size_t failureThreshold) {
+                return vm->runParallel(first, count, successThreshold, failureThreshold);
+            }
+        };
+
+        /*
+         * Ahead-of-time compiler from VM programs to C++. generate()
+         * writes a source file defining one function for the whole
+         * program, with a label for every instruction and plain gotos
+         * between them, and a BehaviorTreeVMNative named 'symbol' that
+         * refers to it. Threads enter the function through a switch on
+         * their pc, which is also where ret goes back to. Build the file
+         * into the game, declare
+         *
+         *     extern const ofxAI::BTVM::BehaviorTreeVMNative symbol;
+         *
+         * and bind() it to the program loaded at run time. VMs running the
+         * bound program run the generated code in place of the bytecode.
+         *
+         * The generated code keeps the thread state the interpreter does,
+         * pcs included, and runs on the same fuel. Budgets, snapshots,
+         * batches and wakeups therefore work as they do with bytecode,
+         * and every tick has the same results. Leaves and decorators are
+         * called through the program's tables. The one exception is a
+         * leaf whose name is in 'leaves', which is called directly as the
+         * C++ function named there. That function takes the leaf's
+         * NodeTick arguments, and 'includes' has to declare it; leaves
+         * with typed params cannot be named there. Profilers
+         * see nothing of what generated code runs.
+         *
+         * generate() returns false for programs that did not link.
+         * bind() returns nullptr if the code was generated from a
+         * different program.
+         */
+        class BehaviorTreeVMCodegen {
+        public:
+            using ProgramPtr = std::shared_ptr<const BehaviorTreeVMProgram>;
+
+            struct Options {
+                std::string symbol = "btvmProgram";
+                std::vector<std::string> includes;
+                // leaf name to the C++ function it calls
+                std::map<std::string, std::string> leaves;
+            };
+
+            static bool generate(BehaviorTreeVMProgram const & program, Options const & options, std::ostream& out);
+            static ProgramPtr bind(BehaviorTreeVMProgram const & program, BehaviorTreeVMNative const & native);
+
+            // hash of everything generated code depends on: the code, the
+            // threads, and the leaves and decorators it calls
+            static uint64_t fingerprint(BehaviorTreeVMProgram const & program);
+        };
+    }
+}
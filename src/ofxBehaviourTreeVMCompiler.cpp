@@ -0,0 +1,628 @@
+#include "ofxBehaviourTreeVMCompiler.h"
+#include <cstdlib>
+#include <deque>
+#include <limits>
+#include <map>
+
+namespace {
+    using namespace ofxAI::BehaviourTree;
+    using ofxAI::BTVM::BehaviorTreeVM;
+    using ofxAI::BTVM::BehaviorTreeVMThread;
+    using ofxAI::BTVM::BehaviorTreeVMProgram;
+    using ofxAI::BTVM::DictBlackboard;
+    using ops = BehaviorTreeVMProgram::ops;
+    using op_type = BehaviorTreeVMProgram::op_type;
+
+    const size_t NoThread = size_t(-1);
+    const size_t NoTarget = size_t(-1);
+
+    // subtrees smaller than this are cheaper to copy than to call
+    const size_t MinSharedNodes = 3;
+
+    Status toTreeStatus(ofxAI::BTVM::Status status) {
+        // parked threads look like they are still running to the tree
+        if (status == ofxAI::BTVM::Status::Suspended)
+            return Status::Running;
+        return static_cast<Status>(status);
+    }
+
+    // hands a VM thread to a NodeDecorate function as its child node
+    class ThreadNode : public BaseNode {
+    public:
+        ThreadNode(std::string const & ref, BehaviorTreeVM* vm, size_t thread)
+            : BaseNode(ref), m_vm(vm), m_thread(thread) {}
+        virtual Status tick(Tree*) override {
+            return toTreeStatus(m_vm->runThread(m_thread));
+        }
+    protected:
+        BehaviorTreeVM* m_vm;
+        size_t m_thread;
+    };
+
+    // the node description a node symbol was compiled from
+    struct SymbolNode : Node {
+        SymbolNode(BehaviorTreeVMProgram::Symbol const & symbol) {
+            m_name = symbol.name;
+            m_ref = symbol.ref;
+            m_params = symbol.params;
+            m_values = symbol.values;
+        }
+    };
+
+    bool isLiteralFact(const std::string& factName) {
+        return !factName.empty() && factName[0] != '#' && factName[0] != '@';
+    }
+
+    class Compiler {
+    public:
+        Compiler(BehaviorTreeVMProgram& program, CompositeMode mode)
+            : m_program(program), m_mode(mode) {}
+
+        bool compile(Node const & root) {
+            if (!known(root))
+                return false;
+            addShape(root);
+            countUses(root);
+            addThread(root, m_mode);
+            while (!m_pending.empty()) {
+                auto pending = m_pending.front();
+                m_pending.pop_front();
+                m_program.m_threadEntries[pending.thread].start = m_program.m_program.size();
+                setRef(pending.ref);
+                emit(*pending.node, m_program.m_threadEntries[pending.thread].mode);
+                op(ops::end::opcode);
+            }
+            // shared code goes after all the threads; it never adds
+            // threads, but may call further shared code
+            for (size_t i = 0; i < m_subroutines.size(); i++) {
+                m_subroutines[i].start = here();
+                setRef(m_subroutines[i].ref);
+                emitCode(*m_subroutines[i].node, m_subroutines[i].mode);
+                op(ops::ret::opcode);
+                for (auto call : m_subroutines[i].calls)
+                    patch(call, 1, m_subroutines[i].start);
+            }
+            if (m_overflow)
+                return false;
+            return m_program.link();
+        }
+    protected:
+        struct PendingThread {
+            const Node* node;
+            size_t thread;
+            std::string ref;    // of the node the thread was requested by
+        };
+
+        // subtrees that compile to the same code have the same shape
+        struct Shape {
+            const Node* node;       // the first one of them
+            bool shareable;         // the node itself, whatever its children
+            size_t nodes;
+            size_t uses;
+            std::vector<size_t> children;
+        };
+
+        struct Subroutine {
+            const Node* node;
+            CompositeMode mode;
+            std::string ref;            // of the first call
+            size_t start;
+            std::vector<size_t> calls;  // waiting for start
+        };
+
+        static bool known(Node const & node) {
+            if (node.leaf() || node.paramLeaf() || node.decorator())
+                return true;
+            static const char* names[] = {
+                Sequence::name, Selector::name, MemSequence::name, MemSelector::name,
+                Parallel::name, ConcurrentParallel::name, UntilFalse::name, UntilTrue::name,
+                ReturnTrue::name, ReturnFalse::name, Negate::name,
+                FactExists::name, WaitForFact::name, RemoveFact::name, SetFactConst::name, FactEqualsConst::name,
+                SetFactValue::name, FactEqualsValue::name, Decision::name, Strategy::name
+            };
+            for (auto name : names) {
+                if (node.name() == name)
+                    return true;
+            }
+            return false;
+        }
+
+        // the mode a composite needs its thread in, or the given one if
+        // the node does not care
+        CompositeMode modeOf(Node const & node, CompositeMode mode) const {
+            auto& name = node.name();
+            if ((name == Sequence::name) || (name == Selector::name) ||
+                (name == UntilFalse::name) || (name == UntilTrue::name))
+                return m_mode;
+            if ((name == MemSequence::name) || (name == MemSelector::name))
+                return CompositeMode::Memory;
+            if (name == Decision::name)
+                return CompositeMode::Reactive;
+            return mode;
+        }
+
+        // gives every node a shape, bottom up. Refs are left out, so the
+        // shared code of copies with different refs is attributed to the
+        // first copy compiled. Leaves without a name cannot be told apart,
+        // and decorators, parallels and decisions run threads whose state
+        // differs per copy, so those shapes are never shared.
+        size_t addShape(Node const & node) {
+            std::vector<size_t> children;
+            size_t nodes = 1;
+            for (auto& child : node.children()) {
+                children.push_back(addShape(child));
+                nodes += m_shapes[children.back()].nodes;
+            }
+            auto& name = node.name();
+            bool leaf = node.leaf() || node.paramLeaf();
+            bool shareable = !node.decorator() && (!leaf || !name.empty()) &&
+                             (name != Parallel::name) && (name != ConcurrentParallel::name) && (name != Decision::name);
+            std::string key = name;
+            if (!shareable) {
+                key += '\0' + std::to_string((uintptr_t)&node);
+            }
+            else {
+                key += '\0';
+                key += node.leaf() ? 'l' : node.paramLeaf() ? 'p' : 'n';
+                for (auto& param : node.params())
+                    key += '\0' + param;
+                key += '\1';
+                for (auto& value : node.values())
+                    key += '\0' + std::to_string(valueId(value));
+                key += '\1';
+                for (auto child : children)
+                    key += '\0' + std::to_string(child);
+            }
+            auto found = m_shapeIds.find(key);
+            size_t shape;
+            if (found != m_shapeIds.end()) {
+                shape = found->second;
+            }
+            else {
+                shape = m_shapes.size();
+                m_shapes.push_back({ &node, shareable, nodes, 0, std::move(children) });
+                m_shapeIds[key] = shape;
+            }
+            m_shapeOf[&node] = shape;
+            return shape;
+        }
+
+        size_t valueId(Value const & value) {
+            for (size_t i = 0; i < m_values.size(); i++) {
+                if ((m_values[i].type() == value.type()) && (m_values[i] == value))
+                    return i;
+            }
+            m_values.push_back(value);
+            return m_values.size() - 1;
+        }
+
+        // counts the places each shape is compiled at; copies inside a
+        // copy only count once, as the outer copy is compiled once
+        void countUses(Node const & node) {
+            if (m_shapes[m_shapeOf.at(&node)].uses++)
+                return;
+            for (auto& child : node.children())
+                countUses(child);
+        }
+
+        // the subtree compiles on the current thread in this mode
+        bool shareable(size_t shape, CompositeMode mode) {
+            auto key = std::make_pair(shape, mode);
+            auto found = m_shareable.find(key);
+            if (found != m_shareable.end())
+                return found->second;
+            Shape const & s = m_shapes[shape];
+            bool result = s.shareable && (modeOf(*s.node, mode) == mode);
+            for (size_t i = 0; result && (i < s.children.size()); i++)
+                result = shareable(s.children[i], mode);
+            m_shareable[key] = result;
+            return result;
+        }
+
+        // how many calls deep code compiled for the shape goes, 0 if it
+        // is compiled in place and calls nothing
+        size_t callDepth(size_t shape, CompositeMode mode) {
+            auto key = std::make_pair(shape, mode);
+            auto found = m_callDepth.find(key);
+            if (found != m_callDepth.end())
+                return found->second;
+            Shape const & s = m_shapes[shape];
+            size_t depth = 0;
+            for (auto child : s.children)
+                depth = std::max(depth, callDepth(child, mode));
+            if ((s.uses >= 2) && (s.nodes >= MinSharedNodes) && (depth < BehaviorTreeVMThread::MaxCallDepth) &&
+                shareable(shape, mode))
+                depth++;
+            m_callDepth[key] = depth;
+            return depth;
+        }
+
+        bool isCalled(size_t shape, CompositeMode mode) {
+            size_t depth = 0;
+            for (auto child : m_shapes[shape].children)
+                depth = std::max(depth, callDepth(child, mode));
+            return callDepth(shape, mode) > depth;
+        }
+
+        // threads are numbered as they are requested, and their code is
+        // emitted after the code requesting them
+        size_t addThread(Node const & node, CompositeMode mode) {
+            return addThread(node, mode, m_ref);
+        }
+
+        size_t addThread(Node const & node, CompositeMode mode, std::string const & ref) {
+            size_t thread = m_program.m_threadEntries.size();
+            m_program.m_threadEntries.push_back({ 0, mode });
+            m_pending.push_back({ &node, thread, ref });
+            return thread;
+        }
+
+        // nodes without a ref of their own belong to the node around them
+        std::string const & refOf(Node const & node) const {
+            return node.ref().empty() ? m_ref : node.ref();
+        }
+
+        // the code from here on was compiled from the node with this ref
+        void setRef(std::string const & ref) {
+            m_ref = ref;
+            auto& map = m_program.m_sourceMap;
+            if (!map.empty() && (map.back().pc == here()))
+                map.pop_back();
+            if (map.empty() ? !ref.empty() : (map.back().ref != ref))
+                map.push_back({ here(), ref });
+        }
+
+        size_t here() const {
+            return m_program.m_program.size();
+        }
+
+        void op(op_type code) {
+            m_program.m_program.push_back(code);
+        }
+
+        void op(op_type code, size_t operand) {
+            op(code);
+            index(operand);
+        }
+
+        // an index operand; ones too large for an operand fail the program
+        void index(size_t value) {
+            if (value > (size_t)std::numeric_limits<op_type>::max())
+                m_overflow = true;
+            op((op_type)value);
+        }
+
+        // points the branch at instruction 'at' (operand 'operand') to
+        // 'target'; offsets too far for an operand fail the program
+        void patch(size_t at, size_t operand, size_t target) {
+            long offset = (long)target - (long)at;
+            if ((offset < std::numeric_limits<op_type>::min()) || (offset > std::numeric_limits<op_type>::max()))
+                m_overflow = true;
+            m_program.m_program[at + operand] = (op_type)offset;
+        }
+
+        size_t addString(std::string const & str) {
+            auto& strings = m_program.m_stringTable;
+            auto found = std::find(strings.begin(), strings.end(), str);
+            if (found != strings.end())
+                return found - strings.begin();
+            strings.push_back(str);
+            return strings.size() - 1;
+        }
+
+        size_t addConstant(Value const & value) {
+            auto& constants = m_program.m_constants;
+            for (size_t i = 0; i < constants.size(); i++) {
+                if ((constants[i].type() == value.type()) && (constants[i] == value))
+                    return i;
+            }
+            constants.push_back(value);
+            return constants.size() - 1;
+        }
+
+        using Symbol = BehaviorTreeVMProgram::Symbol;
+
+        void emitLeaf(BehaviorTreeVMProgram::bt_runner runner, Symbol symbol) {
+            op(ops::run::opcode, m_program.m_leaves.size());
+            m_program.m_leaves.push_back(std::move(runner));
+            m_program.m_leafSymbols.push_back(std::move(symbol));
+        }
+
+        // runs the node's own tree implementation, for nodes that have
+        // no instructions of their own
+        void emitNode(Node const & node) {
+            Symbol symbol{ Symbol::Kind::Node, node.name(), node.ref(), node.params(), node.values(), NoThread };
+            auto runner = ofxAI::BTVM::BehaviorTreeVMCompiler::nodeRunner(symbol);
+            emitLeaf(std::move(runner), std::move(symbol));
+        }
+
+        void emit(Node const & node, CompositeMode mode) {
+            if (refOf(node) == m_ref) {
+                emitShared(node, mode);
+                return;
+            }
+            std::string outer = m_ref;
+            setRef(node.ref());
+            emitShared(node, mode);
+            setRef(outer);
+        }
+
+        // calls the code of subtrees shared with other places, and
+        // compiles the others in place
+        void emitShared(Node const & node, CompositeMode mode) {
+            size_t shape = m_shapeOf.at(&node);
+            if (!isCalled(shape, mode)) {
+                emitCode(node, mode);
+                return;
+            }
+            auto key = std::make_pair(shape, mode);
+            auto found = m_subroutineOf.find(key);
+            size_t subroutine;
+            if (found != m_subroutineOf.end()) {
+                subroutine = found->second;
+            }
+            else {
+                subroutine = m_subroutines.size();
+                m_subroutines.push_back({ &node, mode, m_ref, NoTarget, {} });
+                m_subroutineOf[key] = subroutine;
+            }
+            Subroutine& called = m_subroutines[subroutine];
+            if (called.start == NoTarget)
+                called.calls.push_back(here());
+            op(ops::call::opcode, 0);
+            if (called.start != NoTarget)
+                patch(here() - 2, 1, called.start);
+        }
+
+        void emitCode(Node const & node, CompositeMode mode) {
+            CompositeMode wanted = modeOf(node, mode);
+            if (wanted != mode) {
+                op(ops::run_thr::opcode, addThread(node, wanted));
+                return;
+            }
+
+            auto& name = node.name();
+            auto& children = node.children();
+            auto& params = node.params();
+            if (node.leaf()) {
+                Symbol symbol{ Symbol::Kind::Leaf, name, node.ref(), params, {}, NoThread };
+                auto runner = ofxAI::BTVM::BehaviorTreeVMCompiler::leafRunner(symbol, node.leaf());
+                emitLeaf(std::move(runner), std::move(symbol));
+            }
+            else if (node.paramLeaf()) {
+                // params that do not parse leave the leaf without a
+                // function, which fails the program
+                Symbol symbol{ Symbol::Kind::Leaf, name, node.ref(), params, {}, NoThread };
+                auto runner = ofxAI::BTVM::BehaviorTreeVMCompiler::leafRunner(symbol, node.schema(), node.paramLeaf());
+                emitLeaf(std::move(runner), std::move(symbol));
+            }
+            else if (node.decorator()) {
+                std::string ref = children.empty() ? std::string() : children[0].ref();
+                size_t child = children.empty() ? NoThread : addThread(children[0], modeOf(children[0], mode));
+                Symbol symbol{ Symbol::Kind::Decorator, name, ref, params, {}, child };
+                op(ops::run_dec::opcode, m_program.m_decoratorNodes.size());
+                m_program.m_decoratorNodes.push_back(ofxAI::BTVM::BehaviorTreeVMCompiler::decoratorRunner(symbol, node.decorator()));
+                m_program.m_decoratorSymbols.push_back(std::move(symbol));
+            }
+            else if ((name == Sequence::name) || (name == MemSequence::name)) {
+                emitChildren(children, mode, ops::bra_f::opcode, false);
+            }
+            else if ((name == Selector::name) || (name == MemSelector::name)) {
+                emitChildren(children, mode, ops::bra_t::opcode, false);
+            }
+            else if (name == UntilFalse::name) {
+                emitChildren(children, mode, ops::bra_f::opcode, true);
+            }
+            else if (name == UntilTrue::name) {
+                emitChildren(children, mode, ops::bra_t::opcode, true);
+            }
+            else if ((name == ReturnTrue::name) || (name == ReturnFalse::name) || (name == Negate::name)) {
+                if (children.empty()) {
+                    op(ops::set_i::opcode);
+                    return;
+                }
+                emit(children[0], mode);
+                if (name == ReturnTrue::name)
+                    op(ops::set_t::opcode);
+                else if (name == ReturnFalse::name)
+                    op(ops::set_f::opcode);
+                else
+                    op(ops::neg::opcode);
+            }
+            else if ((name == Parallel::name) || (name == ConcurrentParallel::name)) {
+                // the VM runs one thread at a time, so concurrent parallels
+                // tick their children in turn like plain ones
+                if (children.empty()) {
+                    op(ops::set_i::opcode);
+                    return;
+                }
+                size_t successThreshold = children.size(), failureThreshold = 1;
+                if (params.size() >= 2) {
+                    successThreshold = std::atoi(params[0].c_str());
+                    failureThreshold = std::atoi(params[1].c_str());
+                }
+                size_t first = m_program.m_threadEntries.size();
+                for (auto& child : children)
+                    addThread(child, modeOf(child, mode));
+                op(ops::run_par::opcode);
+                index(first);
+                index(children.size());
+                index(successThreshold);
+                index(failureThreshold);
+            }
+            else if (name == Decision::name) {
+                emitDecision(children, mode);
+            }
+            else if ((name == FactExists::name) || (name == WaitForFact::name) || (name == RemoveFact::name)) {
+                if (params.empty())
+                    op(ops::set_i::opcode);
+                else if (isLiteralFact(params[0]))
+                    op(name == FactExists::name ? ops::chk_fact::opcode :
+                       name == WaitForFact::name ? ops::wait_fact::opcode :
+                       ops::rm_fact::opcode, addString(params[0]));
+                else
+                    emitNode(node);
+            }
+            else if ((name == SetFactConst::name) || (name == FactEqualsConst::name)) {
+                if (params.size() < 2)
+                    op(ops::set_i::opcode);
+                else if (isLiteralFact(params[0]) && isLiteralFact(params[1]))
+                    emitFact(name == SetFactConst::name ? ops::set_fact::opcode : ops::eq_fact::opcode,
+                             params[0], Value(params[1]));
+                else
+                    emitNode(node);
+            }
+            else if ((name == SetFactValue::name) || (name == FactEqualsValue::name)) {
+                if (params.empty() || node.values().empty())
+                    op(ops::set_i::opcode);
+                else if (isLiteralFact(params[0]))
+                    emitFact(name == SetFactValue::name ? ops::set_fact::opcode : ops::eq_fact::opcode,
+                             params[0], node.values()[0]);
+                else
+                    emitNode(node);
+            }
+            else {
+                // unknown node types and strategies outside a decision
+                op(ops::set_i::opcode);
+            }
+        }
+
+        void emitFact(op_type code, std::string const & fact, Value const & value) {
+            op(code, addString(fact));
+            index(addConstant(value));
+        }
+
+        // runs children in order while they return the status 'branch'
+        // does not branch on; loops go around again, returning Running
+        void emitChildren(std::vector<Node> const & children, CompositeMode mode, op_type branch, bool loop) {
+            if (children.empty()) {
+                op(ops::set_i::opcode);
+                return;
+            }
+            size_t start = here();
+            std::vector<size_t> exits;
+            for (size_t i = 0; i < children.size(); i++) {
+                emit(children[i], mode);
+                if (loop || (i + 1 < children.size())) {
+                    exits.push_back(here());
+                    op(branch, 0);
+                }
+            }
+            if (loop) {
+                op(ops::set_r::opcode);
+                size_t back = here();
+                op(ops::jmp::opcode, 0);
+                patch(back, 1, start);
+            }
+            for (auto exit : exits)
+                patch(exit, 1, here());
+        }
+
+        // a strategy whose action is still running gets resumed straight
+        // away; otherwise conditions are tried in order and the action of
+        // the first one to succeed runs on its own thread
+        void emitDecision(std::vector<Node> const & strategies, CompositeMode mode) {
+            std::vector<size_t> actions;
+            for (auto& strategy : strategies) {
+                if ((strategy.name() != Strategy::name) || (strategy.children().size() != 2))
+                    break;
+                auto& action = strategy.children()[1];
+                actions.push_back(addThread(action, modeOf(action, mode), refOf(strategy)));
+            }
+            std::vector<size_t> resumes, exits;
+            for (auto action : actions) {
+                resumes.push_back(here());
+                op(ops::rsm_thr::opcode, action);
+                op(0);
+            }
+            std::string outer = m_ref;
+            for (size_t i = 0; i < actions.size(); i++) {
+                setRef(refOf(strategies[i]));
+                emit(strategies[i].children()[0], mode);
+                size_t next = here();
+                op(ops::bra_f::opcode, 0);
+                op(ops::run_thr::opcode, actions[i]);
+                exits.push_back(here());
+                op(ops::jmp::opcode, 0);
+                patch(next, 1, here());
+                setRef(outer);
+            }
+            // no strategy applies, or the next one is malformed
+            op(ops::set_i::opcode);
+            for (auto resume : resumes)
+                patch(resume, 2, here());
+            for (auto exit : exits)
+                patch(exit, 1, here());
+        }
+
+        BehaviorTreeVMProgram& m_program;
+        CompositeMode m_mode;
+        bool m_overflow = false;   // an operand did not fit
+        std::deque<PendingThread> m_pending;
+        std::string m_ref;  // of the node being compiled
+
+        std::vector<Shape> m_shapes;
+        std::map<std::string, size_t> m_shapeIds;
+        std::map<const Node*, size_t> m_shapeOf;
+        std::vector<Value> m_values;
+        std::map<std::pair<size_t, CompositeMode>, bool> m_shareable;
+        std::map<std::pair<size_t, CompositeMode>, size_t> m_callDepth;
+        std::vector<Subroutine> m_subroutines;
+        std::map<std::pair<size_t, CompositeMode>, size_t> m_subroutineOf;
+    };
+}
+
+ofxAI::BTVM::BehaviorTreeVMCompiler::ProgramPtr ofxAI::BTVM::BehaviorTreeVMCompiler::compile(
+    BehaviourTree::Node const & root,
+    BehaviourTree::CompositeMode mode) {
+    auto program = std::make_shared<BehaviorTreeVMProgram>();
+    Compiler compiler(*program, mode);
+    if (!compiler.compile(root))
+        return ProgramPtr();
+    return program;
+}
+
+ofxAI::BTVM::BehaviorTreeVMProgram::bt_runner ofxAI::BTVM::BehaviorTreeVMCompiler::leafRunner(
+    BehaviorTreeVMProgram::Symbol const & symbol,
+    BehaviourTree::BaseNode::NodeTick const & tick) {
+    auto leafParams = symbol.params;
+    return [tick, leafParams](BehaviorTreeVMThread* thread, DictBlackboard*) {
+        return static_cast<Status>(tick(&thread->m_vm->getHostTree(), leafParams));
+    };
+}
+
+ofxAI::BTVM::BehaviorTreeVMProgram::bt_runner ofxAI::BTVM::BehaviorTreeVMCompiler::leafRunner(
+    BehaviorTreeVMProgram::Symbol const & symbol,
+    BehaviourTree::ParamSchema const & schema,
+    BehaviourTree::BaseNode::NodeParamTick const & tick) {
+    BehaviourTree::LeafParams leafParams;
+    if (!BehaviourTree::LeafParams::parse(schema, symbol.params, leafParams))
+        return BehaviorTreeVMProgram::bt_runner();
+    return [tick, leafParams](BehaviorTreeVMThread* thread, DictBlackboard*) {
+        return static_cast<Status>(tick(&thread->m_vm->getHostTree(), leafParams));
+    };
+}
+
+ofxAI::BTVM::BehaviorTreeVMProgram::bt_decorator ofxAI::BTVM::BehaviorTreeVMCompiler::decoratorRunner(
+    BehaviorTreeVMProgram::Symbol const & symbol,
+    BehaviourTree::BaseNode::NodeDecorate const & decorate) {
+    auto decoratorParams = symbol.params;
+    std::string ref = symbol.ref;
+    size_t child = symbol.child;
+    return [decorate, decoratorParams, ref, child](BehaviorTreeVMThread* thread, DictBlackboard*) {
+        BehaviorTreeVM* vm = thread->m_vm;
+        ThreadNode childNode(ref, vm, child);
+        return static_cast<Status>(
+            decorate(&vm->getHostTree(), child != NoThread ? &childNode : nullptr, decoratorParams));
+    };
+}
+
+ofxAI::BTVM::BehaviorTreeVMProgram::bt_runner ofxAI::BTVM::BehaviorTreeVMCompiler::nodeRunner(
+    BehaviorTreeVMProgram::Symbol const & symbol) {
+    std::shared_ptr<BaseNode> graph = Tree::createNode(SymbolNode(symbol));
+    if (!graph)
+        return BehaviorTreeVMProgram::bt_runner();
+    return [graph](BehaviorTreeVMThread* thread, DictBlackboard*) {
+        return static_cast<Status>(graph->tick(&thread->m_vm->getHostTree()));
+    };
+}
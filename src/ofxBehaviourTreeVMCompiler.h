@@ -0,0 +1,57 @@
+#pragma once
+#include "ofxBehaviourTreeVM.h"
+
+namespace ofxAI {
+    namespace BTVM {
+
+        /*
+         * Lowers a BehaviourTree::Node description to a VM program.
+         * Sequences, selectors, loops and the built-in decorators become
+         * plain branches over the current value; facts on literal names
+         * become fact instructions. Parallel children, Decision actions
+         * and the children of custom decorators get threads of their own.
+         * Leaves and custom decorators keep calling their NodeTick and
+         * NodeDecorate functions, with the VM's host tree; typed leaves
+         * get params parsed while compiling.
+         *
+         * Threads follow the composite mode: with Reactive, a Running leaf
+         * restarts its thread on the next tick, with Memory it resumes at
+         * that leaf. MemSequence and MemSelector always resume, and
+         * Decision conditions are always evaluated from the first one.
+         * The program ticks the same results as the compiled tree.
+         *
+         * Subtrees that appear more than once, made only of named leaves,
+         * facts and the composites that run on the current thread, are
+         * compiled once after the threads and run with call and ret.
+         * Calls nest no deeper than a thread's return stack; deeper ones
+         * are compiled in place.
+         *
+         * The program's source map names the ref of the node each
+         * instruction was compiled from; code of nodes without a ref is
+         * attributed to the closest node around them that has one.
+         *
+         * Returns nullptr if the root node type is unknown, or if a branch
+         * offset or table index does not fit in an operand.
+         */
+        class BehaviorTreeVMCompiler {
+        public:
+            using ProgramPtr = std::shared_ptr<const BehaviorTreeVMProgram>;
+
+            static ProgramPtr compile(BehaviourTree::Node const & root,
+                                      BehaviourTree::CompositeMode mode = BehaviourTree::CompositeMode::Reactive);
+
+            // the functions run by leaf and decorator instructions, for a
+            // leaf or decorator symbol with its function, or a node symbol.
+            // Typed leaves get the symbol's params parsed here, and no
+            // function if they do not parse.
+            static BehaviorTreeVMProgram::bt_runner leafRunner(BehaviorTreeVMProgram::Symbol const & symbol,
+                                                               BehaviourTree::BaseNode::NodeTick const & tick);
+            static BehaviorTreeVMProgram::bt_runner leafRunner(BehaviorTreeVMProgram::Symbol const & symbol,
+                                                               BehaviourTree::ParamSchema const & schema,
+                                                               BehaviourTree::BaseNode::NodeParamTick const & tick);
+            static BehaviorTreeVMProgram::bt_decorator decoratorRunner(BehaviorTreeVMProgram::Symbol const & symbol,
+                                                                       BehaviourTree::BaseNode::NodeDecorate const & decorate);
+            static BehaviorTreeVMProgram::bt_runner nodeRunner(BehaviorTreeVMProgram::Symbol const & symbol);
+        };
+    }
+}
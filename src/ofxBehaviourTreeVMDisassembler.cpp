@@ -0,0 +1,168 @@
+#include "ofxBehaviourTreeVMDisassembler.h"
+#include "ofxBehaviourTreeVMVerifier.h"
+#include <set>
+#include <sstream>
+
+namespace {
+    using ofxAI::BTVM::BehaviorTreeVMProgram;
+    using ofxAI::BTVM::BehaviorTreeVMVerifier;
+    using ofxAI::BehaviourTree::Value;
+    using Symbol = BehaviorTreeVMProgram::Symbol;
+    using ops = BehaviorTreeVMProgram::ops;
+    using op_type = BehaviorTreeVMProgram::op_type;
+
+    // columns instructions and their comments start at
+    const size_t OperandColumn = 10;
+    const size_t CommentColumn = 32;
+
+    void padTo(std::string& text, size_t column) {
+        text.resize(std::max(text.size() + 1, column), ' ');
+    }
+
+    std::string symbolName(std::vector<Symbol> const & symbols, size_t index, const char* kind) {
+        std::string text = std::string(kind) + " " + std::to_string(index);
+        if (index < symbols.size()) {
+            if (!symbols[index].name.empty())
+                text += " " + symbols[index].name;
+            if (!symbols[index].ref.empty())
+                text += " [" + symbols[index].ref + "]";
+        }
+        return text;
+    }
+
+    std::string factName(BehaviorTreeVMProgram const & program, size_t index) {
+        if (index >= program.m_stringTable.size())
+            return "string " + std::to_string(index);
+        return "\"" + program.m_stringTable[index] + "\"";
+    }
+
+    std::string constant(BehaviorTreeVMProgram const & program, size_t index) {
+        if (index >= program.m_constants.size())
+            return "constant " + std::to_string(index);
+        Value const & value = program.m_constants[index];
+        if (value.type() == Value::Type::String)
+            return "\"" + value.toString() + "\"";
+        return value.toString();
+    }
+
+    std::string target(size_t pc, op_type offset) {
+        return "-> " + std::to_string((off_t)pc + offset);
+    }
+
+    // what the operands of the instruction at pc name
+    std::string comment(BehaviorTreeVMProgram const & program, const op_type* code, size_t pc) {
+        switch (code[0]) {
+        case ops::run::opcode:
+            return symbolName(program.m_leafSymbols, code[1], "leaf");
+        case ops::run_bra_f::opcode:
+        case ops::run_bra_t::opcode:
+            return symbolName(program.m_leafSymbols, code[1], "leaf") + " " + target(pc, code[2]);
+        case ops::run_dec::opcode: {
+            std::string text = symbolName(program.m_decoratorSymbols, code[1], "decorator");
+            if (((size_t)code[1] < program.m_decoratorSymbols.size()) &&
+                (program.m_decoratorSymbols[code[1]].child != size_t(-1)))
+                text += " child thread " + std::to_string(program.m_decoratorSymbols[code[1]].child);
+            return text;
+        }
+        case ops::run_thr::opcode:
+            return "thread " + std::to_string(code[1]);
+        case ops::rsm_thr::opcode:
+            return "thread " + std::to_string(code[1]) + " " + target(pc, code[2]);
+        case ops::run_par::opcode:
+            return "threads " + std::to_string(code[1]) + ".." + std::to_string(code[1] + code[2] - 1) +
+                   ", succeed at " + std::to_string(code[3]) + ", fail at " + std::to_string(code[4]);
+        case ops::bra_f::opcode:
+        case ops::bra_t::opcode:
+        case ops::jmp::opcode:
+        case ops::call::opcode:
+            return target(pc, code[1]);
+        case ops::chk_fact::opcode:
+        case ops::rm_fact::opcode:
+        case ops::wait_fact::opcode:
+            return factName(program, code[1]);
+        case ops::set_fact::opcode:
+            return factName(program, code[1]) + " = " + constant(program, code[2]);
+        case ops::eq_fact::opcode:
+            return factName(program, code[1]) + " == " + constant(program, code[2]);
+        default:
+            return std::string();
+        }
+    }
+}
+
+void ofxAI::BTVM::BehaviorTreeVMDisassembler::disassemble(BehaviorTreeVMProgram const & program, std::ostream& out) {
+    const op_type* code = program.code();
+    size_t size = program.codeSize();
+    std::multimap<size_t, size_t> starts;
+    for (size_t i = 0; i < program.m_threadEntries.size(); i++)
+        starts.insert({ program.m_threadEntries[i].start, i });
+    // code entered by call instructions
+    std::set<size_t> shared;
+    for (size_t pc = 0; pc < size;) {
+        size_t length = BehaviorTreeVMVerifier::instructionSize(code[pc]);
+        if ((length == 0) || (length > size - pc)) {
+            pc++;
+            continue;
+        }
+        if (code[pc] == ops::call::opcode)
+            shared.insert(pc + code[pc + 1]);
+        pc += length;
+    }
+
+    std::string ref;
+    for (size_t pc = 0; pc < size;) {
+        auto threads = starts.equal_range(pc);
+        bool entry = threads.first != threads.second;
+        for (auto thread = threads.first; thread != threads.second; ++thread) {
+            bool reactive = program.m_threadEntries[thread->second].mode == BehaviourTree::CompositeMode::Reactive;
+            out << "thread " << thread->second << " (" << (thread->second < program.m_roots ? "root, " : "")
+                << (reactive ? "reactive" : "memory") << "):\n";
+        }
+        if (shared.count(pc)) {
+            out << "shared:\n";
+            entry = true;
+        }
+        if (entry || (program.sourceRef(pc) != ref)) {
+            ref = program.sourceRef(pc);
+            out << "  [" << ref << "]\n";
+        }
+
+        std::string line = std::to_string(pc);
+        line.insert(0, line.size() < 6 ? 6 - line.size() : 0, ' ');
+        out << line << "  " << instruction(program, pc) << "\n";
+
+        size_t length = BehaviorTreeVMVerifier::instructionSize(code[pc]);
+        pc += ((length == 0) || (length > size - pc)) ? 1 : length;
+    }
+}
+
+std::string ofxAI::BTVM::BehaviorTreeVMDisassembler::disassemble(BehaviorTreeVMProgram const & program) {
+    std::ostringstream out;
+    disassemble(program, out);
+    return out.str();
+}
+
+std::string ofxAI::BTVM::BehaviorTreeVMDisassembler::instruction(BehaviorTreeVMProgram const & program, size_t pc) {
+    const op_type* code = program.code();
+    size_t size = program.codeSize();
+    if (pc >= size)
+        return std::string();
+    size_t length = BehaviorTreeVMVerifier::instructionSize(code[pc]);
+    if ((length == 0) || (length > size - pc))
+        return ".word " + std::to_string(code[pc]);
+
+    std::string text = BehaviorTreeVMProgram::mnemonic(code[pc]);
+    for (size_t i = 1; i < length; i++) {
+        if (i == 1)
+            padTo(text, OperandColumn);
+        else
+            text += ", ";
+        text += std::to_string(code[pc + i]);
+    }
+    std::string note = comment(program, code + pc, pc);
+    if (!note.empty()) {
+        padTo(text, CommentColumn);
+        text += "; " + note;
+    }
+    return text;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "ofxBehaviourTreeVM.h"
+#include <ostream>
+
+namespace ofxAI {
+    namespace BTVM {
+
+        /*
+         * Prints VM programs as text: one instruction per line, with its
+         * pc, mnemonic and operands, followed by what the operands name -
+         * leaves and decorators by name and ref, facts by their string,
+         * constants by value, and branches by their target pc. Thread
+         * entries, the shared code calls go to, and changes of the source
+         * map ref are printed above the code they apply to.
+         *
+         * Instructions that do not decode, as in programs that did not
+         * link, are printed as raw words.
+         */
+        class BehaviorTreeVMDisassembler {
+        public:
+            static void disassemble(BehaviorTreeVMProgram const & program, std::ostream& out);
+            static std::string disassemble(BehaviorTreeVMProgram const & program);
+
+            // the instruction at pc, without its pc, for traces and
+            // profiles
+            static std::string instruction(BehaviorTreeVMProgram const & program, size_t pc);
+        };
+    }
+}
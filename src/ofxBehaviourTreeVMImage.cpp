@@ -0,0 +1,532 @@
+#include "ofxBehaviourTreeVMImage.h"
+#include "ofxBehaviourTreeVMCompiler.h"
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    using ofxAI::BTVM::BehaviorTreeVMProgram;
+    using ofxAI::BTVM::BehaviorTreeVMRegistry;
+    using ofxAI::BehaviourTree::Value;
+    using Symbol = BehaviorTreeVMProgram::Symbol;
+    using op_type = BehaviorTreeVMProgram::op_type;
+
+    const uint32_t Magic = 0x4D565442;  // "BTVM"
+    const uint16_t ByteOrder = 0x0102;
+    const uint32_t NoIndex = uint32_t(-1);
+
+    // every section starts at a multiple of this within the image
+    const size_t SectionAlign = 8;
+
+    struct Section {
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t byteOrder;
+        uint16_t opSize;
+        uint16_t reserved;
+        uint32_t size;
+        uint32_t roots;
+        Section code;        // op_type
+        Section threads;     // ThreadRecord
+        Section strings;     // StringRecord, the program's string table
+        Section constants;   // ValueRecord
+        Section leaves;      // SymbolRecord
+        Section decorators;  // SymbolRecord
+        Section params;      // StringRecord, symbol params
+        Section values;      // ValueRecord, symbol values
+        Section sourceMap;   // SourceRecord
+        Section text;        // chars the string records point into
+    };
+
+    struct StringRecord {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct ThreadRecord {
+        uint32_t start;
+        uint32_t mode;
+    };
+
+    // the payload depends on the type: bool and int in the first word,
+    // floats and vectors as floats, handles and strings in two words
+    struct ValueRecord {
+        uint32_t type;
+        uint32_t words[3];
+    };
+
+    struct SourceRecord {
+        uint32_t pc;
+        StringRecord ref;
+    };
+
+    struct SymbolRecord {
+        uint32_t kind;
+        StringRecord name;
+        StringRecord ref;
+        uint32_t child;
+        Section params;
+        Section values;
+    };
+
+    class ImageWriter {
+    public:
+        ImageWriter(std::vector<uint8_t>& image) : m_image(image) {}
+
+        bool write(BehaviorTreeVMProgram const & program) {
+            m_image.assign(sizeof(Header), 0);
+            Header header = {};
+            header.magic = Magic;
+            header.version = ofxAI::BTVM::BehaviorTreeVMImage::Version;
+            header.byteOrder = ByteOrder;
+            header.opSize = sizeof(op_type);
+            header.roots = (uint32_t)program.m_roots;
+
+            header.code = begin(program.codeSize());
+            append(program.code(), program.codeSize() * sizeof(op_type));
+
+            header.threads = begin(program.m_threadEntries.size());
+            for (auto& entry : program.m_threadEntries)
+                append(ThreadRecord{ (uint32_t)entry.start, (uint32_t)entry.mode });
+
+            header.strings = begin(program.m_stringTable.size());
+            for (auto& str : program.m_stringTable)
+                append(addText(str));
+
+            header.constants = begin(program.m_constants.size());
+            for (auto& value : program.m_constants)
+                append(valueRecord(value));
+
+            std::vector<SymbolRecord> leaves, decorators;
+            for (auto& symbol : program.m_leafSymbols) {
+                if (!addSymbol(symbol, leaves))
+                    return false;
+            }
+            for (auto& symbol : program.m_decoratorSymbols) {
+                if (!addSymbol(symbol, decorators))
+                    return false;
+            }
+            header.leaves = begin(leaves.size());
+            for (auto& record : leaves)
+                append(record);
+            header.decorators = begin(decorators.size());
+            for (auto& record : decorators)
+                append(record);
+            header.params = begin(m_params.size());
+            for (auto& record : m_params)
+                append(record);
+            header.values = begin(m_values.size());
+            for (auto& record : m_values)
+                append(record);
+            header.sourceMap = begin(program.m_sourceMap.size());
+            for (auto& location : program.m_sourceMap)
+                append(SourceRecord{ (uint32_t)location.pc, addText(location.ref) });
+
+            header.text = begin(m_text.size());
+            append(m_text.data(), m_text.size());
+            header.size = (uint32_t)m_image.size();
+            std::memcpy(m_image.data(), &header, sizeof(header));
+            return true;
+        }
+    protected:
+        Section begin(size_t count) {
+            m_image.resize((m_image.size() + SectionAlign - 1) / SectionAlign * SectionAlign, 0);
+            return { (uint32_t)m_image.size(), (uint32_t)count };
+        }
+
+        void append(const void* data, size_t size) {
+            auto bytes = static_cast<const uint8_t*>(data);
+            m_image.insert(m_image.end(), bytes, bytes + size);
+        }
+
+        template <typename T>
+        void append(T const & record) {
+            append(&record, sizeof(record));
+        }
+
+        StringRecord addText(std::string const & str) {
+            StringRecord record{ (uint32_t)m_text.size(), (uint32_t)str.size() };
+            m_text.insert(m_text.end(), str.begin(), str.end());
+            return record;
+        }
+
+        ValueRecord valueRecord(Value const & value) {
+            ValueRecord record = {};
+            record.type = (uint32_t)value.type();
+            switch (value.type()) {
+            case Value::Type::Bool: {
+                bool data = false;
+                value.get(data);
+                record.words[0] = data ? 1 : 0;
+                break;
+            }
+            case Value::Type::Int: {
+                int data = 0;
+                value.get(data);
+                std::memcpy(record.words, &data, sizeof(data));
+                break;
+            }
+            case Value::Type::Float: {
+                float data = 0;
+                value.get(data);
+                std::memcpy(record.words, &data, sizeof(data));
+                break;
+            }
+            case Value::Type::Vector: {
+                Value::Vector data = {};
+                value.get(data);
+                std::memcpy(record.words, &data, sizeof(data));
+                break;
+            }
+            case Value::Type::Handle: {
+                Value::Handle data = {};
+                value.get(data);
+                std::memcpy(record.words, &data.id, sizeof(data.id));
+                break;
+            }
+            case Value::Type::String: {
+                std::string data;
+                value.get(data);
+                StringRecord str = addText(data);
+                std::memcpy(record.words, &str, sizeof(str));
+                break;
+            }
+            default:
+                break;
+            }
+            return record;
+        }
+
+        bool addSymbol(Symbol const & symbol, std::vector<SymbolRecord>& records) {
+            // unnamed functions cannot be found again
+            if (symbol.name.empty())
+                return false;
+            SymbolRecord record = {};
+            record.kind = (uint32_t)symbol.kind;
+            record.name = addText(symbol.name);
+            record.ref = addText(symbol.ref);
+            record.child = (symbol.child == size_t(-1)) ? NoIndex : (uint32_t)symbol.child;
+            record.params = { (uint32_t)m_params.size(), (uint32_t)symbol.params.size() };
+            for (auto& param : symbol.params)
+                m_params.push_back(addText(param));
+            record.values = { (uint32_t)m_values.size(), (uint32_t)symbol.values.size() };
+            for (auto& value : symbol.values)
+                m_values.push_back(valueRecord(value));
+            records.push_back(record);
+            return true;
+        }
+
+        std::vector<uint8_t>& m_image;
+        std::vector<char> m_text;
+        std::vector<StringRecord> m_params;
+        std::vector<ValueRecord> m_values;
+    };
+
+    class ImageReader {
+    public:
+        ImageReader(const uint8_t* image, size_t size) : m_image(image), m_size(size) {}
+
+        bool read(BehaviorTreeVMProgram& program, BehaviorTreeVMRegistry const & registry) {
+            if (m_size < sizeof(Header))
+                return false;
+            std::memcpy(&m_header, m_image, sizeof(m_header));
+            if ((m_header.magic != Magic) || (m_header.version != ofxAI::BTVM::BehaviorTreeVMImage::Version) ||
+                (m_header.byteOrder != ByteOrder) || (m_header.opSize != sizeof(op_type)) ||
+                (m_header.size > m_size))
+                return false;
+            if (!fits(m_header.code, sizeof(op_type)) || !fits(m_header.threads, sizeof(ThreadRecord)) ||
+                !fits(m_header.strings, sizeof(StringRecord)) || !fits(m_header.constants, sizeof(ValueRecord)) ||
+                !fits(m_header.leaves, sizeof(SymbolRecord)) || !fits(m_header.decorators, sizeof(SymbolRecord)) ||
+                !fits(m_header.params, sizeof(StringRecord)) || !fits(m_header.values, sizeof(ValueRecord)) ||
+                !fits(m_header.sourceMap, sizeof(SourceRecord)) || !fits(m_header.text, 1))
+                return false;
+            const uint8_t* code = m_image + m_header.code.offset;
+            if (reinterpret_cast<uintptr_t>(code) % alignof(op_type))
+                return false;
+            program.m_code = reinterpret_cast<const op_type*>(code);
+            program.m_codeSize = m_header.code.count;
+
+            if ((m_header.roots > m_header.threads.count) || (m_header.threads.count == 0))
+                return false;
+            program.m_roots = m_header.roots;
+            for (uint32_t i = 0; i < m_header.threads.count; i++) {
+                auto thread = record<ThreadRecord>(m_header.threads, i);
+                if ((thread.start >= m_header.code.count) || (thread.mode > (uint32_t)ofxAI::BehaviourTree::CompositeMode::Memory))
+                    return false;
+                program.m_threadEntries.push_back({ thread.start, (ofxAI::BehaviourTree::CompositeMode)thread.mode });
+            }
+            for (uint32_t i = 0; i < m_header.strings.count; i++) {
+                std::string str;
+                if (!text(record<StringRecord>(m_header.strings, i), str))
+                    return false;
+                program.m_stringTable.push_back(std::move(str));
+            }
+            for (uint32_t i = 0; i < m_header.constants.count; i++) {
+                Value value;
+                if (!valueOf(record<ValueRecord>(m_header.constants, i), value))
+                    return false;
+                program.m_constants.push_back(std::move(value));
+            }
+
+            for (uint32_t i = 0; i < m_header.leaves.count; i++) {
+                Symbol symbol;
+                if (!symbolOf(record<SymbolRecord>(m_header.leaves, i), symbol))
+                    return false;
+                BehaviorTreeVMProgram::bt_runner runner;
+                if (symbol.kind == Symbol::Kind::Leaf) {
+                    auto leaf = registry.findLeaf(symbol.name);
+                    auto paramLeaf = registry.findParamLeaf(symbol.name);
+                    if (leaf)
+                        runner = ofxAI::BTVM::BehaviorTreeVMCompiler::leafRunner(symbol, *leaf);
+                    else if (paramLeaf)
+                        runner = ofxAI::BTVM::BehaviorTreeVMCompiler::leafRunner(symbol, paramLeaf->schema, paramLeaf->tick);
+                }
+                else if (symbol.kind == Symbol::Kind::Node) {
+                    runner = ofxAI::BTVM::BehaviorTreeVMCompiler::nodeRunner(symbol);
+                }
+                if (!runner)
+                    return false;
+                program.m_leaves.push_back(std::move(runner));
+                program.m_leafSymbols.push_back(std::move(symbol));
+            }
+            for (uint32_t i = 0; i < m_header.decorators.count; i++) {
+                Symbol symbol;
+                if (!symbolOf(record<SymbolRecord>(m_header.decorators, i), symbol) ||
+                    (symbol.kind != Symbol::Kind::Decorator))
+                    return false;
+                if ((symbol.child != size_t(-1)) && (symbol.child >= m_header.threads.count))
+                    return false;
+                auto decorator = registry.findDecorator(symbol.name);
+                if (!decorator)
+                    return false;
+                program.m_decoratorNodes.push_back(ofxAI::BTVM::BehaviorTreeVMCompiler::decoratorRunner(symbol, *decorator));
+                program.m_decoratorSymbols.push_back(std::move(symbol));
+            }
+            for (uint32_t i = 0; i < m_header.sourceMap.count; i++) {
+                auto source = record<SourceRecord>(m_header.sourceMap, i);
+                BehaviorTreeVMProgram::SourceLocation location{ source.pc, std::string() };
+                if ((source.pc >= m_header.code.count) || !text(source.ref, location.ref))
+                    return false;
+                if (!program.m_sourceMap.empty() && (program.m_sourceMap.back().pc >= location.pc))
+                    return false;
+                program.m_sourceMap.push_back(std::move(location));
+            }
+            return true;
+        }
+    protected:
+        bool fits(Section const & section, size_t recordSize) const {
+            if ((section.offset % SectionAlign) || (section.offset > m_header.size))
+                return false;
+            return uint64_t(section.count) * recordSize <= m_header.size - section.offset;
+        }
+
+        template <typename T>
+        T record(Section const & section, uint32_t index) const {
+            T value;
+            std::memcpy(&value, m_image + section.offset + size_t(index) * sizeof(T), sizeof(T));
+            return value;
+        }
+
+        bool text(StringRecord const & str, std::string& output) const {
+            if ((str.offset > m_header.text.count) || (str.length > m_header.text.count - str.offset))
+                return false;
+            output.assign(reinterpret_cast<const char*>(m_image + m_header.text.offset + str.offset), str.length);
+            return true;
+        }
+
+        bool valueOf(ValueRecord const & record, Value& value) const {
+            switch ((Value::Type)record.type) {
+            case Value::Type::Empty:
+                value = Value();
+                return true;
+            case Value::Type::Bool:
+                value = Value(record.words[0] != 0);
+                return true;
+            case Value::Type::Int: {
+                int data;
+                std::memcpy(&data, record.words, sizeof(data));
+                value = Value(data);
+                return true;
+            }
+            case Value::Type::Float: {
+                float data;
+                std::memcpy(&data, record.words, sizeof(data));
+                value = Value(data);
+                return true;
+            }
+            case Value::Type::Vector: {
+                Value::Vector data;
+                std::memcpy(&data, record.words, sizeof(data));
+                value = Value(data);
+                return true;
+            }
+            case Value::Type::Handle: {
+                Value::Handle data;
+                std::memcpy(&data.id, record.words, sizeof(data.id));
+                value = Value(data);
+                return true;
+            }
+            case Value::Type::String: {
+                StringRecord str;
+                std::memcpy(&str, record.words, sizeof(str));
+                std::string data;
+                if (!text(str, data))
+                    return false;
+                value = Value(data);
+                return true;
+            }
+            default:
+                return false;
+            }
+        }
+
+        bool symbolOf(SymbolRecord const & record, Symbol& symbol) const {
+            if (record.kind > (uint32_t)Symbol::Kind::Node)
+                return false;
+            symbol.kind = (Symbol::Kind)record.kind;
+            symbol.child = (record.child == NoIndex) ? size_t(-1) : record.child;
+            if (!text(record.name, symbol.name) || !text(record.ref, symbol.ref))
+                return false;
+            if ((record.params.offset > m_header.params.count) ||
+                (record.params.count > m_header.params.count - record.params.offset) ||
+                (record.values.offset > m_header.values.count) ||
+                (record.values.count > m_header.values.count - record.values.offset))
+                return false;
+            for (uint32_t i = 0; i < record.params.count; i++) {
+                std::string param;
+                if (!text(this->record<StringRecord>(m_header.params, record.params.offset + i), param))
+                    return false;
+                symbol.params.push_back(std::move(param));
+            }
+            for (uint32_t i = 0; i < record.values.count; i++) {
+                Value value;
+                if (!valueOf(this->record<ValueRecord>(m_header.values, record.values.offset + i), value))
+                    return false;
+                symbol.values.push_back(std::move(value));
+            }
+            return true;
+        }
+
+        const uint8_t* m_image;
+        size_t m_size;
+        Header m_header;
+    };
+}
+
+void ofxAI::BTVM::BehaviorTreeVMRegistry::addLeaf(std::string const & name, BehaviourTree::BaseNode::NodeTick const & leaf) {
+    m_leaves[name] = leaf;
+}
+
+void ofxAI::BTVM::BehaviorTreeVMRegistry::addLeaf(std::string const & name, BehaviourTree::ParamSchema const & schema,
+                                                 BehaviourTree::BaseNode::NodeParamTick const & leaf) {
+    m_paramLeaves[name] = { schema, leaf };
+}
+
+void ofxAI::BTVM::BehaviorTreeVMRegistry::addDecorator(std::string const & name, BehaviourTree::BaseNode::NodeDecorate const & decorator) {
+    m_decorators[name] = decorator;
+}
+
+const ofxAI::BehaviourTree::BaseNode::NodeTick* ofxAI::BTVM::BehaviorTreeVMRegistry::findLeaf(std::string const & name) const {
+    auto found = m_leaves.find(name);
+    return (found != m_leaves.end()) ? &found->second : nullptr;
+}
+
+const ofxAI::BTVM::BehaviorTreeVMRegistry::ParamLeaf* ofxAI::BTVM::BehaviorTreeVMRegistry::findParamLeaf(std::string const & name) const {
+    auto found = m_paramLeaves.find(name);
+    return (found != m_paramLeaves.end()) ? &found->second : nullptr;
+}
+
+const ofxAI::BehaviourTree::BaseNode::NodeDecorate* ofxAI::BTVM::BehaviorTreeVMRegistry::findDecorator(std::string const & name) const {
+    auto found = m_decorators.find(name);
+    return (found != m_decorators.end()) ? &found->second : nullptr;
+}
+
+bool ofxAI::BTVM::BehaviorTreeVMImage::save(BehaviorTreeVMProgram const & program, std::vector<uint8_t>& image) {
+    ImageWriter writer(image);
+    if (writer.write(program))
+        return true;
+    image.clear();
+    return false;
+}
+
+bool ofxAI::BTVM::BehaviorTreeVMImage::save(BehaviorTreeVMProgram const & program, std::string const & path) {
+    std::vector<uint8_t> image;
+    if (!save(program, image))
+        return false;
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(image.data()), image.size());
+    return file.good();
+}
+
+ofxAI::BTVM::BehaviorTreeVMImage::ProgramPtr ofxAI::BTVM::BehaviorTreeVMImage::load(
+    const void* image, size_t size, BehaviorTreeVMRegistry const & registry, std::shared_ptr<const void> owner) {
+    auto program = std::make_shared<BehaviorTreeVMProgram>();
+    ImageReader reader(static_cast<const uint8_t*>(image), size);
+    if (!reader.read(*program, registry))
+        return ProgramPtr();
+    program->m_image = owner;
+    if (!program->link())
+        return ProgramPtr();
+    return program;
+}
+
+ofxAI::BTVM::BehaviorTreeVMImage::ProgramPtr ofxAI::BTVM::BehaviorTreeVMImage::load(
+    std::vector<uint8_t> const & image, BehaviorTreeVMRegistry const & registry) {
+    auto copy = std::make_shared<const std::vector<uint8_t>>(image);
+    return load(copy->data(), copy->size(), registry, copy);
+}
+
+ofxAI::BTVM::BehaviorTreeVMImage::ProgramPtr ofxAI::BTVM::BehaviorTreeVMImage::map(
+    std::string const & path, BehaviorTreeVMRegistry const & registry) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return ProgramPtr();
+    LARGE_INTEGER size;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &size) && (size.QuadPart > 0))
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        return ProgramPtr();
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view)
+        return ProgramPtr();
+    std::shared_ptr<const void> owner(view, [](const void* view) {
+        UnmapViewOfFile(view);
+    });
+    return load(view, (size_t)size.QuadPart, registry, owner);
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return ProgramPtr();
+    struct stat info;
+    void* view = MAP_FAILED;
+    if ((::fstat(file, &info) == 0) && (info.st_size > 0))
+        view = ::mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+    ::close(file);
+    if (view == MAP_FAILED)
+        return ProgramPtr();
+    size_t size = (size_t)info.st_size;
+    std::shared_ptr<const void> owner(view, [size](const void* view) {
+        ::munmap(const_cast<void*>(view), size);
+    });
+    return load(view, size, registry, owner);
+#endif
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "ofxBehaviourTreeVM.h"
+
+namespace ofxAI {
+    namespace BTVM {
+
+        /*
+         * Registry of the leaf and decorator functions saved programs
+         * refer to by name. Named Nodes compile to symbols that name
+         * their function; loading a program looks every one of them up
+         * here again.
+         */
+        class BehaviorTreeVMRegistry {
+        public:
+            // typed leaves with the schema their params are parsed by
+            struct ParamLeaf {
+                BehaviourTree::ParamSchema schema;
+                BehaviourTree::BaseNode::NodeParamTick tick;
+            };
+
+            void addLeaf(std::string const & name, BehaviourTree::BaseNode::NodeTick const & leaf);
+            void addLeaf(std::string const & name, BehaviourTree::ParamSchema const & schema,
+                         BehaviourTree::BaseNode::NodeParamTick const & leaf);
+            void addDecorator(std::string const & name, BehaviourTree::BaseNode::NodeDecorate const & decorator);
+
+            // nullptr if nothing was registered under the name
+            const BehaviourTree::BaseNode::NodeTick* findLeaf(std::string const & name) const;
+            const ParamLeaf* findParamLeaf(std::string const & name) const;
+            const BehaviourTree::BaseNode::NodeDecorate* findDecorator(std::string const & name) const;
+        protected:
+            std::map<std::string, BehaviourTree::BaseNode::NodeTick> m_leaves;
+            std::map<std::string, ParamLeaf> m_paramLeaves;
+            std::map<std::string, BehaviourTree::BaseNode::NodeDecorate> m_decorators;
+        };
+
+        /*
+         * Binary program images: a versioned header followed by the
+         * bytecode, thread table, strings, constants, symbols and source
+         * map, laid out so the bytecode can be run straight from the
+         * image.
+         * map() maps an image file read-only and runs the program from
+         * the mapping, so every VM sharing the program shares its pages;
+         * only the tables are decoded, and the symbols resolved against
+         * the registry. Images are written in the byte order of the
+         * machine writing them, and only load on machines that match.
+         *
+         * Programs using unnamed leaves or decorators cannot be saved.
+         * Loading returns nullptr on a malformed or mismatched image,
+         * when a symbol is not registered, or when the program does not
+         * pass the verifier.
+         */
+        class BehaviorTreeVMImage {
+        public:
+            using ProgramPtr = std::shared_ptr<const BehaviorTreeVMProgram>;
+
+            static const uint32_t Version = 2;
+
+            static bool save(BehaviorTreeVMProgram const & program, std::vector<uint8_t>& image);
+            static bool save(BehaviorTreeVMProgram const & program, std::string const & path);
+
+            // decodes an image in memory, running its bytecode in place;
+            // 'owner' keeps the memory alive for as long as the program
+            static ProgramPtr load(const void* image, size_t size, BehaviorTreeVMRegistry const & registry,
+                                   std::shared_ptr<const void> owner);
+            // copies the image, so the memory can go away after loading
+            static ProgramPtr load(std::vector<uint8_t> const & image, BehaviorTreeVMRegistry const & registry);
+            static ProgramPtr map(std::string const & path, BehaviorTreeVMRegistry const & registry);
+        };
+    }
+}
@@ -0,0 +1,391 @@
+#include "ofxBehaviourTreeVMOptimizer.h"
+#include "ofxBehaviourTreeVMVerifier.h"
+#include <limits>
+
+namespace {
+    using ofxAI::BTVM::BehaviorTreeVMProgram;
+    using ofxAI::BTVM::BehaviorTreeVMOptimizer;
+    using ofxAI::BTVM::BehaviorTreeVMVerifier;
+    using ofxAI::BTVM::Status;
+    using ops = BehaviorTreeVMProgram::ops;
+    using op_type = BehaviorTreeVMProgram::op_type;
+
+    const size_t NoTarget = size_t(-1);
+    const size_t MaxSize = 5;
+
+    struct Instruction {
+        op_type code[MaxSize];
+        size_t size;
+        size_t target;  // instruction the branch operand lands on
+        bool live;
+    };
+
+    // operand holding the branch offset, 0 if the instruction has none
+    size_t branchOperand(op_type opcode) {
+        switch (opcode) {
+        case ops::bra_f::opcode:
+        case ops::bra_t::opcode:
+        case ops::jmp::opcode:
+        case ops::call::opcode:
+            return 1;
+        case ops::rsm_thr::opcode:
+        case ops::run_bra_f::opcode:
+        case ops::run_bra_t::opcode:
+            return 2;
+        default:
+            return 0;
+        }
+    }
+
+    // the instruction never goes on to the next one
+    bool isTerminal(op_type opcode) {
+        return (opcode == ops::end::opcode) || (opcode == ops::set_i::opcode) || (opcode == ops::jmp::opcode) ||
+               (opcode == ops::ret::opcode);
+    }
+
+    // the current value set_t or set_f leave, Invalid for anything else
+    Status constantOf(op_type opcode) {
+        if (opcode == ops::set_t::opcode)
+            return Status::Success;
+        if (opcode == ops::set_f::opcode)
+            return Status::Failure;
+        return Status::Invalid;
+    }
+
+    // Works on the decoded instructions in place: removed instructions
+    // are only marked dead, and branches to them go on to the next live
+    // one, until encode() lays the live ones out again.
+    class Optimizer {
+    public:
+        Optimizer(BehaviorTreeVMProgram const & program, BehaviorTreeVMOptimizer::Report& report)
+            : m_program(program), m_report(report) {}
+
+        void decode() {
+            const op_type* code = m_program.code();
+            size_t size = m_program.codeSize();
+            m_index.assign(size, NoTarget);
+            for (size_t pc = 0; pc < size;) {
+                Instruction instruction;
+                instruction.size = BehaviorTreeVMVerifier::instructionSize(code[pc]);
+                std::copy(code + pc, code + pc + instruction.size, instruction.code);
+                instruction.target = NoTarget;
+                instruction.live = true;
+                m_index[pc] = m_code.size();
+                m_code.push_back(instruction);
+                pc += instruction.size;
+            }
+            // verified programs only branch to instruction starts
+            size_t pc = 0;
+            for (auto& instruction : m_code) {
+                if (size_t operand = branchOperand(instruction.code[0]))
+                    instruction.target = m_index[pc + instruction.code[operand]];
+                pc += instruction.size;
+            }
+            for (auto& thread : m_program.m_threadEntries)
+                m_starts.push_back(m_index[thread.start]);
+
+            m_report.instructionsBefore = m_code.size();
+            m_report.sizeBefore = size;
+        }
+
+        void optimize() {
+            bool changed;
+            do {
+                markTargets();
+                changed = fold();
+                changed = thread() || changed;
+                changed = removeDead() || changed;
+            } while (changed);
+            markTargets();
+            fuse();
+        }
+
+        bool encode(BehaviorTreeVMProgram& program) {
+            std::vector<size_t> pcs(m_code.size() + 1);
+            size_t pc = 0;
+            for (size_t i = 0; i < m_code.size(); i++) {
+                pcs[i] = pc;
+                if (m_code[i].live)
+                    pc += m_code[i].size;
+            }
+            pcs[m_code.size()] = pc;
+
+            std::vector<op_type>& code = program.m_program;
+            code.clear();
+            for (size_t i = 0; i < m_code.size(); i++) {
+                Instruction const & instruction = m_code[i];
+                if (!instruction.live)
+                    continue;
+                size_t start = code.size();
+                code.insert(code.end(), instruction.code, instruction.code + instruction.size);
+                if (size_t operand = branchOperand(instruction.code[0])) {
+                    long offset = (long)pcs[resolve(instruction.target)] - (long)pcs[i];
+                    if ((offset < std::numeric_limits<op_type>::min()) || (offset > std::numeric_limits<op_type>::max()))
+                        return false;
+                    code[start + operand] = (op_type)offset;
+                }
+            }
+            auto& threads = program.m_threadEntries;
+            for (size_t i = 0; i < threads.size(); i++)
+                threads[i].start = pcs[resolve(m_starts[i])];
+
+            // source locations move with their first instruction, and
+            // give way to later ones that end up at the same pc
+            std::vector<BehaviorTreeVMProgram::SourceLocation> sourceMap;
+            for (auto& location : program.m_sourceMap) {
+                if ((location.pc >= m_index.size()) || (m_index[location.pc] == NoTarget))
+                    continue;
+                size_t moved = pcs[resolve(m_index[location.pc])];
+                if (moved >= code.size())
+                    continue;
+                if (!sourceMap.empty() && (sourceMap.back().pc == moved))
+                    sourceMap.pop_back();
+                if (sourceMap.empty() || (sourceMap.back().ref != location.ref))
+                    sourceMap.push_back({ moved, location.ref });
+            }
+            program.m_sourceMap = std::move(sourceMap);
+
+            m_report.instructionsAfter = 0;
+            for (auto& instruction : m_code)
+                m_report.instructionsAfter += instruction.live ? 1 : 0;
+            m_report.sizeAfter = code.size();
+            return true;
+        }
+
+    protected:
+        // first live instruction after i, m_code.size() if there is none
+        size_t next(size_t i) const {
+            return resolve(i + 1);
+        }
+
+        // where control that reaches instruction i really goes
+        size_t resolve(size_t i) const {
+            while ((i < m_code.size()) && !m_code[i].live)
+                i++;
+            return i;
+        }
+
+        // instructions entered other than from the one before them
+        void markTargets() {
+            m_targeted.assign(m_code.size() + 1, false);
+            for (auto& instruction : m_code) {
+                if (instruction.live && (instruction.target != NoTarget))
+                    m_targeted[resolve(instruction.target)] = true;
+            }
+            for (size_t start : m_starts)
+                m_targeted[resolve(start)] = true;
+        }
+
+        void remove(size_t i) {
+            m_code[i].live = false;
+            // whatever branched here now lands on the next instruction
+            if (m_targeted[i])
+                m_targeted[next(i)] = true;
+        }
+
+        // folds instructions whose effect follows from the one before
+        // them; the second instruction must not be a branch target, as
+        // the first one has not run when it is branched to
+        bool fold() {
+            bool changed = false;
+            for (size_t i = resolve(0); i < m_code.size(); i = next(i)) {
+                Instruction& first = m_code[i];
+                size_t n = next(i);
+
+                // jumps and branches to the next instruction do nothing
+                if ((first.code[0] == ops::jmp::opcode) || (first.code[0] == ops::bra_f::opcode) ||
+                    (first.code[0] == ops::bra_t::opcode)) {
+                    if (resolve(first.target) == n) {
+                        remove(i);
+                        changed = true;
+                    }
+                    continue;
+                }
+
+                if ((n >= m_code.size()) || m_targeted[n])
+                    continue;
+                Instruction& second = m_code[n];
+                Status constant = constantOf(first.code[0]);
+
+                if ((first.code[0] == ops::neg::opcode) && (second.code[0] == ops::neg::opcode)) {
+                    remove(i);
+                    remove(n);
+                    m_report.folded++;
+                    changed = true;
+                }
+                else if ((constant != Status::Invalid) && (second.code[0] == ops::neg::opcode)) {
+                    first.code[0] = (constant == Status::Success) ? ops::set_f::opcode : ops::set_t::opcode;
+                    remove(n);
+                    m_report.folded++;
+                    changed = true;
+                }
+                else if ((constant != Status::Invalid) &&
+                         ((second.code[0] == ops::bra_f::opcode) || (second.code[0] == ops::bra_t::opcode))) {
+                    bool taken = (second.code[0] == ops::bra_f::opcode) == (constant == Status::Failure);
+                    if (taken)
+                        second.code[0] = ops::jmp::opcode;
+                    else
+                        remove(n);
+                    m_report.folded++;
+                    changed = true;
+                }
+            }
+            return changed;
+        }
+
+        // where a branch landing on instruction t goes on to, given the
+        // current value it lands with (Invalid if that is not known)
+        size_t land(size_t t, Status current) const {
+            for (size_t steps = 0; (steps < m_code.size()) && (t < m_code.size()); steps++) {
+                Instruction const & instruction = m_code[t];
+                op_type opcode = instruction.code[0];
+                if (opcode == ops::jmp::opcode) {
+                    t = resolve(instruction.target);
+                }
+                else if ((current != Status::Invalid) &&
+                         ((opcode == ops::bra_f::opcode) || (opcode == ops::bra_t::opcode))) {
+                    bool taken = (opcode == ops::bra_f::opcode) == (current == Status::Failure);
+                    t = taken ? resolve(instruction.target) : next(t);
+                }
+                else {
+                    break;
+                }
+            }
+            return t;
+        }
+
+        // points branches at where they end up, past the jumps and the
+        // branches with a known outcome they land on
+        bool thread() {
+            bool changed = false;
+            size_t previous = NoTarget;
+            for (size_t i = resolve(0); i < m_code.size(); previous = i, i = next(i)) {
+                Instruction& instruction = m_code[i];
+                if (instruction.target == NoTarget)
+                    continue;
+
+                // the value the branch is taken with
+                Status current = Status::Invalid;
+                switch (instruction.code[0]) {
+                case ops::bra_f::opcode:
+                case ops::run_bra_f::opcode:
+                    current = Status::Failure;
+                    break;
+                case ops::bra_t::opcode:
+                case ops::run_bra_t::opcode:
+                    current = Status::Success;
+                    break;
+                case ops::jmp::opcode:
+                    if ((previous != NoTarget) && !m_targeted[i])
+                        current = constantOf(m_code[previous].code[0]);
+                    break;
+                default:
+                    break;
+                }
+
+                size_t target = resolve(instruction.target);
+                size_t landing = land(target, current);
+                if (landing != target) {
+                    instruction.target = landing;
+                    m_targeted[landing] = true;
+                    m_report.branchesThreaded++;
+                    changed = true;
+                }
+
+                // a jump to the end of a thread, or of shared code, ends
+                // it right away
+                if ((instruction.code[0] == ops::jmp::opcode) && (landing < m_code.size())) {
+                    op_type opcode = m_code[landing].code[0];
+                    if ((opcode == ops::end::opcode) || (opcode == ops::set_i::opcode) || (opcode == ops::ret::opcode)) {
+                        instruction.code[0] = opcode;
+                        instruction.size = 1;
+                        instruction.target = NoTarget;
+                        m_report.branchesThreaded++;
+                        changed = true;
+                    }
+                }
+            }
+            return changed;
+        }
+
+        // removes every instruction no thread entry reaches
+        bool removeDead() {
+            std::vector<bool> reached(m_code.size(), false);
+            std::vector<size_t> pending;
+            for (size_t start : m_starts)
+                pending.push_back(resolve(start));
+            while (!pending.empty()) {
+                size_t i = pending.back();
+                pending.pop_back();
+                if ((i >= m_code.size()) || reached[i])
+                    continue;
+                reached[i] = true;
+                Instruction const & instruction = m_code[i];
+                if (!isTerminal(instruction.code[0]))
+                    pending.push_back(next(i));
+                if (instruction.target != NoTarget)
+                    pending.push_back(resolve(instruction.target));
+            }
+
+            bool changed = false;
+            for (size_t i = 0; i < m_code.size(); i++) {
+                if (m_code[i].live && !reached[i]) {
+                    m_code[i].live = false;
+                    m_report.deadInstructions++;
+                    changed = true;
+                }
+            }
+            return changed;
+        }
+
+        // fuses leaves followed by a branch into run_bra_f/run_bra_t
+        void fuse() {
+            for (size_t i = resolve(0); i < m_code.size(); i = next(i)) {
+                Instruction& first = m_code[i];
+                size_t n = next(i);
+                if ((first.code[0] != ops::run::opcode) || (n >= m_code.size()) || m_targeted[n])
+                    continue;
+                Instruction& second = m_code[n];
+                if ((second.code[0] != ops::bra_f::opcode) && (second.code[0] != ops::bra_t::opcode))
+                    continue;
+                first.code[0] = (second.code[0] == ops::bra_f::opcode) ? ops::run_bra_f::opcode : ops::run_bra_t::opcode;
+                first.size = 3;
+                first.target = second.target;
+                remove(n);
+                m_report.superinstructions++;
+            }
+        }
+
+        BehaviorTreeVMProgram const & m_program;
+        BehaviorTreeVMOptimizer::Report& m_report;
+        std::vector<Instruction> m_code;
+        std::vector<size_t> m_index;    // instruction starting at each pc of the original code
+        std::vector<size_t> m_starts;   // first instruction of every thread
+        std::vector<bool> m_targeted;
+    };
+}
+
+ofxAI::BTVM::BehaviorTreeVMOptimizer::ProgramPtr ofxAI::BTVM::BehaviorTreeVMOptimizer::optimize(BehaviorTreeVMProgram const & program,
+                                                                                    Report* report) {
+    if (!program.m_verified)
+        return nullptr;
+    Report local;
+    Report& result = report ? *report : local;
+    result = Report();
+
+    Optimizer optimizer(program, result);
+    optimizer.decode();
+    optimizer.optimize();
+
+    // the optimized program keeps the tables and owns its code
+    auto optimized = std::make_shared<BehaviorTreeVMProgram>(program);
+    optimized->m_image.reset();
+    optimized->m_code = nullptr;
+    optimized->m_codeSize = 0;
+    optimized->m_native = nullptr;
+    if (!optimizer.encode(*optimized))
+        return nullptr;
+    if (!optimized->link())
+        return nullptr;
+    return optimized;
+}
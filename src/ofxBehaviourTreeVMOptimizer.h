@@ -0,0 +1,45 @@
+#pragma once
+#include "ofxBehaviourTreeVM.h"
+
+namespace ofxAI {
+    namespace BTVM {
+
+        /*
+         * Peephole optimizer for VM programs. The compiler lowers every
+         * node on its own, which leaves patterns such as a set_t right
+         * before a bra_f, a neg of a constant, or branches to the branch
+         * of an enclosing composite. The optimizer folds branches whose
+         * outcome is known from the instruction before them, threads
+         * branches and jumps through the jumps and branches they land on,
+         * drops jumps to the next instruction and code nothing reaches,
+         * and fuses a leaf followed by a branch into run_bra_f/run_bra_t.
+         *
+         * Instructions only fold into their predecessor when nothing
+         * branches to them, and thread entries move with the code, so the
+         * optimized program ticks the same results as the original. The
+         * source map moves with the code too. The tables are kept as
+         * they are; leaves, decorators and threads that only dead code
+         * used stay in them.
+         *
+         * Returns nullptr if the program is not linked, or if the result
+         * does not link.
+         */
+        class BehaviorTreeVMOptimizer {
+        public:
+            using ProgramPtr = std::shared_ptr<const BehaviorTreeVMProgram>;
+
+            struct Report {
+                size_t instructionsBefore = 0;
+                size_t instructionsAfter = 0;
+                size_t sizeBefore = 0;      // in op_type words
+                size_t sizeAfter = 0;
+                size_t folded = 0;          // instructions decided by the one before them
+                size_t branchesThreaded = 0;
+                size_t deadInstructions = 0;
+                size_t superinstructions = 0;
+            };
+
+            static ProgramPtr optimize(BehaviorTreeVMProgram const & program, Report* report = nullptr);
+        };
+    }
+}
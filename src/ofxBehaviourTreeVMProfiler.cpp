@@ -0,0 +1,108 @@
+#include "ofxBehaviourTreeVMProfiler.h"
+#include "ofxBehaviourTreeVMDisassembler.h"
+#include <cstdio>
+#include <numeric>
+
+namespace {
+    using ofxAI::BTVM::BehaviorTreeVMProgram;
+    using ofxAI::BTVM::BehaviorTreeVMProfiler;
+    using ofxAI::BTVM::BehaviorTreeVMDisassembler;
+
+    double milliseconds(BehaviorTreeVMProfiler::Clock::duration time) {
+        return std::chrono::duration<double, std::milli>(time).count();
+    }
+
+    double microseconds(BehaviorTreeVMProfiler::Clock::duration time) {
+        return std::chrono::duration<double, std::micro>(time).count();
+    }
+
+    double percent(uint64_t part, uint64_t total) {
+        return total ? 100.0 * part / total : 0.0;
+    }
+
+    // indices of the non-zero entries, largest first
+    template <typename T, typename Key>
+    std::vector<size_t> ranked(std::vector<T> const & entries, Key key) {
+        std::vector<size_t> order;
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (key(entries[i]) != 0)
+                order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return key(entries[a]) > key(entries[b]);
+        });
+        return order;
+    }
+}
+
+ofxAI::BTVM::BehaviorTreeVMProfiler::BehaviorTreeVMProfiler(ProgramPtr program)
+    : m_program(program) {
+    reset();
+}
+
+void ofxAI::BTVM::BehaviorTreeVMProfiler::reset() {
+    m_opcodeCounts.assign(BehaviorTreeVMProgram::OpcodeCount, 0);
+    m_pcCounts.assign(m_program ? m_program->codeSize() : 0, 0);
+    m_leafCalls.assign(m_program ? m_program->m_leaves.size() : 0, Calls());
+    m_decoratorCalls.assign(m_program ? m_program->m_decoratorNodes.size() : 0, Calls());
+}
+
+uint64_t ofxAI::BTVM::BehaviorTreeVMProfiler::getInstructions() const {
+    return std::accumulate(m_opcodeCounts.begin(), m_opcodeCounts.end(), uint64_t(0));
+}
+
+std::string ofxAI::BTVM::BehaviorTreeVMProfiler::describe(std::vector<BehaviorTreeVMProgram::Symbol> const & symbols,
+                                                          size_t index, const char* kind) const {
+    if (index < symbols.size()) {
+        if (!symbols[index].ref.empty())
+            return symbols[index].ref;
+        if (!symbols[index].name.empty())
+            return symbols[index].name;
+    }
+    return std::string(kind) + " " + std::to_string(index);
+}
+
+void ofxAI::BTVM::BehaviorTreeVMProfiler::report(std::ostream& out, size_t hotPcs) const {
+    if (!m_program)
+        return;
+    char line[256];
+    uint64_t instructions = getInstructions();
+    out << "instructions: " << instructions << "\n\n";
+
+    std::snprintf(line, sizeof(line), "%-12s %14s %7s\n", "opcode", "count", "%");
+    out << line;
+    for (size_t opcode : ranked(m_opcodeCounts, [](uint64_t count) { return count; })) {
+        const char* name = BehaviorTreeVMProgram::mnemonic((BehaviorTreeVMProgram::op_type)opcode);
+        std::snprintf(line, sizeof(line), "%-12s %14llu %7.2f\n", name ? name : "?",
+                      (unsigned long long)m_opcodeCounts[opcode], percent(m_opcodeCounts[opcode], instructions));
+        out << line;
+    }
+
+    auto calls = [&](const char* kind, std::vector<Calls> const & entries,
+                     std::vector<BehaviorTreeVMProgram::Symbol> const & symbols) {
+        if (entries.empty())
+            return;
+        std::snprintf(line, sizeof(line), "\n%-32s %10s %12s %10s %10s\n", kind, "calls", "total ms", "avg us", "max us");
+        out << line;
+        for (size_t i : ranked(entries, [](Calls const & entry) { return entry.total.count(); })) {
+            Calls const & entry = entries[i];
+            std::snprintf(line, sizeof(line), "%-32s %10llu %12.3f %10.3f %10.3f\n", describe(symbols, i, kind).c_str(),
+                          (unsigned long long)entry.count, milliseconds(entry.total),
+                          microseconds(entry.total) / entry.count, microseconds(entry.max));
+            out << line;
+        }
+    };
+    calls("leaf", m_leafCalls, m_program->m_leafSymbols);
+    calls("decorator", m_decoratorCalls, m_program->m_decoratorSymbols);
+
+    std::snprintf(line, sizeof(line), "\n%6s %14s %7s  %-24s %s\n", "pc", "count", "%", "node", "instruction");
+    out << line;
+    std::vector<size_t> pcs = ranked(m_pcCounts, [](uint64_t count) { return count; });
+    if (pcs.size() > hotPcs)
+        pcs.resize(hotPcs);
+    for (size_t pc : pcs) {
+        std::snprintf(line, sizeof(line), "%6zu %14llu %7.2f  %-24s ", pc, (unsigned long long)m_pcCounts[pc],
+                      percent(m_pcCounts[pc], instructions), m_program->sourceRef(pc).c_str());
+        out << line << BehaviorTreeVMDisassembler::instruction(*m_program, pc) << "\n";
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "ofxBehaviourTreeVM.h"
+#include <chrono>
+#include <ostream>
+
+namespace ofxAI {
+    namespace BTVM {
+
+        /*
+         * Profile of the VMs running one program. In builds with
+         * BTVM_PROFILE defined to 1, a VM given a profiler through
+         * setProfiler() counts every instruction it executes, by opcode
+         * and by pc, and times every leaf and decorator call with the
+         * steady clock. Decorator times include the children they run.
+         * Without BTVM_PROFILE the VM has no hooks at all, and profilers
+         * stay empty. The branches a BehaviorTreeVMBatch runs in lockstep
+         * are not counted.
+         *
+         * report() prints a flat profile of opcodes, leaves and
+         * decorators, followed by the hottest pcs. Each leaf and
+         * decorator is named by the ref of the node it was compiled from,
+         * or by its name when it has no ref; hot pcs are disassembled and
+         * named by their source map ref. Profilers are not thread
+         * safe; VMs sharing one have to run on the same thread.
+         */
+        class BehaviorTreeVMProfiler {
+        public:
+            using ProgramPtr = std::shared_ptr<const BehaviorTreeVMProgram>;
+            using Clock = std::chrono::steady_clock;
+
+            struct Calls {
+                uint64_t count = 0;
+                Clock::duration total = Clock::duration::zero();
+                Clock::duration max = Clock::duration::zero();
+            };
+
+            BehaviorTreeVMProfiler(ProgramPtr program);
+
+            void reset();
+            ProgramPtr getProgram() const { return m_program; }
+
+            uint64_t getInstructions() const;
+            std::vector<uint64_t> const & getOpcodeCounts() const { return m_opcodeCounts; }
+            std::vector<uint64_t> const & getPcCounts() const { return m_pcCounts; }
+            std::vector<Calls> const & getLeafCalls() const { return m_leafCalls; }
+            std::vector<Calls> const & getDecoratorCalls() const { return m_decoratorCalls; }
+
+            // flat profile plus the 'hotPcs' most executed pcs
+            void report(std::ostream& out, size_t hotPcs = 20) const;
+
+            // hooks run by the VM
+            void countInstruction(size_t pc, BehaviorTreeVMProgram::op_type opcode) {
+                m_pcCounts[pc]++;
+                m_opcodeCounts[opcode]++;
+            }
+            Status runLeaf(size_t leaf, BehaviorTreeVMThread* thread, DictBlackboard* blackboard) {
+                Clock::time_point start = Clock::now();
+                Status status = m_program->m_leaves[leaf](thread, blackboard);
+                record(m_leafCalls[leaf], Clock::now() - start);
+                return status;
+            }
+            Status runDecorator(size_t decorator, BehaviorTreeVMThread* thread, DictBlackboard* blackboard) {
+                Clock::time_point start = Clock::now();
+                Status status = m_program->m_decoratorNodes[decorator](thread, blackboard);
+                record(m_decoratorCalls[decorator], Clock::now() - start);
+                return status;
+            }
+        protected:
+            static void record(Calls& calls, Clock::duration time) {
+                calls.count++;
+                calls.total += time;
+                calls.max = std::max(calls.max, time);
+            }
+            // ref or name of a leaf or decorator, for reports
+            std::string describe(std::vector<BehaviorTreeVMProgram::Symbol> const & symbols, size_t index,
+                                 const char* kind) const;
+
+            ProgramPtr m_program;
+            std::vector<uint64_t> m_opcodeCounts;
+            std::vector<uint64_t> m_pcCounts;
+            std::vector<Calls> m_leafCalls;
+            std::vector<Calls> m_decoratorCalls;
+        };
+    }
+}
@@ -0,0 +1,59 @@
+#include "ofxBehaviourTreeVMScheduler.h"
+
+namespace {
+    // shortest time slice worth giving a VM; shorter ones would be spent
+    // reading the clock
+    const std::chrono::microseconds MinimumSlice(1);
+}
+
+void ofxAI::BTVM::BehaviorTreeVMScheduler::add(BehaviorTreeVM* vm) {
+    if (vm && (std::find(m_vms.begin(), m_vms.end(), vm) == m_vms.end()))
+        m_vms.push_back(vm);
+}
+
+void ofxAI::BTVM::BehaviorTreeVMScheduler::remove(BehaviorTreeVM* vm) {
+    auto found = std::find(m_vms.begin(), m_vms.end(), vm);
+    if (found == m_vms.end())
+        return;
+    size_t index = found - m_vms.begin();
+    m_vms.erase(found);
+    if (index < m_next)
+        m_next--;
+    if (m_next >= m_vms.size())
+        m_next = 0;
+}
+
+size_t ofxAI::BTVM::BehaviorTreeVMScheduler::run(Clock::duration budget) {
+    return run(BehaviorTreeVM::Unlimited, Clock::now() + budget);
+}
+
+size_t ofxAI::BTVM::BehaviorTreeVMScheduler::run(size_t instructions) {
+    return run(instructions, Clock::time_point::max());
+}
+
+size_t ofxAI::BTVM::BehaviorTreeVMScheduler::run(size_t instructions, Clock::time_point deadline) {
+    m_wakeups.drain();
+    bool timed = deadline != Clock::time_point::max();
+    size_t count = m_vms.size(), finished = 0, ran = 0;
+    for (; ran < count; ran++) {
+        Clock::time_point now = timed ? Clock::now() : Clock::time_point();
+        if (!instructions || (timed && (now >= deadline)))
+            break;
+        // an even share of what is left, rounded up so every VM gets some
+        size_t left = count - ran;
+        size_t share = (instructions == BehaviorTreeVM::Unlimited) ? instructions : (instructions + left - 1) / left;
+        auto& vm = *m_vms[(m_next + ran) % count];
+        if (timed) {
+            Clock::duration slice = std::max<Clock::duration>((deadline - now) / Clock::rep(left), MinimumSlice);
+            vm.run(share, std::min(deadline, now + slice));
+        } else
+            vm.run(share, deadline);
+        if (instructions != BehaviorTreeVM::Unlimited)
+            instructions -= std::min(instructions, vm.getInstructionsRun());
+        if (!vm.preempted())
+            finished++;
+    }
+    if (count)
+        m_next = (m_next + ran) % count;
+    return finished;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "ofxBehaviourTreeVMWakeQueue.h"
+
+namespace ofxAI {
+    namespace BTVM {
+
+        /*
+         * Spreads a fixed AI budget per frame over many VMs. Each frame
+         * runs the VMs in turn, starting with the first one the previous
+         * frame did not get to, and gives each an even share of what is
+         * left of the budget; whatever a VM does not use goes to the ones
+         * after it. VMs whose tick was cut short carry on with it the
+         * next frame, so a frame never runs over budget by more than one
+         * leaf, decorator or parallel, however expensive the programs
+         * are. Time slices are never shorter than a microsecond, so a
+         * budget too small for every VM is spread over several frames.
+         *
+         * Other threads wake parked threads of the scheduler's VMs
+         * through its wake queue, which every frame drains first, so the
+         * simulation thread never waits on them.
+         *
+         * The scheduler does not own its VMs.
+         */
+        class BehaviorTreeVMScheduler {
+        public:
+            using Clock = BehaviorTreeVM::Clock;
+
+            explicit BehaviorTreeVMScheduler(size_t wakeCapacity = BehaviorTreeVMWakeQueue::DefaultCapacity)
+                : m_wakeups(wakeCapacity) {}
+
+            void add(BehaviorTreeVM* vm);
+            void remove(BehaviorTreeVM* vm);
+            size_t size() const { return m_vms.size(); }
+            // safe to push to from any thread
+            BehaviorTreeVMWakeQueue& getWakeQueue() { return m_wakeups; }
+
+            // run one frame, returning the number of VMs that finished
+            // their tick
+            size_t run(Clock::duration budget);
+            size_t run(size_t instructions);
+        protected:
+            size_t run(size_t instructions, Clock::time_point deadline);
+
+            std::vector<BehaviorTreeVM*> m_vms;
+            size_t m_next = 0;  // first VM to run next frame
+            BehaviorTreeVMWakeQueue m_wakeups;
+        };
+    }
+}
@@ -0,0 +1,435 @@
+#include "ofxBehaviourTreeVMSnapshot.h"
+#include <cstring>
+
+namespace {
+    using ofxAI::BTVM::BehaviorTreeVM;
+    using ofxAI::BTVM::BehaviorTreeVMSnapshot;
+    using ofxAI::BTVM::BehaviorTreeVMThread;
+    using ofxAI::BehaviourTree::Value;
+
+    const uint32_t Magic = 0x53565442;       // "BTVS"
+    const uint32_t DeltaMagic = 0x44565442;  // "BTVD"
+    const uint32_t NoIndex = uint32_t(-1);
+
+    // equal bytes a delta run has to skip before it is worth ending it
+    const size_t DeltaGap = 8;
+
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t preempted;
+        uint32_t size;
+        uint32_t codeSize;  // of the program, to catch snapshots of other programs
+        uint32_t threads;   // ThreadRecord
+        uint32_t ready;     // uint32_t thread
+        uint32_t next;      // uint32_t thread
+        uint32_t waiters;   // WaiterRecord
+        uint32_t slots;     // SlotRecord, each followed by its text
+        uint32_t tick;
+        uint32_t resume;
+    };
+
+    struct ThreadRecord {
+        int32_t pc;
+        uint32_t start;
+        uint32_t current;
+        uint32_t tick;
+        uint32_t parent;
+        uint32_t saved;
+        uint32_t callDepth;
+        int32_t returns[BehaviorTreeVMThread::MaxCallDepth];  // unused ones are 0
+    };
+
+    struct WaiterRecord {
+        uint32_t fact;
+        uint32_t thread;
+    };
+
+    // like the image's value records, but String values keep their
+    // length in the first word and their text right after the record
+    struct SlotRecord {
+        uint32_t type;
+        uint32_t words[3];
+    };
+
+    struct DeltaHeader {
+        uint32_t magic;
+        uint32_t baseSize;
+        uint32_t size;
+    };
+
+    size_t textSize(size_t length) {
+        return (length + 3) & ~size_t(3);
+    }
+
+    class Writer {
+    public:
+        Writer(uint8_t* buffer, size_t capacity) : m_begin(buffer), m_at(buffer), m_end(buffer + capacity) {}
+
+        void bytes(const void* data, size_t size, size_t padded) {
+            if (!m_ok || (padded > size_t(m_end - m_at))) {
+                m_ok = false;
+                return;
+            }
+            std::memcpy(m_at, data, size);
+            std::memset(m_at + size, 0, padded - size);
+            m_at += padded;
+        }
+
+        template <typename T>
+        void put(T const & record) {
+            bytes(&record, sizeof(record), sizeof(record));
+        }
+
+        bool ok() const { return m_ok; }
+        size_t size() const { return m_at - m_begin; }
+    protected:
+        uint8_t* m_begin;
+        uint8_t* m_at;
+        uint8_t* m_end;
+        bool m_ok = true;
+    };
+
+    class Reader {
+    public:
+        Reader(const uint8_t* buffer, size_t size) : m_at(buffer), m_end(buffer + size) {}
+
+        const uint8_t* bytes(size_t size) {
+            if (!m_ok || (size > size_t(m_end - m_at))) {
+                m_ok = false;
+                return nullptr;
+            }
+            const uint8_t* data = m_at;
+            m_at += size;
+            return data;
+        }
+
+        template <typename T>
+        bool get(T& record) {
+            const uint8_t* data = bytes(sizeof(record));
+            if (data)
+                std::memcpy(&record, data, sizeof(record));
+            return data != nullptr;
+        }
+
+        bool ok() const { return m_ok; }
+        bool done() const { return m_ok && (m_at == m_end); }
+    protected:
+        const uint8_t* m_at;
+        const uint8_t* m_end;
+        bool m_ok = true;
+    };
+
+    SlotRecord slotRecord(Value const & value) {
+        SlotRecord record = {};
+        record.type = (uint32_t)value.type();
+        switch (value.type()) {
+        case Value::Type::Bool: {
+            bool data = false;
+            value.get(data);
+            record.words[0] = data ? 1 : 0;
+            break;
+        }
+        case Value::Type::Int: {
+            int data = 0;
+            value.get(data);
+            std::memcpy(record.words, &data, sizeof(data));
+            break;
+        }
+        case Value::Type::Float: {
+            float data = 0;
+            value.get(data);
+            std::memcpy(record.words, &data, sizeof(data));
+            break;
+        }
+        case Value::Type::Vector: {
+            Value::Vector data = {};
+            value.get(data);
+            std::memcpy(record.words, &data, sizeof(data));
+            break;
+        }
+        case Value::Type::Handle: {
+            Value::Handle data = {};
+            value.get(data);
+            std::memcpy(record.words, &data.id, sizeof(data.id));
+            break;
+        }
+        case Value::Type::String:
+            record.words[0] = (uint32_t)value.text().size();
+            break;
+        default:
+            break;
+        }
+        return record;
+    }
+
+    // sets 'slot' from its record, reusing the slot's string storage
+    bool readSlot(Reader& reader, Value& slot) {
+        SlotRecord record;
+        if (!reader.get(record))
+            return false;
+        switch ((Value::Type)record.type) {
+        case Value::Type::Empty:
+            slot = Value();
+            return true;
+        case Value::Type::Bool:
+            slot = Value(record.words[0] != 0);
+            return true;
+        case Value::Type::Int: {
+            int data;
+            std::memcpy(&data, record.words, sizeof(data));
+            slot = Value(data);
+            return true;
+        }
+        case Value::Type::Float: {
+            float data;
+            std::memcpy(&data, record.words, sizeof(data));
+            slot = Value(data);
+            return true;
+        }
+        case Value::Type::Vector: {
+            Value::Vector data;
+            std::memcpy(&data, record.words, sizeof(data));
+            slot = Value(data);
+            return true;
+        }
+        case Value::Type::Handle: {
+            Value::Handle data;
+            std::memcpy(&data.id, record.words, sizeof(data.id));
+            slot = Value(data);
+            return true;
+        }
+        case Value::Type::String: {
+            const uint8_t* text = reader.bytes(textSize(record.words[0]));
+            if (!text)
+                return false;
+            slot.assignText(reinterpret_cast<const char*>(text), record.words[0]);
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // deltas are runs of changed bytes, each as varints of the bytes
+    // skipped before it and of its length, followed by its bytes
+    void putCount(Writer& writer, size_t count) {
+        do {
+            uint8_t byte = count & 0x7f;
+            count >>= 7;
+            if (count)
+                byte |= 0x80;
+            writer.put(byte);
+        } while (count);
+    }
+
+    bool getCount(Reader& reader, size_t& count) {
+        count = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!reader.get(byte))
+                return false;
+            count |= size_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+}
+
+size_t ofxAI::BTVM::BehaviorTreeVMSnapshot::size(BehaviorTreeVM const & vm) {
+    size_t size = sizeof(Header) + vm.m_threads.size() * sizeof(ThreadRecord) +
+        (vm.m_ready.size() + vm.m_next.size()) * sizeof(uint32_t) +
+        vm.m_factWaiters.size() * sizeof(WaiterRecord) +
+        vm.blackboard.m_slots.size() * sizeof(SlotRecord);
+    for (auto& slot : vm.blackboard.m_slots)
+        size += textSize(slot.text().size());
+    return size;
+}
+
+size_t ofxAI::BTVM::BehaviorTreeVMSnapshot::save(BehaviorTreeVM const & vm, uint8_t* buffer, size_t capacity) {
+    if (vm.m_active != BehaviorTreeVM::NoThread)
+        return 0;
+    auto& slots = vm.blackboard.m_slots;
+    Writer writer(buffer, capacity);
+    Header header = {};
+    header.magic = Magic;
+    header.version = Version;
+    header.size = (uint32_t)size(vm);
+    header.codeSize = vm.m_program ? (uint32_t)vm.m_program->codeSize() : 0;
+    header.threads = (uint32_t)vm.m_threads.size();
+    header.ready = (uint32_t)vm.m_ready.size();
+    header.next = (uint32_t)vm.m_next.size();
+    header.waiters = (uint32_t)vm.m_factWaiters.size();
+    header.slots = (uint32_t)slots.size();
+    header.tick = vm.m_tick;
+    header.preempted = vm.m_preempted ? 1 : 0;
+    header.resume = vm.m_resume == BehaviorTreeVM::NoThread ? NoIndex : (uint32_t)vm.m_resume;
+    writer.put(header);
+
+    for (auto& thread : vm.m_threads) {
+        ThreadRecord record{ (int32_t)thread.m_pc, (uint32_t)thread.m_threadStart, (uint32_t)thread.m_current,
+                             thread.m_tick,
+                             thread.m_parent == BehaviorTreeVM::NoThread ? NoIndex : (uint32_t)thread.m_parent,
+                             (uint32_t)thread.m_saved, thread.m_callDepth, {} };
+        std::memcpy(record.returns, thread.m_returns, thread.m_callDepth * sizeof(int32_t));
+        writer.put(record);
+    }
+    for (size_t thread : vm.m_ready)
+        writer.put((uint32_t)thread);
+    for (size_t thread : vm.m_next)
+        writer.put((uint32_t)thread);
+    for (auto& waiter : vm.m_factWaiters)
+        writer.put(WaiterRecord{ (uint32_t)waiter.first, (uint32_t)waiter.second });
+    for (auto& slot : slots) {
+        writer.put(slotRecord(slot));
+        if (slot.type() == Value::Type::String)
+            writer.bytes(slot.text().data(), slot.text().size(), textSize(slot.text().size()));
+    }
+    return writer.ok() ? header.size : 0;
+}
+
+bool ofxAI::BTVM::BehaviorTreeVMSnapshot::restore(BehaviorTreeVM& vm, const uint8_t* snapshot, size_t size) {
+    if (vm.m_active != BehaviorTreeVM::NoThread)
+        return false;
+    Reader reader(snapshot, size);
+    Header header;
+    if (!reader.get(header) || (header.magic != Magic) || (header.version != Version) || (header.size != size))
+        return false;
+    if (!vm.m_program || (header.codeSize != vm.m_program->codeSize()) || (header.threads != vm.m_threads.size()) ||
+        ((header.resume != NoIndex) && (header.resume >= header.threads)))
+        return false;
+
+    // check everything before touching the VM
+    size_t threads = header.threads;
+    const uint8_t* threadRecords = reader.bytes(threads * sizeof(ThreadRecord));
+    const uint8_t* queues = reader.bytes((size_t(header.ready) + header.next) * sizeof(uint32_t));
+    const uint8_t* waiters = reader.bytes(size_t(header.waiters) * sizeof(WaiterRecord));
+    if (!reader.ok())
+        return false;
+    // every pc the threads would go on from has to be an instruction
+    auto& starts = vm.m_program->m_instructionStarts;
+    auto instruction = [&](int32_t pc) { return (pc >= 0) && ((size_t)pc < starts.size()) && starts[pc]; };
+    for (size_t i = 0; i < threads; i++) {
+        ThreadRecord record;
+        std::memcpy(&record, threadRecords + i * sizeof(record), sizeof(record));
+        if (!instruction(record.pc) || (record.start != vm.m_program->m_threadEntries[i].start) ||
+            (record.current > (uint32_t)Status::Suspended) || (record.saved > (uint32_t)Status::Suspended) ||
+            ((record.parent != NoIndex) && (record.parent >= threads)) ||
+            (record.callDepth > BehaviorTreeVMThread::MaxCallDepth))
+            return false;
+        for (size_t j = 0; j < record.callDepth; j++) {
+            if (!instruction(record.returns[j]))
+                return false;
+        }
+    }
+    for (size_t i = 0; i < size_t(header.ready) + header.next; i++) {
+        uint32_t thread;
+        std::memcpy(&thread, queues + i * sizeof(thread), sizeof(thread));
+        if (thread >= threads)
+            return false;
+    }
+    for (size_t i = 0; i < header.waiters; i++) {
+        WaiterRecord record;
+        std::memcpy(&record, waiters + i * sizeof(record), sizeof(record));
+        if (record.thread >= threads)
+            return false;
+    }
+    Reader slotReader = reader;
+    Value scratch;
+    for (size_t i = 0; i < header.slots; i++) {
+        if (!readSlot(slotReader, scratch))
+            return false;
+    }
+    if (!slotReader.done())
+        return false;
+
+    for (size_t i = 0; i < threads; i++) {
+        ThreadRecord record;
+        std::memcpy(&record, threadRecords + i * sizeof(record), sizeof(record));
+        auto& thread = vm.m_threads[i];
+        thread.m_pc = record.pc;
+        thread.m_threadStart = record.start;
+        thread.m_current = (Status)record.current;
+        thread.m_tick = record.tick;
+        thread.m_parent = (record.parent == NoIndex) ? BehaviorTreeVM::NoThread : record.parent;
+        thread.m_saved = (Status)record.saved;
+        thread.m_callDepth = record.callDepth;
+        std::memcpy(thread.m_returns, record.returns, sizeof(record.returns));
+    }
+    vm.m_ready.clear();
+    vm.m_next.clear();
+    for (size_t i = 0; i < size_t(header.ready) + header.next; i++) {
+        uint32_t thread;
+        std::memcpy(&thread, queues + i * sizeof(thread), sizeof(thread));
+        (i < header.ready ? vm.m_ready : vm.m_next).push_back(thread);
+    }
+    vm.m_factWaiters.clear();
+    for (size_t i = 0; i < header.waiters; i++) {
+        WaiterRecord record;
+        std::memcpy(&record, waiters + i * sizeof(record), sizeof(record));
+        vm.m_factWaiters.emplace(record.fact, record.thread);
+    }
+    vm.m_tick = header.tick;
+    vm.m_preempted = header.preempted != 0;
+    vm.m_resume = (header.resume == NoIndex) ? BehaviorTreeVM::NoThread : header.resume;
+
+    // slots are set directly, so restoring wakes no one up
+    auto& slots = vm.blackboard.m_slots;
+    if (slots.size() < header.slots)
+        vm.blackboard.reserve(header.slots);
+    for (size_t i = 0; i < header.slots; i++)
+        readSlot(reader, slots[i]);
+    for (size_t i = header.slots; i < slots.size(); i++)
+        slots[i] = Value();
+    return true;
+}
+
+size_t ofxAI::BTVM::BehaviorTreeVMSnapshot::diff(const uint8_t* base, size_t baseSize, const uint8_t* snapshot, size_t size,
+                                                 uint8_t* delta, size_t capacity) {
+    Writer writer(delta, capacity);
+    writer.put(DeltaHeader{ DeltaMagic, (uint32_t)baseSize, (uint32_t)size });
+    auto same = [&](size_t at) { return (at < baseSize) && (base[at] == snapshot[at]); };
+    size_t done = 0;
+    for (size_t at = 0; at < size;) {
+        if (same(at)) {
+            at++;
+            continue;
+        }
+        // the run ends at the first stretch of DeltaGap unchanged bytes
+        size_t end = at, unchanged = 0;
+        while ((end < size) && (unchanged < DeltaGap)) {
+            unchanged = same(end) ? unchanged + 1 : 0;
+            end++;
+        }
+        end -= unchanged;
+        putCount(writer, at - done);
+        putCount(writer, end - at);
+        writer.bytes(snapshot + at, end - at, end - at);
+        done = at = end;
+    }
+    return writer.ok() ? writer.size() : 0;
+}
+
+size_t ofxAI::BTVM::BehaviorTreeVMSnapshot::patch(uint8_t* base, size_t baseSize, size_t capacity,
+                                                  const uint8_t* delta, size_t deltaSize) {
+    Reader reader(delta, deltaSize);
+    DeltaHeader header;
+    if (!reader.get(header) || (header.magic != DeltaMagic) || (header.baseSize != baseSize) || (header.size > capacity))
+        return 0;
+    size_t at = 0;
+    while (!reader.done()) {
+        size_t skip, length;
+        if (!getCount(reader, skip) || !getCount(reader, length))
+            return 0;
+        if ((skip > header.size - at) || (length > header.size - at - skip))
+            return 0;
+        at += skip;
+        const uint8_t* bytes = reader.bytes(length);
+        if (!bytes)
+            return 0;
+        std::memcpy(base + at, bytes, length);
+        at += length;
+    }
+    return header.size;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "ofxBehaviourTreeVM.h"
+
+namespace ofxAI {
+    namespace BTVM {
+
+        /*
+         * Snapshots of a VM's running state, for rollback and save games.
+         * A snapshot holds every thread's pc, start, current value, tick,
+         * parent and return stack, where a preempted tick stopped, the
+         * ready queues, the threads parked on facts and the blackboard
+         * slots. It is written to and read from buffers the caller owns,
+         * as fixed-size records, so taking one does not allocate, and
+         * restoring one only does for string facts too long to be stored
+         * inline and for threads parked on facts.
+         *
+         * diff() encodes a snapshot as the bytes that changed since an
+         * earlier one of the same VM, and patch() turns the earlier one
+         * into the later one again, in place.
+         *
+         * Snapshots cannot be taken or restored while the VM is running,
+         * and only restore into VMs running the same program. Leaves keep
+         * whatever state of their own they have. Facts are stored by
+         * FactId, so snapshots kept across runs need the facts interned
+         * in the same order, and like program images they only load on
+         * machines of the same byte order.
+         */
+        class BehaviorTreeVMSnapshot {
+        public:
+            static const uint32_t Version = 3;
+
+            // size of a snapshot of the VM as it is now
+            static size_t size(BehaviorTreeVM const & vm);
+
+            // returns the size of the snapshot, 0 if it did not fit
+            static size_t save(BehaviorTreeVM const & vm, uint8_t* buffer, size_t capacity);
+            // returns false, leaving the VM alone, if the snapshot is
+            // malformed or of another program
+            static bool restore(BehaviorTreeVM& vm, const uint8_t* snapshot, size_t size);
+
+            // encodes 'snapshot' against 'base', returning the size of the
+            // delta, 0 if it did not fit
+            static size_t diff(const uint8_t* base, size_t baseSize, const uint8_t* snapshot, size_t size,
+                               uint8_t* delta, size_t capacity);
+            // applies a delta to the snapshot it was made against,
+            // returning the size of the result, 0 if the delta does not
+            // apply or the result does not fit
+            static size_t patch(uint8_t* base, size_t baseSize, size_t capacity, const uint8_t* delta, size_t deltaSize);
+        };
+    }
+}
@@ -0,0 +1,345 @@
+#include "ofxBehaviourTreeVMVerifier.h"
+
+namespace {
+    using ofxAI::BTVM::BehaviorTreeVMProgram;
+    using ofxAI::BTVM::BehaviorTreeVMThread;
+    using ops = BehaviorTreeVMProgram::ops;
+    using op_type = BehaviorTreeVMProgram::op_type;
+    const size_t NoThread = size_t(-1);
+
+    class Verifier {
+    public:
+        Verifier(BehaviorTreeVMProgram const & program, std::string* error)
+            : m_program(program), m_code(program.code()), m_size(program.codeSize()), m_error(error) {}
+
+        bool verify() {
+            auto& threads = m_program.m_threadEntries;
+            if (threads.empty() || (m_program.m_roots > threads.size()))
+                return fail("the program needs a thread for each of its roots");
+            if (m_program.m_factIds.size() != m_program.m_stringTable.size())
+                return fail("the program is not linked");
+            for (size_t i = 0; i < m_program.m_leaves.size(); i++) {
+                if (!m_program.m_leaves[i])
+                    return fail("leaf " + std::to_string(i) + " has no function");
+            }
+            for (size_t i = 0; i < m_program.m_decoratorNodes.size(); i++) {
+                if (!m_program.m_decoratorNodes[i])
+                    return fail("decorator " + std::to_string(i) + " has no function");
+            }
+            for (size_t i = 0; i < m_program.m_decoratorSymbols.size(); i++) {
+                size_t child = m_program.m_decoratorSymbols[i].child;
+                if ((child != NoThread) && (child >= threads.size()))
+                    return fail("decorator " + std::to_string(i) + " runs thread " + std::to_string(child) +
+                                ", which does not exist");
+            }
+
+            // find where every instruction starts, checking its operands
+            m_starts.assign(m_size, false);
+            for (size_t pc = 0; pc < m_size;) {
+                size_t size = ofxAI::BTVM::BehaviorTreeVMVerifier::instructionSize(m_code[pc]);
+                if (size == 0)
+                    return fail("unknown opcode " + std::to_string(m_code[pc]), pc);
+                if (size > m_size - pc)
+                    return fail("operands run past the end of the code", pc);
+                if (!checkOperands(pc))
+                    return false;
+                m_starts[pc] = true;
+                // the next instruction has to exist unless this one never
+                // goes on to it
+                op_type code = m_code[pc];
+                bool last = pc + size == m_size;
+                if (last && (code != ops::end::opcode) && (code != ops::set_i::opcode) && (code != ops::jmp::opcode) &&
+                    (code != ops::ret::opcode))
+                    return fail("the code runs off its end", pc);
+                pc += size;
+            }
+
+            for (size_t pc = 0; pc < m_size; pc += ofxAI::BTVM::BehaviorTreeVMVerifier::instructionSize(m_code[pc])) {
+                switch (m_code[pc]) {
+                case ops::bra_f::opcode:
+                case ops::bra_t::opcode:
+                case ops::jmp::opcode:
+                case ops::call::opcode:
+                    if (!checkTarget(pc, m_code[pc + 1]))
+                        return false;
+                    break;
+                case ops::rsm_thr::opcode:
+                case ops::run_bra_f::opcode:
+                case ops::run_bra_t::opcode:
+                    if (!checkTarget(pc, m_code[pc + 2]))
+                        return false;
+                    break;
+                default:
+                    break;
+                }
+            }
+            for (size_t i = 0; i < threads.size(); i++) {
+                if ((threads[i].start >= m_size) || !m_starts[threads[i].start])
+                    return fail("thread " + std::to_string(i) + " does not start on an instruction");
+            }
+            return checkCalls() && checkThreadCycles();
+        }
+    protected:
+        // follows every path from every thread entry, along with how many
+        // calls deep it is; a ret goes back to the instruction after its
+        // call, which is followed from the call itself
+        bool checkCalls() {
+            const size_t levels = BehaviorTreeVMThread::MaxCallDepth + 1;
+            std::vector<bool> seen(m_size * levels, false);
+            std::vector<std::pair<size_t, size_t>> pending;
+            for (auto& thread : m_program.m_threadEntries)
+                pending.push_back({ thread.start, 0 });
+            while (!pending.empty()) {
+                size_t pc = pending.back().first, depth = pending.back().second;
+                pending.pop_back();
+                if (seen[pc * levels + depth])
+                    continue;
+                seen[pc * levels + depth] = true;
+                const op_type* code = m_code + pc;
+                size_t next = pc + ofxAI::BTVM::BehaviorTreeVMVerifier::instructionSize(code[0]);
+                switch (code[0]) {
+                case ops::call::opcode:
+                    if (depth + 1 == levels)
+                        return fail("calls nest deeper than " + std::to_string(levels - 1), pc);
+                    pending.push_back({ pc + code[1], depth + 1 });
+                    pending.push_back({ next, depth });
+                    break;
+                case ops::ret::opcode:
+                    if (depth == 0)
+                        return fail("ret outside of a call", pc);
+                    break;
+                case ops::end::opcode:
+                case ops::set_i::opcode:
+                    break;
+                case ops::jmp::opcode:
+                    pending.push_back({ pc + code[1], depth });
+                    break;
+                case ops::bra_f::opcode:
+                case ops::bra_t::opcode:
+                    pending.push_back({ pc + code[1], depth });
+                    pending.push_back({ next, depth });
+                    break;
+                case ops::rsm_thr::opcode:
+                case ops::run_bra_f::opcode:
+                case ops::run_bra_t::opcode:
+                    pending.push_back({ pc + code[2], depth });
+                    pending.push_back({ next, depth });
+                    break;
+                default:
+                    pending.push_back({ next, depth });
+                    break;
+                }
+            }
+            return true;
+        }
+
+        // a thread that runs itself, directly or through other threads
+        // and decorators, would be entered again while it is running
+        bool checkThreadCycles() {
+            auto& threads = m_program.m_threadEntries;
+            // the threads each thread runs, with the pc that runs them
+            std::vector<std::vector<std::pair<size_t, size_t>>> runs(threads.size());
+            std::vector<size_t> seen(m_size, NoThread);
+            for (size_t i = 0; i < threads.size(); i++)
+                collectRuns(i, seen, runs[i]);
+
+            // depth-first, with the threads on the current path marked
+            enum : uint8_t { Unvisited, OnPath, Done };
+            std::vector<uint8_t> state(threads.size(), Unvisited);
+            std::vector<std::pair<size_t, size_t>> path;
+            for (size_t root = 0; root < threads.size(); root++) {
+                if (state[root] != Unvisited)
+                    continue;
+                state[root] = OnPath;
+                path.push_back({ root, 0 });
+                while (!path.empty()) {
+                    size_t thread = path.back().first;
+                    size_t& edge = path.back().second;
+                    if (edge == runs[thread].size()) {
+                        state[thread] = Done;
+                        path.pop_back();
+                        continue;
+                    }
+                    auto run = runs[thread][edge++];
+                    if (state[run.first] == OnPath)
+                        return fail("thread " + std::to_string(run.first) + " runs itself", run.second);
+                    if (state[run.first] == Unvisited) {
+                        state[run.first] = OnPath;
+                        path.push_back({ run.first, 0 });
+                    }
+                }
+            }
+            return true;
+        }
+
+        // follows every path through a thread, calls included, listing
+        // the threads its instructions run
+        void collectRuns(size_t thread, std::vector<size_t>& seen, std::vector<std::pair<size_t, size_t>>& runs) {
+            std::vector<size_t> pending{ m_program.m_threadEntries[thread].start };
+            while (!pending.empty()) {
+                size_t pc = pending.back();
+                pending.pop_back();
+                if (seen[pc] == thread)
+                    continue;
+                seen[pc] = thread;
+                const op_type* code = m_code + pc;
+                size_t next = pc + ofxAI::BTVM::BehaviorTreeVMVerifier::instructionSize(code[0]);
+                switch (code[0]) {
+                case ops::run_thr::opcode:
+                    runs.push_back({ (size_t)code[1], pc });
+                    pending.push_back(next);
+                    break;
+                case ops::rsm_thr::opcode:
+                    runs.push_back({ (size_t)code[1], pc });
+                    pending.push_back(pc + code[2]);
+                    pending.push_back(next);
+                    break;
+                case ops::run_par::opcode:
+                    for (op_type i = 0; i < code[2]; i++)
+                        runs.push_back({ (size_t)(code[1] + i), pc });
+                    pending.push_back(next);
+                    break;
+                case ops::run_dec::opcode:
+                    if (((size_t)code[1] < m_program.m_decoratorSymbols.size()) &&
+                        (m_program.m_decoratorSymbols[code[1]].child != NoThread))
+                        runs.push_back({ m_program.m_decoratorSymbols[code[1]].child, pc });
+                    pending.push_back(next);
+                    break;
+                case ops::ret::opcode:
+                case ops::end::opcode:
+                case ops::set_i::opcode:
+                    break;
+                case ops::jmp::opcode:
+                    pending.push_back(pc + code[1]);
+                    break;
+                case ops::bra_f::opcode:
+                case ops::bra_t::opcode:
+                case ops::call::opcode:
+                    pending.push_back(pc + code[1]);
+                    pending.push_back(next);
+                    break;
+                case ops::run_bra_f::opcode:
+                case ops::run_bra_t::opcode:
+                    pending.push_back(pc + code[2]);
+                    pending.push_back(next);
+                    break;
+                default:
+                    pending.push_back(next);
+                    break;
+                }
+            }
+        }
+
+        bool checkOperands(size_t pc) {
+            const op_type* code = m_code + pc;
+            switch (code[0]) {
+            case ops::run::opcode:
+            case ops::run_bra_f::opcode:
+            case ops::run_bra_t::opcode:
+                return checkIndex(pc, code[1], m_program.m_leaves.size(), "leaf");
+            case ops::run_dec::opcode:
+                return checkIndex(pc, code[1], m_program.m_decoratorNodes.size(), "decorator");
+            case ops::run_thr::opcode:
+            case ops::rsm_thr::opcode:
+                return checkIndex(pc, code[1], m_program.m_threadEntries.size(), "thread");
+            case ops::run_par::opcode:
+                if ((code[2] <= 0) || (code[3] < 0) || (code[4] < 0))
+                    return fail("bad parallel thread count or thresholds", pc);
+                return checkIndex(pc, code[1], m_program.m_threadEntries.size(), "thread") &&
+                       checkIndex(pc, code[1] + code[2] - 1, m_program.m_threadEntries.size(), "thread");
+            case ops::chk_fact::opcode:
+            case ops::rm_fact::opcode:
+            case ops::wait_fact::opcode:
+                return checkIndex(pc, code[1], m_program.m_factIds.size(), "string");
+            case ops::set_fact::opcode:
+            case ops::eq_fact::opcode:
+                return checkIndex(pc, code[1], m_program.m_factIds.size(), "string") &&
+                       checkIndex(pc, code[2], m_program.m_constants.size(), "constant");
+            default:
+                return true;
+            }
+        }
+
+        bool checkIndex(size_t pc, int index, size_t count, const char* what) {
+            if ((index < 0) || ((size_t)index >= count))
+                return fail(std::string(what) + " " + std::to_string(index) + " does not exist", pc);
+            return true;
+        }
+
+        bool checkTarget(size_t pc, op_type offset) {
+            off_t target = (off_t)pc + offset;
+            if ((target < 0) || ((size_t)target >= m_size) || !m_starts[target])
+                return fail("branch to " + std::to_string(target) + " does not land on an instruction", pc);
+            return true;
+        }
+
+        bool fail(std::string const & message, size_t pc = size_t(-1)) {
+            if (m_error) {
+                *m_error = message;
+                if (pc != size_t(-1))
+                    *m_error += " at " + std::to_string(pc);
+            }
+            return false;
+        }
+
+        BehaviorTreeVMProgram const & m_program;
+        const op_type* m_code;
+        size_t m_size;
+        std::string* m_error;
+        std::vector<bool> m_starts;
+    };
+}
+
+bool ofxAI::BTVM::BehaviorTreeVMVerifier::verify(BehaviorTreeVMProgram const & program, std::string* error) {
+    Verifier verifier(program, error);
+    return verifier.verify();
+}
+
+std::vector<bool> ofxAI::BTVM::BehaviorTreeVMVerifier::instructionStarts(BehaviorTreeVMProgram const & program) {
+    const op_type* code = program.code();
+    size_t codeSize = program.codeSize();
+    std::vector<bool> starts(codeSize, false);
+    for (size_t pc = 0; pc < codeSize;) {
+        size_t size = instructionSize(code[pc]);
+        if ((size == 0) || (size > codeSize - pc))
+            return {};
+        starts[pc] = true;
+        pc += size;
+    }
+    return starts;
+}
+
+size_t ofxAI::BTVM::BehaviorTreeVMVerifier::instructionSize(BehaviorTreeVMProgram::op_type opcode) {
+    switch (opcode) {
+    case ops::set_f::opcode:
+    case ops::set_t::opcode:
+    case ops::neg::opcode:
+    case ops::set_r::opcode:
+    case ops::set_i::opcode:
+    case ops::end::opcode:
+    case ops::ret::opcode:
+        return 1;
+    case ops::run::opcode:
+    case ops::run_thr::opcode:
+    case ops::run_dec::opcode:
+    case ops::bra_f::opcode:
+    case ops::bra_t::opcode:
+    case ops::jmp::opcode:
+    case ops::chk_fact::opcode:
+    case ops::rm_fact::opcode:
+    case ops::wait_fact::opcode:
+    case ops::call::opcode:
+        return 2;
+    case ops::rsm_thr::opcode:
+    case ops::set_fact::opcode:
+    case ops::eq_fact::opcode:
+    case ops::run_bra_f::opcode:
+    case ops::run_bra_t::opcode:
+        return 3;
+    case ops::run_par::opcode:
+        return 5;
+    default:
+        // dbg_break and log have no implementation
+        return 0;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "ofxBehaviourTreeVM.h"
+
+namespace ofxAI {
+    namespace BTVM {
+
+        /*
+         * Checks a linked program before any VM runs it, so the
+         * interpreter can trust it: every opcode is known and has all its
+         * operands, branches land on instructions, code never runs off
+         * the end, and every leaf, decorator, thread, string and constant
+         * an instruction names exists. Every path through a thread is
+         * followed, so that ret only runs inside a call, calls never
+         * nest deeper than a thread's return stack, and no thread runs
+         * itself through run_thr, rsm_thr, run_par or a decorator's
+         * child.
+         * BehaviorTreeVMProgram::link() runs it, and VMs only load
+         * programs that passed.
+         *
+         * On failure, 'error' (if given) says what failed and where.
+         */
+        class BehaviorTreeVMVerifier {
+        public:
+            static bool verify(BehaviorTreeVMProgram const & program, std::string* error = nullptr);
+
+            // length of the instruction with the given opcode, operands
+            // included, or 0 if the VM does not run it
+            static size_t instructionSize(BehaviorTreeVMProgram::op_type opcode);
+            // whether an instruction starts at each pc of the program's
+            // code; empty if the code does not split into instructions
+            static std::vector<bool> instructionStarts(BehaviorTreeVMProgram const & program);
+        };
+    }
+}
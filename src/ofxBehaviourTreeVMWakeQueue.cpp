@@ -0,0 +1,63 @@
+#include "ofxBehaviourTreeVMWakeQueue.h"
+
+ofxAI::BTVM::BehaviorTreeVMWakeQueue::BehaviorTreeVMWakeQueue(size_t capacity) : m_tail(0), m_head(0) {
+    size_t size = 2;
+    while (size < capacity)
+        size *= 2;
+    m_cells.reset(new Cell[size]);
+    m_mask = size - 1;
+    for (size_t i = 0; i < size; i++)
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool ofxAI::BTVM::BehaviorTreeVMWakeQueue::push(BehaviorTreeVM* vm, size_t thread) {
+    size_t position = m_tail.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = m_cells[position & m_mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+            // the cell is free; whoever moves the tail past it owns it
+            if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.wakeup = { vm, thread };
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if ((ptrdiff_t)(sequence - position) < 0) {
+            // the cell still holds the wakeup from a lap ago
+            return false;
+        }
+        else {
+            // another producer took the cell
+            position = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool ofxAI::BTVM::BehaviorTreeVMWakeQueue::push(BehaviorTreeVMThread const * thread) {
+    return push(thread->m_vm, thread->m_vm->getThreadIndex(thread));
+}
+
+bool ofxAI::BTVM::BehaviorTreeVMWakeQueue::pop(Wakeup& wakeup) {
+    Cell& cell = m_cells[m_head & m_mask];
+    if (cell.sequence.load(std::memory_order_acquire) != m_head + 1)
+        return false;
+    wakeup = cell.wakeup;
+    // free for the producer a lap ahead
+    cell.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+    m_head++;
+    return true;
+}
+
+size_t ofxAI::BTVM::BehaviorTreeVMWakeQueue::drain() {
+    // wakeups pushed meanwhile wait, so busy producers cannot keep
+    // the consumer here
+    size_t end = m_tail.load(std::memory_order_relaxed);
+    size_t count = 0;
+    Wakeup wakeup;
+    while ((m_head != end) && pop(wakeup)) {
+        wakeup.vm->wake(wakeup.thread);
+        count++;
+    }
+    return count;
+}
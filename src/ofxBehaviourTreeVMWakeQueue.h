@@ -0,0 +1,66 @@
+#pragma once
+#include "ofxBehaviourTreeVM.h"
+#include <atomic>
+
+namespace ofxAI {
+    namespace BTVM {
+
+        /*
+         * Wakeups for parked VM threads, pushed from other threads - such
+         * as pathfinding, animation or perception finishing work a leaf
+         * suspended on - and handed to BehaviorTreeVM::wake() by the
+         * thread that runs the VMs. One queue can serve one VM or a whole
+         * BehaviorTreeVMScheduler, which drains its own at the start of
+         * every run.
+         *
+         * The queue is a fixed ring of cells with sequence numbers: push()
+         * claims a cell with a compare and swap and publishes it with a
+         * release store, and drain() reads cells in order without atomic
+         * read-modify-writes. Neither locks or allocates. push() returns
+         * false when the queue is full, so producers have to try again
+         * later. Wakeups still being written when drain() gets to them
+         * wait for the next drain, as do the ones after them.
+         *
+         * Any number of threads may push, but only one may drain. VMs
+         * have to stay alive until the wakeups pushed for them are
+         * drained; waking a thread that is no longer parked does nothing.
+         */
+        class BehaviorTreeVMWakeQueue {
+        public:
+            struct Wakeup {
+                BehaviorTreeVM* vm;
+                size_t thread;
+            };
+
+            // capacity is rounded up to a power of two
+            explicit BehaviorTreeVMWakeQueue(size_t capacity = DefaultCapacity);
+            BehaviorTreeVMWakeQueue(const BehaviorTreeVMWakeQueue&) = delete;
+            BehaviorTreeVMWakeQueue& operator=(const BehaviorTreeVMWakeQueue&) = delete;
+
+            static const size_t DefaultCapacity = 1024;
+            size_t capacity() const { return m_mask + 1; }
+
+            // from any thread; returns false if the queue is full
+            bool push(BehaviorTreeVM* vm, size_t thread);
+            bool push(BehaviorTreeVMThread const * thread);
+
+            // from the thread running the VMs: takes the oldest wakeup,
+            // returning false if there is none
+            bool pop(Wakeup& wakeup);
+            // wakes the threads of every wakeup pushed so far, returning
+            // how many there were
+            size_t drain();
+        protected:
+            struct Cell {
+                std::atomic<size_t> sequence;   // position the cell is free for, or that +1 once written
+                Wakeup wakeup;
+            };
+
+            std::unique_ptr<Cell[]> m_cells;
+            size_t m_mask;
+            // producers and the consumer on cache lines of their own
+            alignas(64) std::atomic<size_t> m_tail;
+            alignas(64) size_t m_head;
+        };
+    }
+}
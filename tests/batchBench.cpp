@@ -0,0 +1,94 @@
+#include "ofxBehaviourTreeVMCompiler.h"
+#include "ofxBehaviourTreeVMBatch.h"
+#include <chrono>
+#include <cstdio>
+
+/*
+ * Times a BehaviorTreeVMBatch against calling run() on each of as many
+ * VMs, storing every result either way. The agents differ in the facts
+ * they hold, so the batch's lanes split where those are checked. Each
+ * figure is the best of several rounds.
+ */
+
+using namespace ofxAI::BehaviourTree;
+namespace VM = ofxAI::BTVM;
+
+namespace {
+    const size_t Agents = 512;
+    const int Ticks = 1000;
+    const int Rounds = 15;
+
+    int calls = 0;
+
+    // fails on every third call or so
+    Node leaf(int id) {
+        return Node(BaseNode::NodeTick([id](Tree*, const std::vector<std::string>&) {
+            calls++;
+            return ((calls * 7 + id) % 3) ? Status::Success : Status::Failure;
+        }));
+    }
+
+    // decorators around a node, all control flow once compiled
+    Node chain(Node node, int length) {
+        for (int i = 0; i < length; i++)
+            node = (i % 3 == 1) ? Node(ReturnTrue(node)) : Node(Negate(node));
+        return node;
+    }
+
+    template <typename Tick>
+    double millis(Tick tick) {
+        double best = 1e30;
+        for (int round = 0; round < Rounds; round++) {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < Ticks; i++)
+                tick();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    }
+
+    void bench(const char* name, Node const & root) {
+        auto program = VM::BehaviorTreeVMCompiler::compile(root);
+        VM::BehaviorTreeVMBatch batch(program);
+        std::vector<std::unique_ptr<VM::BehaviorTreeVM>> agents;
+        for (size_t i = 0; i < Agents; i++) {
+            batch.addAgent();
+            agents.emplace_back(new VM::BehaviorTreeVM(program));
+            for (VM::DictBlackboard* blackboard : { &batch.getAgent(i).blackboard, &agents[i]->blackboard }) {
+                if (i % 3 == 0)
+                    blackboard->setFact("a", "1");
+                if (i % 5 == 0)
+                    blackboard->setFact("c", "1");
+            }
+        }
+        std::vector<VM::Status> results(Agents);
+        double batched = millis([&] { batch.run(); });
+        double looped = millis([&] {
+            for (size_t i = 0; i < Agents; i++)
+                results[i] = agents[i]->run();
+        });
+        printf("  %-8s %7.1f ms %7.1f ms\n", name, batched, looped);
+    }
+}
+
+int main() {
+    printf("%zu agents, %d ticks:\n", Agents, Ticks);
+    printf("  tree       batch    run() each\n");
+    bench("chain", Sequence({ chain(FactExists("x"), 40), chain(FactExists("y"), 40), chain(FactExists("x"), 40) }));
+    bench("leaves", Selector({
+        Sequence({ Negate(leaf(1)), ReturnTrue(leaf(2)), FactExists("a") }),
+        Sequence({ Selector({ ReturnFalse(leaf(3)), Negate(ReturnTrue(leaf(4))), leaf(5) }), Negate(Negate(leaf(6))) }),
+        UntilFalse({ ReturnFalse(leaf(7)) }),
+        leaf(8) }));
+    bench("facts", Selector({
+        Sequence({ Negate(Negate(FactExists("a"))), ReturnTrue(Negate(FactExists("b"))) }),
+        Sequence({ Selector({ ReturnFalse(FactExists("a")), Negate(ReturnTrue(FactExists("c"))), FactExists("b") }),
+                   Negate(Negate(FactExists("c"))) }),
+        ReturnTrue(FactExists("a")) }));
+    bench("control", Selector({
+        chain(FactExists("a"), 7),
+        Sequence({ chain(FactExists("c"), 6), chain(FactExists("a"), 6) }),
+        chain(FactExists("c"), 8) }));
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "randomTrees.h"
+#include "ofxBehaviourTreeVMCompiler.h"
+#include "ofxBehaviourTreeVMOptimizer.h"
+#include "ofxBehaviourTreeVMBatch.h"
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * Differential test for BehaviorTreeVMBatch: random trees, in both
+ * composite modes, tick on a batch of a tile and a half of agents and on
+ * as many VMs run one after the other. Facts change on random sets of
+ * agents, so the batch's lanes split up into groups and meet again; every
+ * tick each agent's result has to be the one of its VM, having ticked
+ * the same leaves. The batch never backs off to running agent by agent.
+ *
+ *     batchTest [seed] [trees per mode]
+ *
+ * Built with -mavx2, it tests the AVX2 steps instead of the SSE2 ones.
+ */
+
+using namespace RandomTrees;
+namespace VM = ofxAI::BTVM;
+
+namespace {
+    const size_t Ticks = 8;
+    const size_t Agents = 48;
+
+    // a batch that steps its lanes together on every tick
+    class EagerBatch : public VM::BehaviorTreeVMBatch {
+    public:
+        using BehaviorTreeVMBatch::BehaviorTreeVMBatch;
+
+        std::vector<VM::Status> const & run() {
+            std::fill(m_backoff.begin(), m_backoff.end(), 0);
+            return BehaviorTreeVMBatch::run();
+        }
+    };
+}
+
+int main(int argc, char** argv) {
+    std::mt19937 rng(argc > 1 ? atoi(argv[1]) : 1);
+    int trees = argc > 2 ? atoi(argv[2]) : 1000;
+
+    size_t ticks = 0;
+    for (auto mode : { CompositeMode::Reactive, CompositeMode::Memory }) {
+        for (int i = 0; i < trees; i++) {
+            auto tree = generate(rng);
+            auto program = VM::BehaviorTreeVMCompiler::compile(tree.root, mode);
+            if (rng() % 2)
+                program = VM::BehaviorTreeVMOptimizer::optimize(*program);
+            EagerBatch batch(program);
+            std::vector<std::unique_ptr<VM::BehaviorTreeVM>> vms;
+            for (size_t agent = 0; agent < Agents; agent++) {
+                batch.addAgent();
+                vms.emplace_back(new VM::BehaviorTreeVM(program));
+            }
+
+            clearTraces();
+            for (size_t tick = 0; tick < Ticks; tick++, ticks += Agents) {
+                randomizeLeaves(rng);
+                // each fact change goes to a different set of agents
+                for (size_t change = rng() % 4; change > 0; change--) {
+                    std::vector<Blackboard*> blackboards;
+                    for (size_t agent = 0; agent < Agents; agent++) {
+                        if (rng() % 2) {
+                            blackboards.push_back(&batch.getAgent(agent).blackboard);
+                            blackboards.push_back(&vms[agent]->blackboard);
+                        }
+                    }
+                    changeFact(rng, blackboards);
+                }
+                auto& results = batch.run();
+                for (size_t agent = 0; agent < Agents; agent++) {
+                    VM::Status expected = vms[agent]->run();
+                    if ((results[agent] != expected) ||
+                        (trace(&batch.getAgent(agent).blackboard) != trace(&vms[agent]->blackboard))) {
+                        printf("%s tree %d, tick %zu, agent %zu: the batch ran %d, the VM %d\n",
+                               mode == CompositeMode::Memory ? "memory" : "reactive", i, tick, agent,
+                               (int)results[agent], (int)expected);
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+    printf("batch: %zu agent ticks match\n", ticks);
+    return 0;
+}
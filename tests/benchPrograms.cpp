@@ -0,0 +1,27 @@
+#include "benchPrograms.h"
+#include "ofxBehaviourTreeVMCompiler.h"
+
+namespace {
+    using namespace ofxAI::BehaviourTree;
+
+    Status succeed(Tree*, const std::vector<std::string>&) {
+        return Status::Success;
+    }
+    Status fail(Tree*, const std::vector<std::string>&) {
+        return Status::Failure;
+    }
+}
+
+namespace BenchPrograms {
+    ProgramPtr dispatchProgram() {
+        Node pass("pass", succeed), block("block", fail);
+        std::vector<Node> branches;
+        for (int i = 0; i < 16; i++)
+            branches.push_back(Sequence({ Negate(ReturnTrue(pass)), ReturnFalse(pass), pass }));
+        branches.push_back(Sequence({ Negate(block), ReturnTrue(block), pass, pass }));
+        Node root = Selector({ branches[0], branches[1], branches[2], branches[3], branches[4], branches[5],
+                               branches[6], branches[7], branches[8], branches[9], branches[10], branches[11],
+                               branches[12], branches[13], branches[14], branches[15], branches[16] });
+        return ofxAI::BTVM::BehaviorTreeVMCompiler::compile(root);
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "ofxBehaviourTreeVM.h"
+
+/*
+ * Programs the benchmarks share, so their figures can be compared.
+ */
+namespace BenchPrograms {
+    using ProgramPtr = ofxAI::BTVM::BehaviorTreeVM::ProgramPtr;
+
+    // a selector over 17 guarded sequences, where only the last guard
+    // passes: 52 leaf calls a tick, and mostly control flow between them
+    ProgramPtr dispatchProgram();
+}
@@ -0,0 +1,49 @@
+#include "benchPrograms.h"
+#include "ofxBehaviourTreeVMCodegen.h"
+#include <chrono>
+#include <cstdio>
+
+/*
+ * Times one tick of the dispatch benchmark program run by the
+ * interpreter loop in execute() and by the code codegenGenerate wrote
+ * for it, as dispatchBench times the interpreter against stepping it.
+ * Each figure is the best of several rounds.
+ */
+
+namespace VM = ofxAI::BTVM;
+
+extern const VM::BehaviorTreeVMNative benchNative;
+
+namespace {
+    const int Ticks = 200000;
+    const int Rounds = 9;
+
+    template <typename Tick>
+    double nanosPerTick(Tick tick) {
+        double best = 1e30;
+        for (int round = 0; round < Rounds; round++) {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < Ticks; i++)
+                tick();
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count() / Ticks);
+        }
+        return best;
+    }
+}
+
+int main() {
+    auto program = BenchPrograms::dispatchProgram();
+    auto native = VM::BehaviorTreeVMCodegen::bind(*program, benchNative);
+    if (!native) {
+        printf("the benchmark program did not bind to its code\n");
+        return 1;
+    }
+    VM::BehaviorTreeVM interpreted(program), compiled(native);
+    double execute = nanosPerTick([&] { interpreted.run(); });
+    double generated = nanosPerTick([&] { compiled.run(); });
+    printf("program of %zu words, per tick:\n", program->codeSize());
+    printf("  execute()        %6.1f ns\n", execute);
+    printf("  generated code   %6.1f ns  %.2fx\n", generated, execute / generated);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "codegenPrograms.h"
+#include "benchPrograms.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+/*
+ * Writes the C++ that codegenTest and codegenBench run:
+ *
+ *     codegenGenerate <directory> <programs>
+ *
+ * program<i>.cpp for each random program, natives.cpp listing them all,
+ * and bench.cpp for the dispatch benchmark program.
+ */
+
+using namespace CodegenPrograms;
+namespace VM = ofxAI::BTVM;
+
+namespace {
+    bool write(std::string const & path, VM::BehaviorTreeVMProgram const & program,
+               VM::BehaviorTreeVMCodegen::Options const & options) {
+        std::ofstream out(path);
+        if (!VM::BehaviorTreeVMCodegen::generate(program, options, out) || !out) {
+            printf("could not generate %s\n", path.c_str());
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("usage: codegenGenerate <directory> <programs>\n");
+        return 1;
+    }
+    std::string directory = argv[1];
+    size_t count = atoi(argv[2]);
+
+    auto programs = randomPrograms(count);
+    std::ofstream natives(directory + "/natives.cpp");
+    natives << "#include \"ofxBehaviourTreeVMCodegen.h\"\n\n";
+    for (size_t i = 0; i < count; i++) {
+        std::string symbol = "program" + std::to_string(i);
+        if (!programs[i].program || !write(directory + "/" + symbol + ".cpp", *programs[i].program,
+                                           options(symbol, programs[i].direct)))
+            return 1;
+        natives << "extern const ofxAI::BTVM::BehaviorTreeVMNative " << symbol << ";\n";
+    }
+    if (!write(directory + "/bench.cpp", *BenchPrograms::dispatchProgram(), options("benchNative", false)))
+        return 1;
+
+    natives << "\nextern const size_t nativeCount = " << count << ";\n";
+    natives << "extern const ofxAI::BTVM::BehaviorTreeVMNative* const natives[] = {\n";
+    for (size_t i = 0; i < count; i++)
+        natives << "    &program" << i << ",\n";
+    natives << "};\n";
+    return natives ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+#include "codegenPrograms.h"
+#include "ofxBehaviourTreeVMCompiler.h"
+#include "ofxBehaviourTreeVMOptimizer.h"
+
+namespace {
+    const unsigned Seed = 22;
+}
+
+namespace CodegenPrograms {
+    namespace VM = ofxAI::BTVM;
+
+    std::vector<RandomProgram> randomPrograms(size_t count) {
+        std::mt19937 rng(Seed);
+        std::vector<RandomProgram> programs;
+        for (size_t i = 0; i < count; i++) {
+            auto tree = generate(rng);
+            auto mode = (i % 2) ? CompositeMode::Memory : CompositeMode::Reactive;
+            ProgramPtr program = VM::BehaviorTreeVMCompiler::compile(tree.root, mode);
+            if (program && (rng() % 2))
+                program = VM::BehaviorTreeVMOptimizer::optimize(*program);
+            programs.push_back({ tree, mode, program, rng() % 2 == 0 });
+        }
+        return programs;
+    }
+
+    VM::BehaviorTreeVMCodegen::Options options(std::string const & symbol, bool direct) {
+        VM::BehaviorTreeVMCodegen::Options options;
+        options.symbol = symbol;
+        if (direct) {
+            options.includes.push_back("randomTrees.h");
+            for (int id = 0; id < NamedLeaves; id++)
+                options.leaves["L" + std::to_string(id)] = "RandomTrees::leaf<" + std::to_string(id) + ">";
+        }
+        return options;
+    }
+}
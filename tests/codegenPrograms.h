@@ -0,0 +1,24 @@
+#pragma once
+#include "randomTrees.h"
+#include "ofxBehaviourTreeVMCodegen.h"
+
+/*
+ * The random programs codegenGenerate writes C++ for, and codegenTest
+ * binds that code to again. Both sides build them from the
+ * same seed, so they come out the same.
+ */
+namespace CodegenPrograms {
+    using namespace RandomTrees;
+    using ProgramPtr = ofxAI::BTVM::BehaviorTreeVMCodegen::ProgramPtr;
+
+    struct RandomProgram {
+        RandomTree tree;
+        CompositeMode mode;
+        ProgramPtr program;
+        // named leaves are called directly by the generated code
+        bool direct;
+    };
+    std::vector<RandomProgram> randomPrograms(size_t count);
+
+    ofxAI::BTVM::BehaviorTreeVMCodegen::Options options(std::string const & symbol, bool direct);
+}
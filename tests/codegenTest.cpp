@@ -0,0 +1,88 @@
+#include "codegenPrograms.h"
+#include "ofxBehaviourTreeVMSnapshot.h"
+#include <cstdio>
+#include <memory>
+
+/*
+ * Differential test for generated code: the random programs that
+ * codegenGenerate wrote C++ for, compiled into this test and bound to
+ * the programs again. Each ticks as a Tree, as bytecode, as native code,
+ * and as native code run on budgets of a few instructions, whose
+ * snapshots are restored now and then into a VM running either the
+ * bytecode or the native code. Every tick they all have to return the
+ * same status, having ticked the same leaves in the same order.
+ */
+
+using namespace CodegenPrograms;
+namespace VM = ofxAI::BTVM;
+
+extern const size_t nativeCount;
+extern const VM::BehaviorTreeVMNative* const natives[];
+
+namespace {
+    const size_t Ticks = 16;
+}
+
+int main() {
+    std::mt19937 rng(1);
+    auto programs = randomPrograms(nativeCount);
+    std::vector<uint8_t> snapshot(1 << 16);
+    size_t ticks = 0, preempted = 0;
+    for (size_t i = 0; i < nativeCount; i++) {
+        auto& random = programs[i];
+        auto native = VM::BehaviorTreeVMCodegen::bind(*random.program, *natives[i]);
+        if (!native) {
+            printf("program %zu did not bind to its code\n", i);
+            return 1;
+        }
+        auto& other = *natives[(i + 1) % nativeCount];
+        if ((other.fingerprint != natives[i]->fingerprint) && VM::BehaviorTreeVMCodegen::bind(*random.program, other)) {
+            printf("program %zu bound to the code of another program\n", i);
+            return 1;
+        }
+
+        auto blackboard = std::make_shared<VM::DictBlackboard>();
+        Tree reference(Tree::compile(random.tree.root, random.mode), blackboard);
+        VM::BehaviorTreeVM interpreted(random.program), compiled(native);
+        auto budgeted = std::make_unique<VM::BehaviorTreeVM>(native);
+
+        clearTraces();
+        for (size_t tick = 0; tick < Ticks; tick++, ticks++) {
+            randomizeLeaves(rng);
+            if (rng() % 3 == 0)
+                changeFact(rng, { blackboard.get(), &interpreted.blackboard, &compiled.blackboard, &budgeted->blackboard });
+            int expected = (int)interpreted.run();
+            int results[] = { (int)compiled.run(), 0, (int)reference.tick() };
+            for (;;) {
+                results[1] = (int)budgeted->run(1 + rng() % 12);
+                if (!budgeted->preempted())
+                    break;
+                preempted++;
+                if (rng() % 4 == 0) {
+                    size_t size = VM::BehaviorTreeVMSnapshot::save(*budgeted, snapshot.data(), snapshot.size());
+                    auto restored = std::make_unique<VM::BehaviorTreeVM>(rng() % 2 ? native : random.program);
+                    if (!VM::BehaviorTreeVMSnapshot::restore(*restored, snapshot.data(), size)) {
+                        printf("program %zu, tick %zu: snapshot did not restore\n", i, tick);
+                        return 1;
+                    }
+                    trace(&restored->blackboard) = trace(&budgeted->blackboard);
+                    budgeted = std::move(restored);
+                }
+            }
+
+            auto& expectedTrace = trace(&interpreted.blackboard);
+            bool same = (results[0] == expected) && (results[1] == expected) &&
+                        (trace(&compiled.blackboard) == expectedTrace) && (trace(&budgeted->blackboard) == expectedTrace);
+            // a Tree cannot wait for facts
+            if (!random.tree.waits)
+                same &= (results[2] == expected) && (trace(blackboard.get()) == expectedTrace);
+            if (!same) {
+                printf("program %zu, tick %zu: bytecode %d, native %d, budgeted %d, tree %d\n", i, tick, expected,
+                       results[0], results[1], results[2]);
+                return 1;
+            }
+        }
+    }
+    printf("codegen: %zu ticks match, %zu budgeted runs preempted\n", ticks, preempted);
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include "ofxBehaviourTreePool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+
+/*
+ * Differential test for ConcurrentParallel: parallels of random sizes
+ * and thresholds, some given a single threshold, tick as
+ * ConcurrentParallel on an AgentPool's agents and on a Tree with a pool
+ * of its own, and as Parallel on as many Trees ticked one after the
+ * other. Every child returns a random status picked per agent; every
+ * tick each concurrent parallel has to return what its Parallel does,
+ * having ticked the same children, and no child that finished may be
+ * ticked again before the parallel itself finishes.
+ *
+ *     concurrentParallelTest [seed] [parallels]
+ *
+ * make tsan runs it built with -fsanitize=thread.
+ */
+
+using namespace ofxAI::BehaviourTree;
+
+namespace {
+    const size_t Ticks = 12;
+    // the pool's agents, then the Tree with a pool of its own
+    const size_t Agents = 6;
+    const size_t Runs = Agents + 1;
+    // past the 16 children tickParallel keeps on the stack
+    const size_t MaxChildren = 20;
+
+    // what each child returns on the next tick, by run
+    Status nextStatus[Runs][MaxChildren];
+
+    // what the children ticked with a blackboard did; children of one
+    // parallel may tick at the same time, so each has its own counters
+    struct Record {
+        size_t run;
+        size_t ticks[MaxChildren];
+        size_t reticked[MaxChildren];
+        bool finished[MaxChildren];
+    };
+    std::map<Blackboard const *, Record> records;
+
+    // every blackboard's record exists before ticking starts
+    Record& record(Tree* tree) {
+        return records.find(tree->getBlackboard().get())->second;
+    }
+
+    Node child(size_t id) {
+        return Node(BaseNode::NodeTick([id](Tree* tree, const std::vector<std::string>&) {
+            Record& ran = record(tree);
+            ran.ticks[id]++;
+            ran.reticked[id] += ran.finished[id];
+            Status status = nextStatus[ran.run][id];
+            ran.finished[id] = (status == Status::Success) || (status == Status::Failure);
+            return status;
+        }));
+    }
+
+    // the node DSL only takes initializer lists of children
+    struct WithChildren : public Node {
+        WithChildren(Node const & node, std::vector<Node> const & children) : Node(node) {
+            m_children = children;
+        }
+    };
+
+    template <typename Make>
+    Node fromList(std::vector<Node> const & nodes, Make make) {
+        switch (nodes.size()) {
+        case 1: return make({ nodes[0] });
+        case 2: return make({ nodes[0], nodes[1] });
+        case 3: return make({ nodes[0], nodes[1], nodes[2] });
+        default: return make({ nodes[0], nodes[1], nodes[2], nodes[3] });
+        }
+    }
+
+    Status randomStatus(std::mt19937& rng) {
+        unsigned pick = rng() % 40;
+        return (pick == 0) ? Status::Invalid : (pick < 16) ? Status::Running :
+               (pick < 28) ? Status::Success : Status::Failure;
+    }
+
+    // once the parallel is done, its children start over
+    void settle(Tree& tree, Status status) {
+        if (status != Status::Running) {
+            Record& ran = record(&tree);
+            std::fill(ran.finished, ran.finished + MaxChildren, false);
+        }
+    }
+
+    bool sameChildren(Tree& tree, Tree& expected, size_t& reticks) {
+        Record& ran = record(&tree);
+        Record& reference = record(&expected);
+        for (size_t id = 0; id < MaxChildren; id++) {
+            reticks += ran.reticked[id] + reference.reticked[id];
+            if (ran.ticks[id] != reference.ticks[id])
+                return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::mt19937 rng(argc > 1 ? atoi(argv[1]) : 1);
+    int parallels = argc > 2 ? atoi(argv[2]) : 500;
+
+    TaskPool pool(3), own(2);
+    size_t ticks = 0, singles = 0;
+    for (int i = 0; i < parallels; i++) {
+        // single thresholds go through the constructors taking one,
+        // which need the children as a list
+        bool single = rng() % 3 == 0;
+        size_t count = 1 + rng() % (single ? 4 : MaxChildren);
+        std::vector<Node> children;
+        for (size_t id = 0; id < count; id++)
+            children.push_back(child(id));
+        size_t success = 1 + rng() % count, failure = 1 + rng() % count;
+        auto make = [&](bool concurrent) -> Node {
+            if (single) {
+                return fromList(children, [=](std::initializer_list<Node> list) {
+                    return concurrent ? Node(ConcurrentParallel(success, list)) : Node(Parallel(success, list));
+                });
+            }
+            if (concurrent)
+                return WithChildren(ConcurrentParallel(success, failure, {}), children);
+            return WithChildren(Parallel(success, failure, {}), children);
+        };
+        Node concurrent = make(true), plain = make(false);
+        singles += single;
+
+        AgentPool agents(Tree::compile(concurrent), pool);
+        Tree alone(Tree::compile(concurrent));
+        // the Tree on its own runs on the shared pool every other time
+        if (i % 2)
+            alone.setTaskPool(&own);
+        std::vector<Tree> serial;
+        records.clear();
+        for (size_t run = 0; run < Runs; run++) {
+            Tree& tree = (run < Agents) ? agents.getAgent(agents.addAgent()) : alone;
+            serial.emplace_back(Tree::compile(plain));
+            records[tree.getBlackboard().get()] = Record{ run, {}, {}, {} };
+            records[serial[run].getBlackboard().get()] = Record{ run, {}, {}, {} };
+        }
+        if (agents.getAgent(0).getTaskPool() != &pool) {
+            printf("parallel %d: the agents do not run on their AgentPool's pool\n", i);
+            return 1;
+        }
+
+        for (size_t tick = 0; tick < Ticks; tick++, ticks += Runs) {
+            for (size_t run = 0; run < Runs; run++) {
+                for (size_t id = 0; id < count; id++)
+                    nextStatus[run][id] = randomStatus(rng);
+            }
+            std::vector<Status> results = agents.tick();
+            results.push_back(alone.tick());
+            for (size_t run = 0; run < Runs; run++) {
+                Tree& tree = (run < Agents) ? agents.getAgent(run) : alone;
+                Status expected = serial[run].tick();
+                settle(tree, results[run]);
+                settle(serial[run], expected);
+                size_t reticks = 0;
+                bool same = sameChildren(tree, serial[run], reticks);
+                if ((results[run] != expected) || !same || reticks) {
+                    printf("parallel %d (%zu children, %zu/%zu), tick %zu, run %zu: concurrent %d, plain %d%s%s\n",
+                           i, count, success, failure, tick, run, (int)results[run], (int)expected,
+                           same ? "" : ", children ticked differently",
+                           reticks ? ", finished children ticked again" : "");
+                    return 1;
+                }
+            }
+        }
+    }
+    printf("concurrent parallel: %zu ticks match, %zu with a single threshold\n", ticks, singles * Ticks * Runs);
+    return 0;
+}
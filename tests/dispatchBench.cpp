@@ -0,0 +1,57 @@
+#include "benchPrograms.h"
+#include <chrono>
+#include <cstdio>
+
+/*
+ * Times one tick of the dispatch benchmark program two ways: stepping it
+ * one eval() per instruction, as the VM used to, and the interpreter
+ * loop in execute(). Each figure is the best of several rounds.
+ */
+
+namespace VM = ofxAI::BTVM;
+
+namespace {
+    const int Ticks = 200000;
+    const int Rounds = 9;
+
+    class BenchVM : public VM::BehaviorTreeVM {
+    public:
+        using VM::BehaviorTreeVM::BehaviorTreeVM;
+
+        // ticks the root one instruction at a time
+        VM::Status step() {
+            auto& root = m_threads[0];
+            m_tick = root.m_tick + 1;
+            enterThread(0);
+            m_active = 0;
+            while (root.step(this))
+                ;
+            m_active = NoThread;
+            return root.m_current;
+        }
+    };
+
+    template <typename Tick>
+    double nanosPerTick(Tick tick) {
+        double best = 1e30;
+        for (int round = 0; round < Rounds; round++) {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < Ticks; i++)
+                tick();
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count() / Ticks);
+        }
+        return best;
+    }
+}
+
+int main() {
+    auto program = BenchPrograms::dispatchProgram();
+    BenchVM stepped(program), interpreted(program);
+    double step = nanosPerTick([&] { stepped.step(); });
+    double execute = nanosPerTick([&] { interpreted.run(); });
+    printf("program of %zu words, per tick:\n", program->codeSize());
+    printf("  eval() per instruction  %6.1f ns\n", step);
+    printf("  execute()               %6.1f ns  %.2fx\n", execute, step / execute);
+    return 0;
+}
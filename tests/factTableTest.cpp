@@ -0,0 +1,105 @@
+#include "ofxBehaviourTree.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+/*
+ * Tests for FactTable: threads intern the same few thousand names in
+ * different orders while reading back names of IDs interned so far, and
+ * another thread only reads names, which name() and size() do without
+ * the table's lock. Every thread has to get the same ID for each name,
+ * the IDs have to be dense, and every name read has to be the one its
+ * ID was interned from.
+ *
+ * make tsan runs it built with -fsanitize=thread.
+ */
+
+using namespace ofxAI::BehaviourTree;
+
+namespace {
+    const size_t Threads = 4;
+    // enough to fill several of the table's chunks
+    const size_t Names = 5000;
+
+    std::string nameOf(size_t i) {
+        return "factTableTest" + std::to_string(i);
+    }
+}
+
+int main() {
+    const size_t before = FactTable::size();
+    std::vector<std::vector<FactId>> ids(Threads, std::vector<FactId>(Names));
+    std::vector<size_t> wrong(Threads, 0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < Threads; t++) {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng((unsigned)t);
+            std::vector<size_t> order(Names);
+            for (size_t i = 0; i < Names; i++)
+                order[i] = i;
+            std::shuffle(order.begin(), order.end(), rng);
+            for (size_t i : order) {
+                FactId fact = FactTable::intern(nameOf(i));
+                ids[t][i] = fact;
+                if ((FactTable::name(fact) != nameOf(i)) || (FactTable::find(nameOf(i)) != fact))
+                    wrong[t]++;
+                // any ID below size() is readable, whoever interned it
+                FactId other = FactId(before + rng() % (FactTable::size() - before));
+                if (FactTable::name(other).compare(0, 13, "factTableTest") != 0)
+                    wrong[t]++;
+            }
+        });
+    }
+    // a reader that never takes the lock, so nothing but the table's
+    // own publishing orders what it reads
+    std::atomic<size_t> interning(Threads);
+    size_t reads = 0, unread = 0;
+    std::thread reader([&] {
+        std::mt19937 rng(Threads);
+        while (interning > 0) {
+            size_t size = FactTable::size();
+            if (size == before)
+                continue;
+            reads++;
+            if (FactTable::name(FactId(before + rng() % (size - before))).compare(0, 13, "factTableTest") != 0)
+                unread++;
+        }
+    });
+    for (auto& thread : threads) {
+        thread.join();
+        interning--;
+    }
+    reader.join();
+    if (unread) {
+        printf("the reader read %zu names wrong\n", unread);
+        return 1;
+    }
+
+    for (size_t t = 0; t < Threads; t++) {
+        if (wrong[t]) {
+            printf("thread %zu read %zu wrong names or IDs\n", t, wrong[t]);
+            return 1;
+        }
+        if (ids[t] != ids[0]) {
+            printf("threads 0 and %zu got different IDs\n", t);
+            return 1;
+        }
+    }
+    std::vector<bool> seen(Names, false);
+    for (FactId fact : ids[0]) {
+        if ((fact < before) || (fact >= before + Names) || seen[fact - before]) {
+            printf("fact ID %u is out of range or taken twice\n", (unsigned)fact);
+            return 1;
+        }
+        seen[fact - before] = true;
+    }
+    if ((FactTable::size() != before + Names) || !FactTable::name(FactId(FactTable::size())).empty() ||
+        (FactTable::find("factTableTestMissing") != InvalidFact)) {
+        printf("the table holds names that were never interned\n");
+        return 1;
+    }
+    printf("fact table: %zu names interned by %zu threads, %zu read alongside\n", Names, Threads, reads);
+    return 0;
+}
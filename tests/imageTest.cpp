@@ -0,0 +1,153 @@
+#include "randomTrees.h"
+#include "ofxBehaviourTreeVMCompiler.h"
+#include "ofxBehaviourTreeVMOptimizer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+/*
+ * Tests for program images: random programs of named trees are saved to
+ * a file and map()-ed back, and two VMs sharing the mapped program tick
+ * alongside a VM running the program they were saved from; every tick
+ * all three have to return the same status, having ticked the same
+ * leaves. Images that are truncated, have a bad header, bad code or a
+ * symbol missing from the registry have to be refused, from memory and
+ * from a file; images with random bytes flipped either load a program
+ * that passed the verifier or are refused.
+ *
+ *     imageTest [seed] [trees per mode]
+ *
+ * The image file is written next to the test, and removed again.
+ */
+
+using namespace RandomTrees;
+namespace VM = ofxAI::BTVM;
+using Image = VM::BehaviorTreeVMImage;
+using Bytes = std::vector<uint8_t>;
+
+namespace {
+    const size_t Ticks = 8;
+
+    // header fields of images of version 2
+    const size_t VersionField = 4, ByteOrderField = 6, CodeField = 20, ThreadsField = 28;
+
+    template <typename T>
+    void put(Bytes& image, size_t at, T value) {
+        std::memcpy(image.data() + at, &value, sizeof(value));
+    }
+
+    uint32_t get(Bytes const & image, size_t at) {
+        uint32_t value;
+        std::memcpy(&value, image.data() + at, sizeof(value));
+        return value;
+    }
+
+    bool write(std::string const & path, Bytes const & image) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(image.data()), image.size());
+        return file.good();
+    }
+
+    // images that no registry holding the named functions may load
+    std::vector<Bytes> corruptions(Bytes const & image) {
+        std::vector<Bytes> corrupt;
+        auto change = [&](size_t at, auto value) {
+            corrupt.push_back(image);
+            put(corrupt.back(), at, value);
+        };
+        change(0, uint32_t(0));  // magic
+        change(VersionField, uint16_t(1));
+        change(ByteOrderField, uint16_t(0x0201));
+        change(CodeField, get(image, CodeField) + 1);  // misaligned code
+        change(CodeField + 4, 1u << 30);               // code past the end
+        // the first instruction's opcode, and the first thread's start
+        change(get(image, CodeField), 99);
+        change(get(image, ThreadsField), get(image, CodeField + 4));
+        for (size_t size : { size_t(0), size_t(16), image.size() / 2, image.size() - 1 })
+            corrupt.push_back(Bytes(image.begin(), image.begin() + size));
+        return corrupt;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::mt19937 rng(argc > 1 ? atoi(argv[1]) : 1);
+    int trees = argc > 2 ? atoi(argv[2]) : 1000;
+    std::string path = std::string(argv[0]) + ".btvm";
+
+    VM::BehaviorTreeVMRegistry registry, empty;
+    registerNamed(registry);
+
+    size_t ticks = 0, rejected = 0, unresolved = 0, flipped = 0;
+    for (auto mode : { CompositeMode::Reactive, CompositeMode::Memory }) {
+        for (int i = 0; i < trees; i++) {
+            auto tree = generate(rng, true);
+            auto program = VM::BehaviorTreeVMCompiler::compile(tree.root, mode);
+            if (rng() % 2)
+                program = VM::BehaviorTreeVMOptimizer::optimize(*program);
+            Bytes image;
+            if (!Image::save(*program, image) || !Image::save(*program, path)) {
+                printf("tree %d could not be saved\n", i);
+                return 1;
+            }
+            auto mapped = Image::map(path, registry);
+            if (!mapped || !mapped->m_image || (mapped->code() == mapped->m_program.data())) {
+                printf("tree %d: the image was not mapped and run in place\n", i);
+                return 1;
+            }
+
+            VM::BehaviorTreeVM original(program), first(mapped), second(mapped);
+            clearTraces();
+            for (size_t tick = 0; tick < Ticks; tick++, ticks++) {
+                randomizeLeaves(rng);
+                if (rng() % 3 == 0)
+                    changeFact(rng, { &original.blackboard, &first.blackboard, &second.blackboard });
+                int expected = (int)original.run();
+                if (((int)first.run() != expected) || ((int)second.run() != expected) ||
+                    (trace(&first.blackboard) != trace(&original.blackboard)) ||
+                    (trace(&second.blackboard) != trace(&original.blackboard))) {
+                    printf("%s tree %d, tick %zu: the mapped program ticks differently\n",
+                           mode == CompositeMode::Memory ? "memory" : "reactive", i, tick);
+                    return 1;
+                }
+            }
+
+            for (auto& bad : corruptions(image)) {
+                if (Image::load(bad, registry) || !write(path, bad) || Image::map(path, registry)) {
+                    printf("tree %d: a corrupt image was loaded\n", i);
+                    return 1;
+                }
+                rejected++;
+            }
+            if (!program->m_leaves.empty() || !program->m_decoratorNodes.empty()) {
+                if (Image::load(image, empty)) {
+                    printf("tree %d: an image with unregistered symbols was loaded\n", i);
+                    return 1;
+                }
+                unresolved++;
+            }
+
+            Bytes noise = image;
+            for (int flip = 0; flip < 4; flip++)
+                noise[rng() % noise.size()] ^= uint8_t(1 << rng() % 8);
+            if (auto loaded = Image::load(noise, registry)) {
+                if (!loaded->m_verified) {
+                    printf("tree %d: an unverified program was loaded\n", i);
+                    return 1;
+                }
+                VM::BehaviorTreeVM vm(loaded);
+                for (size_t tick = 0; tick < Ticks; tick++)
+                    vm.run();
+                flipped++;
+            }
+        }
+    }
+    std::remove(path.c_str());
+    if (Image::map(path, registry)) {
+        printf("a missing file was mapped\n");
+        return 1;
+    }
+    printf("image: %zu ticks match, %zu corrupt images and %zu with unregistered symbols refused, %zu noisy ones ran\n",
+           ticks, rejected, unresolved, flipped);
+    return 0;
+}
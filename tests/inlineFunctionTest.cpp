@@ -0,0 +1,123 @@
+#include "ofxBehaviourTree.h"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Tests for InlineFunction: empty functions, from nothing, nullptr or a
+ * null function pointer, are false; function pointers, lambdas capturing
+ * numbers, pointers and references, and mutable lambdas are true and
+ * return what the callable does, copies keeping state of their own; and
+ * none of it, including ticking leaves and decorators made of them,
+ * allocates. Built with assertions, calling an empty function has to
+ * assert, which a child process is left to do.
+ */
+
+using namespace ofxAI::BehaviourTree;
+
+namespace {
+    size_t allocations = 0;
+
+    using Add = InlineFunction<int(int)>;
+
+    int twice(int value) {
+        return 2 * value;
+    }
+
+    bool check(bool ok, char const * what) {
+        if (!ok)
+            printf("inline function: %s\n", what);
+        return ok;
+    }
+
+    // an empty function asserts when called, and the child calling it
+    // is killed by the abort
+    bool emptyCallAsserts() {
+#ifdef NDEBUG
+        return true;
+#else
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0) {
+            // the assertion's message is expected
+            if (!freopen("/dev/null", "w", stderr))
+                _exit(2);
+            Add empty;
+            empty(1);
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        return WIFSIGNALED(status) && (WTERMSIG(status) == SIGABRT);
+#endif
+    }
+}
+
+void* operator new(size_t size) {
+    allocations++;
+    if (void* memory = malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+int main() {
+    bool ok = true;
+    int (*none)(int) = nullptr;
+    ok &= check(!Add() && !Add(nullptr) && !Add(none), "empty functions are not false");
+
+    int offset = 5, total = 0;
+    int* sum = &total;
+    int& ref = offset;
+    size_t before = allocations;
+    Add pointer(twice);
+    Add number([offset](int value) { return value + offset; });
+    Add captured([sum, &ref](int value) { return *sum += value + ref; });
+    Add counter([calls = 0](int value) mutable { return value + ++calls; });
+    ok &= check(pointer && number && captured && counter, "functions are false");
+    ok &= check((pointer(21) == 42) && (number(1) == 6), "calls return something else");
+    ok &= check((captured(1) == 6) && (captured(2) == 13) && (total == 13), "captured pointers miss the calls");
+
+    // copies, made and assigned, call the same callable with its state
+    // copied along
+    counter(0);
+    Add copied(counter), assigned;
+    assigned = number;
+    ok &= check((copied(0) == 2) && (counter(0) == 2) && (copied(0) == 3), "copies share state");
+    ok &= check(assigned(1) == 6, "assigned functions call something else");
+    assigned = pointer;
+    ok &= check(assigned(3) == 6, "reassigned functions call something else");
+    assigned = nullptr;
+    ok &= check(!assigned, "functions assigned nullptr are not false");
+    ok &= check(allocations == before, "making, copying or calling a function allocates");
+
+    // as a leaf and a decorator of a tree
+    int ticks = 0;
+    Node leaf(BaseNode::NodeTick([&ticks](Tree*, const std::vector<std::string>&) {
+        ticks++;
+        return Status::Success;
+    }));
+    Node inverted(BaseNode::NodeDecorate([](Tree* tree, BaseNode* child, const std::vector<std::string>&) {
+        return (child->tick(tree) == Status::Success) ? Status::Failure : Status::Success;
+    }), leaf);
+    Tree tree(Tree::compile(inverted));
+    before = allocations;
+    Status status = tree.tick();
+    ok &= check((status == Status::Failure) && (ticks == 1), "the tree ticked its functions wrong");
+    ok &= check(allocations == before, "ticking leaves and decorators allocates");
+
+    ok &= check(emptyCallAsserts(), "calling an empty function does not assert");
+    if (!ok)
+        return 1;
+    printf("inline function: made, copied and called without allocating\n");
+    return 0;
+}
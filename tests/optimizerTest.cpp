@@ -0,0 +1,167 @@
+#include "randomTrees.h"
+#include "ofxBehaviourTreeVMCompiler.h"
+#include "ofxBehaviourTreeVMOptimizer.h"
+#include "ofxBehaviourTreeVMBatch.h"
+#include "ofxBehaviourTreeVMProfiler.h"
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * Differential test for the optimizer: random trees, in both composite
+ * modes, tick as a Tree, as bytecode, as optimized bytecode, on a batch
+ * of VMs running the optimized bytecode, and on a VM whose run() only
+ * gets a few instructions at a time. Every tick they all have to return
+ * the same status, having ticked the same leaves in the same order.
+ * Built with BTVM_PROFILE, as make test does in build/profile, the two
+ * bytecode VMs are profiled too: every run their profilers have to
+ * count the instructions the VM reports it ran, and every tree the
+ * counts by pc have to add up to the counts by opcode.
+ *
+ *     optimizerTest [seed] [trees per mode]
+ */
+
+using namespace RandomTrees;
+namespace VM = ofxAI::BTVM;
+
+namespace {
+    const size_t Ticks = 8;
+    const size_t BatchAgents = 8;
+
+    // runs a tick on budgets of 1 to 12 instructions until it is done
+    VM::Status runBudgeted(VM::BehaviorTreeVM& vm, std::mt19937& rng) {
+        VM::Status status;
+        do {
+            size_t budget = 1 + rng() % 12;
+            status = vm.run(budget);
+            if (vm.getInstructionsRun() > budget) {
+                printf("run(%zu) ran %zu instructions\n", budget, vm.getInstructionsRun());
+                exit(1);
+            }
+        } while (vm.preempted());
+        return status;
+    }
+
+#if BTVM_PROFILE
+    // the profiler counted the instructions the VM's last run ran
+    bool countedRun(VM::BehaviorTreeVM& vm, uint64_t& counted) {
+        uint64_t total = vm.getProfiler()->getInstructions();
+        if (total - counted != vm.getInstructionsRun())
+            return false;
+        counted = total;
+        return true;
+    }
+
+    // pcs are only counted where instructions start, and add up to the
+    // count of their opcode
+    bool countsAgree(VM::BehaviorTreeVMProfiler const & profiler) {
+        auto& program = *profiler.getProgram();
+        auto& pcs = profiler.getPcCounts();
+        std::vector<uint64_t> opcodes(VM::BehaviorTreeVMProgram::OpcodeCount, 0);
+        for (size_t pc = 0; pc < pcs.size(); pc++) {
+            if (!pcs[pc])
+                continue;
+            if (!program.m_instructionStarts[pc])
+                return false;
+            opcodes[program.code()[pc]] += pcs[pc];
+        }
+        return opcodes == profiler.getOpcodeCounts();
+    }
+#endif
+}
+
+int main(int argc, char** argv) {
+    std::mt19937 rng(argc > 1 ? atoi(argv[1]) : 1);
+    int trees = argc > 2 ? atoi(argv[2]) : 5000;
+
+    VM::BehaviorTreeVMOptimizer::Report total;
+    size_t ticks = 0;
+    uint64_t profiled = 0;
+    for (auto mode : { CompositeMode::Reactive, CompositeMode::Memory }) {
+        for (int i = 0; i < trees; i++) {
+            auto tree = generate(rng);
+            auto program = VM::BehaviorTreeVMCompiler::compile(tree.root, mode);
+            if (!program) {
+                printf("tree %d did not compile\n", i);
+                return 1;
+            }
+            VM::BehaviorTreeVMOptimizer::Report report;
+            auto optimized = VM::BehaviorTreeVMOptimizer::optimize(*program, &report);
+            if (!optimized) {
+                printf("tree %d did not optimize\n", i);
+                return 1;
+            }
+            if ((report.instructionsAfter > report.instructionsBefore) || (report.sizeAfter > report.sizeBefore)) {
+                printf("tree %d grew from %zu to %zu words\n", i, report.sizeBefore, report.sizeAfter);
+                return 1;
+            }
+            total.instructionsBefore += report.instructionsBefore;
+            total.instructionsAfter += report.instructionsAfter;
+            total.sizeBefore += report.sizeBefore;
+            total.sizeAfter += report.sizeAfter;
+
+            auto blackboard = std::make_shared<VM::DictBlackboard>();
+            Tree reference(Tree::compile(tree.root, mode), blackboard);
+            VM::BehaviorTreeVM plain(program), fast(optimized);
+            VM::BehaviorTreeVM budgeted(rng() % 2 ? optimized : program);
+            VM::BehaviorTreeVMBatch batch(optimized);
+            for (size_t agent = 0; agent < BatchAgents; agent++)
+                batch.addAgent();
+#if BTVM_PROFILE
+            VM::BehaviorTreeVMProfiler plainProfile(program), fastProfile(optimized);
+            plain.setProfiler(&plainProfile);
+            fast.setProfiler(&fastProfile);
+            uint64_t plainCounted = 0, fastCounted = 0;
+#endif
+
+            std::vector<Blackboard*> blackboards = { blackboard.get(), &plain.blackboard, &fast.blackboard,
+                                                     &budgeted.blackboard };
+            for (size_t agent = 0; agent < BatchAgents; agent++)
+                blackboards.push_back(&batch.getAgent(agent).blackboard);
+
+            clearTraces();
+            for (size_t tick = 0; tick < Ticks; tick++, ticks++) {
+                randomizeLeaves(rng);
+                if (rng() % 3 == 0)
+                    changeFact(rng, blackboards);
+                int expected = (int)plain.run();
+                int results[] = { (int)fast.run(), (int)runBudgeted(budgeted, rng), (int)reference.tick() };
+                auto& batchResults = batch.run();
+                auto& expectedTrace = trace(&plain.blackboard);
+#if BTVM_PROFILE
+                if (!countedRun(plain, plainCounted) || !countedRun(fast, fastCounted)) {
+                    printf("tree %d, tick %zu: the profiler counted other instructions than the VM ran\n", i, tick);
+                    return 1;
+                }
+#endif
+
+                bool same = (results[0] == expected) && (results[1] == expected) &&
+                            (trace(&fast.blackboard) == expectedTrace) && (trace(&budgeted.blackboard) == expectedTrace);
+                // a Tree cannot wait for facts
+                if (!tree.waits)
+                    same &= (results[2] == expected) && (trace(blackboard.get()) == expectedTrace);
+                for (size_t agent = 0; agent < BatchAgents; agent++) {
+                    same &= ((int)batchResults[agent] == expected) &&
+                            (trace(&batch.getAgent(agent).blackboard) == expectedTrace);
+                }
+                if (!same) {
+                    printf("%s tree %d, tick %zu: bytecode %d, optimized %d, budgeted %d, tree %d, batch %d\n",
+                           mode == CompositeMode::Memory ? "memory" : "reactive", i, tick, expected, results[0],
+                           results[1], results[2], (int)batchResults[0]);
+                    return 1;
+                }
+            }
+#if BTVM_PROFILE
+            if (!countsAgree(plainProfile) || !countsAgree(fastProfile)) {
+                printf("tree %d: the profile's counts by pc and by opcode disagree\n", i);
+                return 1;
+            }
+            profiled += plainCounted + fastCounted;
+#endif
+        }
+    }
+    if (profiled)
+        printf("optimizer: %llu profiled instructions counted\n", (unsigned long long)profiled);
+    printf("optimizer: %zu ticks match, %zu -> %zu instructions, %zu -> %zu words\n", ticks,
+           total.instructionsBefore, total.instructionsAfter, total.sizeBefore, total.sizeAfter);
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include "ofxBehaviourTreePool.h"
+#include <chrono>
+#include <cstdio>
+
+/*
+ * Ticks a crowd of agents sharing one tree with AgentPool, on pools of
+ * 1, 2, 4, ... workers up to one per hardware thread, against ticking
+ * them one after the other on the calling thread. The calling thread
+ * helps the workers, so a pool of n workers ticks on n + 1 threads. Each
+ * figure is the best of several rounds.
+ */
+
+using namespace ofxAI::BehaviourTree;
+
+namespace {
+    const size_t Agents = 4096;
+    const int Ticks = 50;
+    const int Rounds = 5;
+
+    const FactId Seed = FactTable::intern("seed");
+
+    // a few hundred cycles of work that depends on the agent's facts
+    Node work(int id) {
+        return Node(BaseNode::NodeTick([id](Tree* tree, const std::vector<std::string>&) {
+            int value = 0;
+            tree->getBlackboard()->getFact(Seed, value);
+            uint32_t hash = value * 2654435761u + id;
+            for (int i = 0; i < 200; i++)
+                hash = (hash ^ (hash >> 13)) * 2246822519u;
+            return (hash % 3) ? Status::Success : Status::Failure;
+        }));
+    }
+
+    template <typename Tick>
+    double agentsPerSecond(Tick tick) {
+        double best = 1e30;
+        for (int round = 0; round < Rounds; round++) {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < Ticks; i++)
+                tick();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return Agents * Ticks / best;
+    }
+}
+
+int main() {
+    auto tree = Tree::compile(Selector({
+        Sequence({ work(1), work(2), Negate(work(3)) }),
+        Sequence({ ReturnTrue(work(4)), work(5) }),
+        Parallel(2, { work(6), work(7), work(8) }) }));
+
+    std::vector<Tree> serial;
+    for (size_t i = 0; i < Agents; i++) {
+        serial.emplace_back(tree, std::make_shared<SlotBlackboard>());
+        serial.back().getBlackboard()->setFact(Seed, (int)i);
+    }
+    std::vector<Status> results(Agents);
+    double base = agentsPerSecond([&] {
+        for (size_t i = 0; i < Agents; i++)
+            results[i] = serial[i].tick();
+    });
+    printf("%zu agents, %d ticks, in agent ticks per second:\n", Agents, Ticks);
+    printf("  serial      %10.0f\n", base);
+
+    size_t hardware = std::max(std::thread::hardware_concurrency(), 1u);
+    for (size_t workers = 1;; workers *= 2) {
+        workers = std::min(workers, hardware);
+        TaskPool pool(workers);
+        AgentPool agents(tree, pool);
+        for (size_t i = 0; i < Agents; i++)
+            agents.getAgent(agents.addAgent()).getBlackboard()->setFact(Seed, (int)i);
+        double rate = agentsPerSecond([&] { agents.tick(); });
+        printf("  %2zu workers  %10.0f  %.2fx\n", workers, rate, rate / base);
+        if (workers == hardware)
+            break;
+    }
+    return 0;
+}
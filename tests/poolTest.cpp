@@ -0,0 +1,73 @@
+#include "randomTrees.h"
+#include "ofxBehaviourTreePool.h"
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * Differential test for AgentPool: random trees tick on a pool of
+ * agents, with pools of several sizes and grains, and on as many Trees
+ * ticked one after the other. The agents hold different facts, so they
+ * take different paths; every tick each agent's result, stored at its
+ * index, has to be the one of its Tree, having ticked the same leaves.
+ *
+ *     poolTest [seed] [trees]
+ */
+
+using namespace RandomTrees;
+
+namespace {
+    const size_t Ticks = 8;
+    const size_t Agents = 37;
+}
+
+int main(int argc, char** argv) {
+    std::mt19937 rng(argc > 1 ? atoi(argv[1]) : 1);
+    int trees = argc > 2 ? atoi(argv[2]) : 300;
+
+    std::vector<std::unique_ptr<TaskPool>> pools;
+    for (size_t workers : { 1, 2, 4 })
+        pools.emplace_back(new TaskPool(workers));
+
+    size_t ticks = 0;
+    for (int i = 0; i < trees; i++) {
+        auto tree = generate(rng);
+        auto compiled = Tree::compile(tree.root);
+        AgentPool agents(compiled, *pools[i % pools.size()]);
+        agents.setGrain(1 + rng() % 8);
+        std::vector<Tree> serial;
+        clearTraces();
+        for (size_t agent = 0; agent < Agents; agent++) {
+            agents.addAgent();
+            serial.emplace_back(compiled, std::make_shared<SlotBlackboard>());
+            trace(agents.getAgent(agent).getBlackboard().get());
+            trace(serial[agent].getBlackboard().get());
+        }
+
+        for (size_t tick = 0; tick < Ticks; tick++, ticks += Agents) {
+            randomizeLeaves(rng);
+            // each fact change goes to a different set of agents
+            for (size_t change = rng() % 4; change > 0; change--) {
+                std::vector<Blackboard*> blackboards;
+                for (size_t agent = 0; agent < Agents; agent++) {
+                    if (rng() % 2) {
+                        blackboards.push_back(agents.getAgent(agent).getBlackboard().get());
+                        blackboards.push_back(serial[agent].getBlackboard().get());
+                    }
+                }
+                changeFact(rng, blackboards);
+            }
+            auto& results = agents.tick();
+            for (size_t agent = 0; agent < Agents; agent++) {
+                Status expected = serial[agent].tick();
+                if ((results[agent] != expected) ||
+                    (trace(agents.getAgent(agent).getBlackboard().get()) != trace(serial[agent].getBlackboard().get()))) {
+                    printf("tree %d, tick %zu, agent %zu: the pool ticked %d, the tree %d\n", i, tick, agent,
+                           (int)results[agent], (int)expected);
+                    return 1;
+                }
+            }
+        }
+    }
+    printf("pool: %zu agent ticks match\n", ticks);
+    return 0;
+}
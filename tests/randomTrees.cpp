@@ -0,0 +1,183 @@
+#include "randomTrees.h"
+#include <map>
+
+namespace {
+    using namespace RandomTrees;
+
+    const char* Facts[] = { "a", "b", "c" };
+
+    std::map<Blackboard const *, std::vector<int>> traces;
+
+    BaseNode::NodeTick namedLeaves[NamedLeaves] = {
+        leaf<0>, leaf<1>, leaf<2>, leaf<3>, leaf<4>, leaf<5>, leaf<6>, leaf<7>,
+        leaf<8>, leaf<9>, leaf<10>, leaf<11>, leaf<12>, leaf<13>, leaf<14>, leaf<15>
+    };
+
+    // turns Running into Failure
+    Status failRunning(Tree* tree, BaseNode* child, const std::vector<std::string>&) {
+        Status status = child->tick(tree);
+        return (status == Status::Running) ? Status::Failure : status;
+    }
+
+    // the node DSL builds composites from initializer lists only
+    template <typename Item, typename Make>
+    Node fromList(std::vector<Item> const & items, Make make) {
+        switch (items.size()) {
+        case 0: return make({});
+        case 1: return make({ items[0] });
+        case 2: return make({ items[0], items[1] });
+        case 3: return make({ items[0], items[1], items[2] });
+        default: return make({ items[0], items[1], items[2], items[3] });
+        }
+    }
+
+    class Generator {
+    public:
+        Generator(std::mt19937& rng, bool named) : m_rng(rng), m_named(named), m_waits(false) {}
+
+        RandomTree generate() {
+            Node root = node(0);
+            return { root, m_waits };
+        }
+    protected:
+        // reuses an earlier subtree now and then, which the compiler
+        // turns into calls
+        Node node(int depth) {
+            if (!m_shared.empty() && (pick(3) == 0))
+                return m_shared[pick(m_shared.size())];
+            Node n = newNode(depth);
+            if (pick(2))
+                m_shared.push_back(n);
+            return n;
+        }
+
+        Node newNode(int depth) {
+            switch (pick(depth > 3 ? 3 : 15)) {
+            case 0:
+            case 1:
+                return leafNode();
+            case 2:
+                return factNode();
+            case 3:
+                return Negate(node(depth + 1));
+            case 4:
+                if (pick(2))
+                    return ReturnTrue(node(depth + 1));
+                return ReturnFalse(node(depth + 1));
+            case 5:
+                if (m_named)
+                    return Node("FailRunning", failRunning, node(depth + 1));
+                return Node(BaseNode::NodeDecorate(failRunning), node(depth + 1));
+            case 6:
+                return fromList(children(depth), [](std::initializer_list<Node> nodes) { return Sequence(nodes); });
+            case 7:
+                return fromList(children(depth), [](std::initializer_list<Node> nodes) { return Selector(nodes); });
+            case 8:
+                return fromList(children(depth), [](std::initializer_list<Node> nodes) { return UntilFalse(nodes); });
+            case 9:
+                return fromList(children(depth), [](std::initializer_list<Node> nodes) { return UntilTrue(nodes); });
+            case 10:
+                return fromList(children(depth), [](std::initializer_list<Node> nodes) { return MemSequence(nodes); });
+            case 11:
+                return fromList(children(depth), [](std::initializer_list<Node> nodes) { return MemSelector(nodes); });
+            case 12:
+            {
+                auto nodes = children(depth);
+                size_t success = 1 + pick(nodes.size() + 1), failure = 1 + pick(nodes.size() + 1);
+                return fromList(nodes, [=](std::initializer_list<Node> list) {
+                    return Parallel(success, failure, list);
+                });
+            }
+            default:
+            {
+                std::vector<Strategy> strategies;
+                for (size_t i = 1 + pick(4); i > 0; i--)
+                    strategies.push_back(Strategy(node(depth + 1), node(depth + 1)));
+                return fromList(strategies, [](std::initializer_list<Strategy> list) { return Decision(list); });
+            }
+            }
+        }
+
+        std::vector<Node> children(int depth) {
+            std::vector<Node> nodes;
+            for (size_t i = pick(4); i > 0; i--)
+                nodes.push_back(node(depth + 1));
+            return nodes;
+        }
+
+        Node leafNode() {
+            int id = (int)pick(m_named ? NamedLeaves : Leaves);
+            if (id < NamedLeaves)
+                return Node("L" + std::to_string(id), namedLeaves[id]);
+            return Node(BaseNode::NodeTick([id](Tree* tree, const std::vector<std::string>&) {
+                trace(tree->getBlackboard().get()).push_back(id);
+                return leafStatus[id];
+            }));
+        }
+
+        Node factNode() {
+            std::string fact = Facts[pick(3)];
+            switch (pick(9)) {
+            case 0: return FactExists(fact);
+            case 1: return SetFactConst(fact, "1");
+            case 2: return FactEqualsConst(fact, "1");
+            case 3: return SetFactValue(fact, Value(1));
+            case 4: return FactEqualsValue(fact, Value(1));
+            case 5: return FactEqualsValue(fact, Value(1.0f));
+            case 6: return SetFactValue(fact, Value(2.5f));
+            case 7:
+                m_waits = true;
+                return WaitForFact(fact);
+            default: return RemoveFact(fact);
+            }
+        }
+
+        size_t pick(size_t count) {
+            return m_rng() % count;
+        }
+
+        std::mt19937& m_rng;
+        bool m_named;
+        std::vector<Node> m_shared;
+        bool m_waits;
+    };
+}
+
+namespace RandomTrees {
+    Status leafStatus[Leaves];
+
+    std::vector<int>& trace(Blackboard const * blackboard) {
+        auto found = traces.find(blackboard);
+        return (found != traces.end()) ? found->second : traces[blackboard];
+    }
+
+    void clearTraces() {
+        traces.clear();
+    }
+
+    RandomTree generate(std::mt19937& rng, bool named) {
+        return Generator(rng, named).generate();
+    }
+
+    void registerNamed(ofxAI::BTVM::BehaviorTreeVMRegistry& registry) {
+        for (int id = 0; id < NamedLeaves; id++)
+            registry.addLeaf("L" + std::to_string(id), namedLeaves[id]);
+        registry.addDecorator("FailRunning", failRunning);
+    }
+
+    void randomizeLeaves(std::mt19937& rng) {
+        for (auto& status : leafStatus)
+            status = (rng() % 10 == 0) ? Status::Invalid : (Status)(1 + rng() % 3);
+    }
+
+    void changeFact(std::mt19937& rng, std::vector<Blackboard*> const & blackboards) {
+        std::string fact = Facts[rng() % 3];
+        bool set = rng() % 2;
+        for (auto blackboard : blackboards) {
+            if (set)
+                blackboard->setFact(fact, "1");
+            else
+                blackboard->removeFact(fact);
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "ofxBehaviourTreeVMImage.h"
+#include <random>
+
+/*
+ * Random behaviour trees for the differential tests: every node type the
+ * VM compiler handles, shared subtrees included, built from leaves whose
+ * results the test sets before each tick. Leaves record which of them
+ * ran on which blackboard, so runs can be compared leaf by leaf.
+ */
+namespace RandomTrees {
+    using namespace ofxAI::BehaviourTree;
+
+    // leaves 0 to NamedLeaves - 1 are the functions below, registered
+    // under "L<id>"; the others are anonymous lambdas
+    const int NamedLeaves = 16;
+    const int Leaves = 20;
+
+    // what each leaf returns on the next tick
+    extern Status leafStatus[Leaves];
+
+    // the leaves ticked with a blackboard, in order; once a blackboard's
+    // trace exists, trees ticking it may run on any thread
+    std::vector<int>& trace(Blackboard const * blackboard);
+    void clearTraces();
+
+    template <int Id>
+    Status leaf(Tree* tree, const std::vector<std::string>&) {
+        trace(tree->getBlackboard().get()).push_back(Id);
+        return leafStatus[Id];
+    }
+
+    struct RandomTree {
+        Node root;
+        // WaitForFact parks VM threads, which a Tree cannot do
+        bool waits;
+    };
+    // 'named' trees only use named leaves and decorators, so their
+    // programs can be saved as images
+    RandomTree generate(std::mt19937& rng, bool named = false);
+    // registers the functions of named trees under their names
+    void registerNamed(ofxAI::BTVM::BehaviorTreeVMRegistry& registry);
+
+    // picks every leaf's next result, Invalid now and then
+    void randomizeLeaves(std::mt19937& rng);
+    // sets or removes one of the facts the trees use, on every blackboard
+    void changeFact(std::mt19937& rng, std::vector<Blackboard*> const & blackboards);
+}
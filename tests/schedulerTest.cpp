@@ -0,0 +1,190 @@
+#include "randomTrees.h"
+#include "ofxBehaviourTreeVMCompiler.h"
+#include "ofxBehaviourTreeVMScheduler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * Tests for BehaviorTreeVMScheduler: a handful of VMs running random
+ * programs share budgets of a few instructions per frame, and each is
+ * taken out of the scheduler once it finished its tick. Every frame has
+ * to stay within its budget, the VMs that ran have to be the ones
+ * following the last VM run the frame before, in order, and every VM
+ * has to finish its tick within a bounded number of frames, returning
+ * what a VM ticking the same program unbudgeted returned, having ticked
+ * the same leaves. Programs with decorators or parallels, which run to
+ * the end whatever the budget, are left out, and so are those that can
+ * stop on set_i, which takes no instruction, so every VM given a turn
+ * shows for it.
+ *
+ *     schedulerTest [seed] [sets of VMs]
+ */
+
+using namespace RandomTrees;
+namespace VM = ofxAI::BTVM;
+using ops = VM::BehaviorTreeVMProgram::ops;
+
+namespace {
+    const size_t Ticks = 6;
+    const size_t MaxVMs = 12;
+    const size_t MaxBudget = 8;
+    const size_t MaxFrames = 100000;
+
+    // forgets what its last run ran, so runs can be told from no run
+    class CountedVM : public VM::BehaviorTreeVM {
+    public:
+        using BehaviorTreeVM::BehaviorTreeVM;
+        void forgetRun() { m_instructionsRun = 0; }
+    };
+
+    class RoundRobin : public VM::BehaviorTreeVMScheduler {
+    public:
+        size_t next() const { return m_next; }
+    };
+
+    // a program that keeps to the budget it is given, and runs at least
+    // one instruction whenever it runs
+    std::shared_ptr<const VM::BehaviorTreeVMProgram> budgetedProgram(std::mt19937& rng) {
+        for (;;) {
+            auto tree = generate(rng);
+            if (tree.waits)
+                continue;
+            auto program = VM::BehaviorTreeVMCompiler::compile(tree.root, rng() % 2 ? CompositeMode::Memory
+                                                                                     : CompositeMode::Reactive);
+            bool unbudgeted = false;
+            for (size_t pc = 0; pc < program->codeSize(); pc++) {
+                auto opcode = program->code()[pc];
+                unbudgeted |= program->m_instructionStarts[pc] &&
+                              ((opcode == ops::run_dec::opcode) || (opcode == ops::run_par::opcode) ||
+                               (opcode == ops::set_i::opcode));
+            }
+            if (!unbudgeted)
+                return program;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    std::mt19937 rng(argc > 1 ? atoi(argv[1]) : 1);
+    int sets = argc > 2 ? atoi(argv[2]) : 300;
+
+    size_t frames = 0, finished = 0, removedMidRotation = 0;
+    for (int set = 0; set < sets; set++) {
+        size_t count = 2 + rng() % (MaxVMs - 1);
+        std::vector<std::unique_ptr<CountedVM>> vms;
+        std::vector<std::unique_ptr<VM::BehaviorTreeVM>> references;
+        for (size_t i = 0; i < count; i++) {
+            auto program = budgetedProgram(rng);
+            vms.emplace_back(new CountedVM(program));
+            references.emplace_back(new VM::BehaviorTreeVM(program));
+        }
+        RoundRobin scheduler;
+        clearTraces();
+
+        for (size_t tick = 0; tick < Ticks; tick++) {
+            randomizeLeaves(rng);
+            for (size_t change = rng() % 3; change > 0; change--) {
+                std::vector<Blackboard*> blackboards;
+                for (size_t i = 0; i < count; i++) {
+                    if (rng() % 2) {
+                        blackboards.push_back(&vms[i]->blackboard);
+                        blackboards.push_back(&references[i]->blackboard);
+                    }
+                }
+                changeFact(rng, blackboards);
+            }
+            std::vector<VM::Status> expected;
+            for (auto& reference : references)
+                expected.push_back(reference->run());
+
+            // the scheduler's VMs in its order, as add() and remove() keep it
+            std::vector<CountedVM*> order;
+            for (size_t i = 0; i < count; i++) {
+                scheduler.add(vms[i].get());
+                order.push_back(vms[i].get());
+            }
+            for (size_t frame = 0; !order.empty(); frame++, frames++) {
+                if (frame == MaxFrames) {
+                    printf("set %d, tick %zu: %zu VMs never finished\n", set, tick, order.size());
+                    return 1;
+                }
+                size_t budget = 1 + rng() % MaxBudget;
+                size_t first = scheduler.next();
+                for (auto* vm : order)
+                    vm->forgetRun();
+                size_t returned = scheduler.run(budget);
+
+                // every VM given a turn runs something, so those that ran
+                // come first, counting from the one the last frame left at
+                size_t total = 0, ran = 0;
+                bool inTurn = true;
+                for (size_t k = 0; k < order.size(); k++) {
+                    size_t instructions = order[(first + k) % order.size()]->getInstructionsRun();
+                    inTurn &= !instructions || (ran == k);
+                    ran += instructions != 0;
+                    total += instructions;
+                }
+                if (total > budget) {
+                    printf("set %d, tick %zu: a frame with a budget of %zu ran %zu instructions\n", set, tick,
+                           budget, total);
+                    return 1;
+                }
+                if (!inTurn || (scheduler.next() != (first + ran) % order.size())) {
+                    printf("set %d, tick %zu: the frame did not carry on from the VM after the last one\n", set,
+                           tick);
+                    return 1;
+                }
+
+                // the VMs done with their tick leave, in a random order,
+                // from anywhere in the rotation
+                std::vector<CountedVM*> done;
+                for (auto* vm : order) {
+                    if (vm->getInstructionsRun() && !vm->preempted())
+                        done.push_back(vm);
+                }
+                if (returned != done.size()) {
+                    printf("set %d, tick %zu: run() said %zu VMs finished, not %zu\n", set, tick, returned,
+                           done.size());
+                    return 1;
+                }
+                // the VM due next frame stays due, or the next one left
+                // after it in the rotation if it leaves itself
+                CountedVM* due = nullptr;
+                for (size_t k = 0; k < order.size() && !due; k++) {
+                    auto* vm = order[(scheduler.next() + k) % order.size()];
+                    if (std::find(done.begin(), done.end(), vm) == done.end())
+                        due = vm;
+                }
+                std::shuffle(done.begin(), done.end(), rng);
+                for (auto* vm : done) {
+                    size_t i = std::find_if(vms.begin(), vms.end(), [&](std::unique_ptr<CountedVM> const & owned) {
+                        return owned.get() == vm;
+                    }) - vms.begin();
+                    if ((vm->getStatus() != expected[i]) ||
+                        (trace(&vm->blackboard) != trace(&references[i]->blackboard))) {
+                        printf("set %d, tick %zu, VM %zu: the scheduled VM ticked %d, unbudgeted %d\n", set, tick,
+                               i, (int)vm->getStatus(), (int)expected[i]);
+                        return 1;
+                    }
+                    removedMidRotation += order.size() > 1;
+                    scheduler.remove(vm);
+                    order.erase(std::find(order.begin(), order.end(), vm));
+                    finished++;
+                }
+                if (scheduler.size() != order.size()) {
+                    printf("set %d, tick %zu: remove() left %zu VMs, not %zu\n", set, tick, scheduler.size(),
+                           order.size());
+                    return 1;
+                }
+                if (due && ((scheduler.next() >= order.size()) || (order[scheduler.next()] != due))) {
+                    printf("set %d, tick %zu: remove() moved the VM due next frame\n", set, tick);
+                    return 1;
+                }
+            }
+        }
+    }
+    printf("scheduler: %zu ticks finished in %zu frames, %zu VMs removed mid-rotation\n", finished, frames,
+           removedMidRotation);
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include "randomTrees.h"
+#include "ofxBehaviourTreeVMCompiler.h"
+#include "ofxBehaviourTreeVMOptimizer.h"
+#include "ofxBehaviourTreeVMSnapshot.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Tests for snapshots of random programs, some of them taken while a
+ * budgeted tick is preempted: ticking on after restoring a snapshot,
+ * into the same VM or a fresh one, has to repeat the ticks that followed
+ * it, and diff() and patch() have to turn one snapshot into another and
+ * back, whether it grew or shrank in between. restore() has to reject
+ * truncated snapshots, and snapshots with a thread anywhere but on an
+ * instruction of the program, leaving the VM alone; snapshots with
+ * random bytes flipped either restore or are rejected, and never crash
+ * the VM.
+ *
+ *     snapshotTest [seed] [trees per mode]
+ */
+
+using namespace RandomTrees;
+namespace VM = ofxAI::BTVM;
+using Snapshot = VM::BehaviorTreeVMSnapshot;
+using Bytes = std::vector<uint8_t>;
+
+namespace {
+    const size_t Ticks = 6;
+
+    // where thread records start, and their fields, in snapshots of
+    // version 3
+    const size_t HeaderSize = 44;
+    const size_t ThreadSize = 60;
+    const size_t PcField = 0, StartField = 4, ParentField = 16, CallDepthField = 24, ReturnsField = 28;
+
+    Bytes save(VM::BehaviorTreeVM const & vm) {
+        Bytes snapshot(Snapshot::size(vm));
+        if (Snapshot::save(vm, snapshot.data(), snapshot.size()) != snapshot.size()) {
+            printf("a snapshot did not fit in its size\n");
+            exit(1);
+        }
+        return snapshot;
+    }
+
+    // runs ticks driven by 'seed', returning their results and trace
+    std::vector<int> replay(VM::BehaviorTreeVM& vm, unsigned seed) {
+        std::mt19937 rng(seed);
+        clearTraces();
+        std::vector<int> results;
+        for (size_t tick = 0; tick < Ticks; tick++) {
+            randomizeLeaves(rng);
+            if (rng() % 3 == 0)
+                changeFact(rng, { &vm.blackboard });
+            results.push_back((int)vm.run());
+        }
+        auto& ticked = trace(&vm.blackboard);
+        results.insert(results.end(), ticked.begin(), ticked.end());
+        return results;
+    }
+
+    // a string fact of random length, so snapshots grow and shrink
+    void setText(VM::BehaviorTreeVM& vm, std::mt19937& rng) {
+        vm.blackboard.setFact("text", std::string(rng() % 40, 't'));
+    }
+
+    bool roundTrip(Bytes const & from, Bytes const & to) {
+        Bytes delta(to.size() * 2 + 64);
+        size_t size = Snapshot::diff(from.data(), from.size(), to.data(), to.size(), delta.data(), delta.size());
+        Bytes patched(from);
+        patched.resize(std::max(from.size(), to.size()));
+        return size && (Snapshot::patch(patched.data(), from.size(), patched.size(), delta.data(), size) == to.size()) &&
+               !std::memcmp(patched.data(), to.data(), to.size());
+    }
+
+    void put(Bytes& snapshot, size_t at, int32_t value) {
+        std::memcpy(snapshot.data() + at, &value, sizeof(value));
+    }
+
+    int32_t get(Bytes const & snapshot, size_t at) {
+        int32_t value;
+        std::memcpy(&value, snapshot.data() + at, sizeof(value));
+        return value;
+    }
+
+    // snapshots no VM running 'program' may accept, each one value off
+    std::vector<Bytes> corruptions(Bytes const & snapshot, VM::BehaviorTreeVMProgram const & program) {
+        std::vector<Bytes> corrupt;
+        auto change = [&](size_t at, int32_t value) {
+            corrupt.push_back(snapshot);
+            put(corrupt.back(), at, value);
+        };
+        change(0, 0);        // magic
+        change(4, 2);        // version
+        change(8, (int32_t)snapshot.size() + 4);
+        change(12, (int32_t)program.codeSize() + 1);
+        change(16, (int32_t)program.m_threadEntries.size() + 1);
+
+        int32_t operand = -1;
+        for (size_t pc = 0; pc < program.codeSize(); pc++) {
+            if (!program.m_instructionStarts[pc])
+                operand = (int32_t)pc;
+        }
+        for (size_t i = 0; i < program.m_threadEntries.size(); i++) {
+            size_t record = HeaderSize + i * ThreadSize;
+            change(record + PcField, -1);
+            change(record + PcField, (int32_t)program.codeSize());
+            if (operand >= 0)
+                change(record + PcField, operand);
+            change(record + StartField, get(snapshot, record + StartField) + 1);
+            change(record + ParentField, (int32_t)program.m_threadEntries.size());
+            change(record + CallDepthField, VM::BehaviorTreeVMThread::MaxCallDepth + 1);
+            for (int32_t depth = 0; depth < get(snapshot, record + CallDepthField); depth++) {
+                if (operand >= 0)
+                    change(record + ReturnsField + 4 * depth, operand);
+                change(record + ReturnsField + 4 * depth, (int32_t)program.codeSize() + 2);
+            }
+        }
+        corrupt.push_back(snapshot);
+        corrupt.back().push_back(0);
+        return corrupt;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::mt19937 rng(argc > 1 ? atoi(argv[1]) : 1);
+    int trees = argc > 2 ? atoi(argv[2]) : 2000;
+
+    size_t restored = 0, grown = 0, shrunk = 0, rejected = 0, flipped = 0;
+    for (auto mode : { CompositeMode::Reactive, CompositeMode::Memory }) {
+        for (int i = 0; i < trees; i++) {
+            auto tree = generate(rng);
+            auto program = VM::BehaviorTreeVMCompiler::compile(tree.root, mode);
+            if (rng() % 2)
+                program = VM::BehaviorTreeVMOptimizer::optimize(*program);
+
+            // run into some state, maybe stopping a tick part of the way
+            VM::BehaviorTreeVM vm(program);
+            for (size_t tick = rng() % 4; tick > 0; tick--) {
+                randomizeLeaves(rng);
+                if (rng() % 3 == 0)
+                    changeFact(rng, { &vm.blackboard });
+                vm.run();
+            }
+            if (rng() % 2)
+                vm.run(1 + rng() % 12);
+            setText(vm, rng);
+            Bytes before = save(vm);
+
+            unsigned seed = rng();
+            auto expected = replay(vm, seed);
+            setText(vm, rng);
+            Bytes after = save(vm);
+            if (!roundTrip(before, after) || !roundTrip(after, before)) {
+                printf("tree %d: diff and patch did not round-trip\n", i);
+                return 1;
+            }
+            grown += after.size() > before.size();
+            shrunk += after.size() < before.size();
+
+            VM::BehaviorTreeVM fresh(program);
+            fresh.blackboard.setFact("other", "1");
+            for (VM::BehaviorTreeVM* target : { &vm, &fresh }) {
+                if (!Snapshot::restore(*target, before.data(), before.size()) || (replay(*target, seed) != expected)) {
+                    printf("%s tree %d: ticks after restoring differ\n",
+                           mode == CompositeMode::Memory ? "memory" : "reactive", i);
+                    return 1;
+                }
+                restored++;
+            }
+
+            // the VM has to be left as it was when restoring fails
+            Bytes state = save(vm);
+            auto bad = corruptions(before, *program);
+            for (size_t size : { size_t(0), HeaderSize - 1, HeaderSize, before.size() / 2, before.size() - 1 })
+                bad.push_back(Bytes(before.begin(), before.begin() + size));
+            for (auto& snapshot : bad) {
+                if (Snapshot::restore(vm, snapshot.data(), snapshot.size()) || (save(vm) != state)) {
+                    printf("tree %d: a corrupt snapshot was restored\n", i);
+                    return 1;
+                }
+                rejected++;
+            }
+
+            Bytes noise = before;
+            for (int flip = 0; flip < 4; flip++)
+                noise[rng() % noise.size()] ^= uint8_t(1 << rng() % 8);
+            if (Snapshot::restore(fresh, noise.data(), noise.size())) {
+                replay(fresh, seed);
+                flipped++;
+            }
+        }
+    }
+    if (!grown || !shrunk) {
+        printf("no snapshot grew or none shrank\n");
+        return 1;
+    }
+    printf("snapshot: %zu restores replay, %zu grew, %zu shrank, %zu corrupt ones rejected, %zu noisy ones ran\n",
+           restored, grown, shrunk, rejected, flipped);
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "ofxBehaviourTreeStatic.h"
+#include <cstdio>
+#include <random>
+
+/*
+ * Static trees against their Node DSL namesakes ticked by a Tree, whose
+ * composites are reactive unless they are Mem ones, as a static tree's
+ * are: each pair ticks leaves that draw their results from the same random sequence,
+ * and every tick both have to return the same status, having ticked the
+ * same leaves. The trees put memory composites and parallels under
+ * selectors and sequences that skip them now and then, so their
+ * preemption is compared too, and both are reset halfway through.
+ *
+ * Built as C++14, which ofxBehaviourTreeStatic.h sticks to.
+ */
+
+using namespace ofxAI::BehaviourTree;
+namespace S = ofxAI::BehaviourTree::Static;
+
+namespace {
+    const int Runs = 200;
+    const int Ticks = 60;
+
+    struct Agent {
+        std::mt19937 rng;
+        std::vector<int> trace;
+
+        Status next(int id) {
+            trace.push_back(id);
+            switch (rng() % 8) {
+            case 0: case 1: case 2: return Status::Success;
+            case 3: case 4: case 5: return Status::Failure;
+            case 6: return Status::Running;
+            default: return id == 9 ? Status::Invalid : Status::Running;
+            }
+        }
+    };
+
+    // the Tree's leaves have no context, so they tick this agent
+    Agent* current = nullptr;
+
+    template <int Id>
+    Status leaf(Agent& agent) {
+        return agent.next(Id);
+    }
+
+    template <int Id>
+    bool condition(Agent& agent) {
+        return agent.next(Id) == Status::Success;
+    }
+
+    struct Functor7 {
+        Status operator()(Agent& agent) const { return agent.next(7); }
+    };
+
+    Node L(int id) {
+        return Node([id](Tree*, const std::vector<std::string>&) { return current->next(id); });
+    }
+
+    Node C(int id) {
+        return Node([id](Tree*, const std::vector<std::string>&) {
+            return current->next(id) == Status::Success ? Status::Success : Status::Failure;
+        });
+    }
+
+    using Plain = S::Selector<S::Sequence<BT_STATIC_LEAF(condition<1>), BT_STATIC_LEAF(leaf<2>)>,
+                              S::Negate<BT_STATIC_LEAF(leaf<3>)>, S::Functor<Functor7>>;
+    Node plain() {
+        return Selector({ Sequence({ C(1), L(2) }), Negate(L(3)), L(7) });
+    }
+
+    using Memory = S::MemSequence<BT_STATIC_LEAF(leaf<1>),
+                                  S::MemSelector<BT_STATIC_LEAF(leaf<2>), S::ReturnFalse<BT_STATIC_LEAF(leaf<3>)>>,
+                                  S::UntilTrue<BT_STATIC_LEAF(leaf<4>), BT_STATIC_LEAF(leaf<9>)>,
+                                  S::ReturnTrue<BT_STATIC_LEAF(leaf<5>)>>;
+    Node memory() {
+        return MemSequence({ L(1), MemSelector({ L(2), ReturnFalse(L(3)) }), UntilTrue({ L(4), L(9) }), ReturnTrue(L(5)) });
+    }
+
+    // the selector skips the memory sequence and the parallel whenever
+    // the child before them succeeds, preempting them
+    using Preempted = S::Selector<BT_STATIC_LEAF(condition<8>),
+                                  S::MemSequence<BT_STATIC_LEAF(leaf<1>), BT_STATIC_LEAF(leaf<2>), BT_STATIC_LEAF(leaf<3>)>,
+                                  BT_STATIC_LEAF(condition<8>),
+                                  S::Parallel<2, 2, BT_STATIC_LEAF(leaf<4>),
+                                              S::MemSequence<BT_STATIC_LEAF(leaf<5>), BT_STATIC_LEAF(leaf<6>)>,
+                                              BT_STATIC_LEAF(leaf<7>)>>;
+    Node preempted() {
+        return Selector({ C(8), MemSequence({ L(1), L(2), L(3) }), C(8),
+                          Parallel(2, 2, { L(4), MemSequence({ L(5), L(6) }), L(7) }) });
+    }
+
+    using Mixed = S::Sequence<S::Parallel<2, 2, BT_STATIC_LEAF(leaf<1>),
+                                          S::MemSequence<BT_STATIC_LEAF(leaf<2>), BT_STATIC_LEAF(leaf<3>)>,
+                                          BT_STATIC_LEAF(leaf<4>)>,
+                              S::Selector<S::MemSequence<BT_STATIC_LEAF(leaf<5>), BT_STATIC_LEAF(leaf<6>)>,
+                                          BT_STATIC_LEAF(leaf<9>)>,
+                              S::UntilFalse<BT_STATIC_LEAF(leaf<7>)>>;
+    Node mixed() {
+        return Sequence({ Parallel(2, 2, { L(1), MemSequence({ L(2), L(3) }), L(4) }),
+                          Selector({ MemSequence({ L(5), L(6) }), L(9) }), UntilFalse({ L(7) }) });
+    }
+
+    template <typename Root>
+    bool compare(const char* name, Node const & root, unsigned seed) {
+        for (int run = 0; run < Runs; run++) {
+            Agent expected{ std::mt19937(seed * 1000 + run), {} };
+            Agent actual{ std::mt19937(seed * 1000 + run), {} };
+            S::Tree<Root> tree;
+            Tree reference(root, std::make_shared<SlotBlackboard>());
+            current = &expected;
+            for (int tick = 0; tick < Ticks; tick++) {
+                if (tick == Ticks / 2) {
+                    tree.reset();
+                    reference.reset();
+                }
+                Status status = reference.tick();
+                if ((tree.tick(actual) != status) || (actual.trace != expected.trace)) {
+                    printf("%s, run %d, tick %d: the static tree differs\n", name, run, tick);
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+int main() {
+    if (!compare<Plain>("plain", plain(), 1) || !compare<Memory>("memory", memory(), 2) ||
+        !compare<Preempted>("preempted", preempted(), 3) || !compare<Mixed>("mixed", mixed(), 4))
+        return 1;
+    printf("static: %d ticks match\n", 4 * Runs * Ticks);
+    return 0;
+}
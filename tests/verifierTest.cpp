@@ -0,0 +1,142 @@
+#include "ofxBehaviourTreeVMVerifier.h"
+#include <cstdio>
+#include <functional>
+
+/*
+ * Negative tests for the verifier: every case is a small hand-written
+ * program that links, and one corruption of it, usually a single
+ * operand, that link() has to reject for the reason given. VMs must not
+ * load the corrupted program either.
+ */
+
+namespace VM = ofxAI::BTVM;
+using Program = VM::BehaviorTreeVMProgram;
+using ops = Program::ops;
+using op_type = Program::op_type;
+
+namespace {
+    struct Spec {
+        Spec(std::vector<op_type> code, std::vector<size_t> threads = { 0 }, std::vector<size_t> decorators = {})
+            : code(code), threads(threads), decorators(decorators) {}
+
+        std::vector<op_type> code;
+        std::vector<size_t> threads;
+        // child thread of each decorator
+        std::vector<size_t> decorators;
+    };
+
+    struct Case {
+        const char* name;
+        Spec spec;
+        std::function<void(Spec&)> corrupt;
+        // part of the error the verifier has to give
+        const char* error;
+    };
+
+    std::shared_ptr<Program> build(Spec const & spec) {
+        auto program = std::make_shared<Program>();
+        program->m_program = spec.code;
+        for (size_t start : spec.threads)
+            program->m_threadEntries.push_back({ start, ofxAI::BehaviourTree::CompositeMode::Reactive });
+        program->m_leaves.push_back([](VM::BehaviorTreeVMThread*, VM::DictBlackboard*) { return VM::Status::Success; });
+        for (size_t child : spec.decorators) {
+            program->m_decoratorNodes.push_back([](VM::BehaviorTreeVMThread*, VM::DictBlackboard*) { return VM::Status::Success; });
+            Program::Symbol symbol;
+            symbol.kind = Program::Symbol::Kind::Decorator;
+            symbol.child = child;
+            program->m_decoratorSymbols.push_back(symbol);
+        }
+        program->m_stringTable = { "verifierTest" };
+        program->m_constants = { ofxAI::BehaviourTree::Value(1) };
+        return program;
+    }
+
+    // the call chain of 'calls' subroutines, each calling the next
+    Spec nestedCalls(size_t calls) {
+        Spec spec({ ops::call::opcode, 3, ops::end::opcode });
+        for (size_t i = 1; i < calls; i++) {
+            spec.code.insert(spec.code.end(), { ops::call::opcode, 3, ops::ret::opcode });
+        }
+        spec.code.insert(spec.code.end(), { ops::set_t::opcode, ops::ret::opcode });
+        return spec;
+    }
+
+    std::vector<Case> cases() {
+        const op_type MaxCalls = VM::BehaviorTreeVMThread::MaxCallDepth;
+        Spec leaf = { { ops::run::opcode, 0, ops::end::opcode } };
+        Spec branch = { { ops::bra_f::opcode, 3, ops::set_t::opcode, ops::end::opcode } };
+        Spec subthread = { { ops::run_thr::opcode, 1, ops::end::opcode, ops::set_t::opcode, ops::end::opcode }, { 0, 3 } };
+        Spec resume = { { ops::rsm_thr::opcode, 1, 3, ops::end::opcode, ops::set_t::opcode, ops::end::opcode }, { 0, 4 } };
+        Spec parallel = { { ops::run_par::opcode, 1, 2, 1, 1, ops::end::opcode, ops::set_t::opcode, ops::end::opcode },
+                          { 0, 6, 6 } };
+        Spec decorator = { { ops::run_dec::opcode, 0, ops::end::opcode, ops::set_t::opcode, ops::end::opcode }, { 0, 3 }, { 1 } };
+        // both ways out of the branch reach a call, which returns
+        Spec call = { { ops::bra_f::opcode, 2, ops::call::opcode, 4, ops::end::opcode, ops::end::opcode,
+                        ops::set_t::opcode, ops::ret::opcode } };
+
+        return {
+            { "unknown opcode", leaf, [](Spec& s) { s.code[0] = 99; }, "unknown opcode" },
+            { "unimplemented opcode", leaf, [](Spec& s) { s.code[0] = ops::dbg_break::opcode; }, "unknown opcode" },
+            { "truncated operands", leaf, [](Spec& s) { s.code.resize(1); }, "operands run past the end" },
+            { "running off the end", leaf, [](Spec& s) { s.code[2] = ops::set_t::opcode; }, "runs off its end" },
+            { "leaf index", leaf, [](Spec& s) { s.code[1] = 1; }, "leaf 1 does not exist" },
+            { "negative leaf index", leaf, [](Spec& s) { s.code[1] = -1; }, "leaf -1 does not exist" },
+            { "decorator index", decorator, [](Spec& s) { s.code[1] = 1; }, "decorator 1 does not exist" },
+            { "string index", { { ops::chk_fact::opcode, 0, ops::end::opcode } }, [](Spec& s) { s.code[1] = 1; },
+              "string 1 does not exist" },
+            { "constant index", { { ops::set_fact::opcode, 0, 0, ops::end::opcode } }, [](Spec& s) { s.code[2] = 1; },
+              "constant 1 does not exist" },
+            { "branch into an operand", branch, [](Spec& s) { s.code[1] = 1; }, "does not land on an instruction" },
+            { "branch past the end", branch, [](Spec& s) { s.code[1] = 40; }, "does not land on an instruction" },
+            { "branch before the start", branch, [](Spec& s) { s.code[1] = -1; }, "does not land on an instruction" },
+            { "thread start", subthread, [](Spec& s) { s.threads[1] = 1; }, "does not start on an instruction" },
+            { "thread index", subthread, [](Spec& s) { s.code[1] = 2; }, "thread 2 does not exist" },
+            { "parallel thread count", parallel, [](Spec& s) { s.code[2] = 3; }, "thread 3 does not exist" },
+            { "parallel threshold", parallel, [](Spec& s) { s.code[3] = -1; }, "bad parallel thread count or thresholds" },
+            { "ret outside of a call", call, [](Spec& s) { s.code[1] = 6; }, "ret outside of a call" },
+            { "calls nesting too deep", nestedCalls(MaxCalls),
+              [=](Spec& s) { s.code[3 * (MaxCalls - 1) + 1] = 0; }, "calls nest deeper than" },
+            { "thread running itself", subthread, [](Spec& s) { s.code[1] = 0; }, "thread 0 runs itself" },
+            { "thread resuming itself", resume, [](Spec& s) { s.code[1] = 0; }, "thread 0 runs itself" },
+            { "parallel running itself", parallel, [](Spec& s) { s.code[1] = 0; }, "thread 0 runs itself" },
+            { "threads running each other", subthread,
+              [](Spec& s) { s.code[3] = ops::run_thr::opcode; s.code[4] = 0; s.code.push_back(ops::end::opcode); },
+              "runs itself" },
+            { "decorator running itself", decorator, [](Spec& s) { s.decorators[0] = 0; }, "thread 0 runs itself" },
+            { "decorator child", decorator, [](Spec& s) { s.decorators[0] = 2; }, "runs thread 2, which does not exist" },
+        };
+    }
+}
+
+int main() {
+    int failures = 0;
+    auto all = cases();
+    for (auto& c : all) {
+        auto valid = build(c.spec);
+        if (!valid->link()) {
+            std::string error;
+            VM::BehaviorTreeVMVerifier::verify(*valid, &error);
+            printf("%s: the valid program did not link: %s\n", c.name, error.c_str());
+            failures++;
+            continue;
+        }
+        Spec spec = c.spec;
+        c.corrupt(spec);
+        auto corrupt = build(spec);
+        std::string error;
+        bool linked = corrupt->link();
+        VM::BehaviorTreeVMVerifier::verify(*corrupt, &error);
+        VM::BehaviorTreeVM vm(corrupt);
+        if (linked || vm.getProgram()) {
+            printf("%s: the corrupt program was accepted\n", c.name);
+            failures++;
+        } else if (error.find(c.error) == std::string::npos) {
+            printf("%s: expected \"%s\", got \"%s\"\n", c.name, c.error, error.c_str());
+            failures++;
+        }
+    }
+    if (failures)
+        return 1;
+    printf("verifier: %zu corruptions rejected\n", all.size());
+    return 0;
+}
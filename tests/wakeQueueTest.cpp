@@ -0,0 +1,148 @@
+#include "ofxBehaviourTreeVMWakeQueue.h"
+#include <cstdio>
+#include <thread>
+#include <unordered_map>
+
+/*
+ * Tests for BehaviorTreeVMWakeQueue: producers on several threads push a
+ * wakeup for each of a crowd of parked VMs into a small queue, retrying
+ * while it is full, as the main thread drains it; every VM has to be
+ * woken exactly once. Then, on one thread, a full queue has to refuse
+ * pushes until a wakeup is taken, wakeups have to come out in order, and
+ * all of that again with positions wrapping around.
+ *
+ * make tsan runs it built with -fsanitize=thread.
+ */
+
+namespace VM = ofxAI::BTVM;
+using ops = VM::BehaviorTreeVMProgram::ops;
+
+namespace {
+    const size_t Producers = 4;
+    const size_t PerProducer = 1000;
+    const size_t Capacity = 64;
+
+    // leaf runs by VM, counted on the thread draining the queue
+    std::unordered_map<VM::BehaviorTreeVM const *, size_t> runs;
+
+    // a root that parks on a leaf, and is run again when woken
+    std::shared_ptr<VM::BehaviorTreeVMProgram> parkingProgram() {
+        auto program = std::make_shared<VM::BehaviorTreeVMProgram>();
+        program->m_program = { ops::run::opcode, 0, ops::end::opcode };
+        program->m_threadEntries.push_back({ 0, ofxAI::BehaviourTree::CompositeMode::Reactive });
+        program->m_leaves.push_back([](VM::BehaviorTreeVMThread* thread, VM::DictBlackboard*) {
+            runs[thread->m_vm]++;
+            return VM::Status::Suspended;
+        });
+        program->link();
+        return program;
+    }
+
+    // a queue whose positions start 'start' pushes before they wrap
+    class WrappingQueue : public VM::BehaviorTreeVMWakeQueue {
+    public:
+        WrappingQueue(size_t capacity, size_t start) : BehaviorTreeVMWakeQueue(capacity) {
+            m_head = size_t(0) - start;
+            m_tail.store(m_head);
+            for (size_t i = 0; i <= m_mask; i++)
+                m_cells[(m_head + i) & m_mask].sequence.store(m_head + i);
+        }
+    };
+
+    bool fail(const char* what) {
+        printf("%s\n", what);
+        return false;
+    }
+
+    bool concurrentPushes() {
+        auto program = parkingProgram();
+        std::vector<std::unique_ptr<VM::BehaviorTreeVM>> vms;
+        for (size_t i = 0; i < Producers * PerProducer; i++) {
+            vms.emplace_back(new VM::BehaviorTreeVM(program));
+            vms.back()->run();
+        }
+        runs.clear();
+
+        VM::BehaviorTreeVMWakeQueue queue(Capacity);
+        std::atomic<size_t> finished(0), full(0);
+        std::vector<std::thread> producers;
+        for (size_t p = 0; p < Producers; p++) {
+            producers.emplace_back([&, p] {
+                for (size_t i = p * PerProducer; i < (p + 1) * PerProducer; i++) {
+                    while (!queue.push(vms[i].get(), 0)) {
+                        full++;
+                        std::this_thread::yield();
+                    }
+                }
+                finished++;
+            });
+        }
+        size_t drained = 0;
+        while (finished < Producers)
+            drained += queue.drain();
+        for (auto& producer : producers)
+            producer.join();
+        drained += queue.drain();
+
+        for (auto& vm : vms)
+            vm->run();
+        if (drained != vms.size())
+            return fail("drain() did not deliver every wakeup once");
+        for (auto& vm : vms) {
+            if (runs[vm.get()] != 1)
+                return fail("a VM was not woken exactly once");
+        }
+        printf("wake queue: %zu wakeups from %zu threads, %zu pushes found it full\n", drained, Producers,
+               full.load());
+        return true;
+    }
+
+    bool fullQueue(VM::BehaviorTreeVMWakeQueue& queue) {
+        VM::BehaviorTreeVMWakeQueue::Wakeup wakeup;
+        size_t next = 0;
+        // a few laps, so positions wrap if the queue starts them near it
+        for (int lap = 0; lap < 3; lap++) {
+            for (size_t i = 0; i < queue.capacity(); i++) {
+                if (!queue.push(nullptr, next + i))
+                    return fail("push() failed before the queue was full");
+            }
+            if (queue.push(nullptr, 0))
+                return fail("push() succeeded on a full queue");
+            if (!queue.pop(wakeup) || (wakeup.thread != next++))
+                return fail("pop() did not take the oldest wakeup");
+            if (!queue.push(nullptr, next + queue.capacity() - 1) || queue.push(nullptr, 0))
+                return fail("push() did not take the one free cell");
+            for (size_t i = 0; i < queue.capacity(); i++) {
+                if (!queue.pop(wakeup) || (wakeup.thread != next++))
+                    return fail("wakeups did not come out in order");
+            }
+            if (queue.pop(wakeup))
+                return fail("pop() took a wakeup from an empty queue");
+        }
+        return true;
+    }
+
+    bool drainWhenFull() {
+        auto program = parkingProgram();
+        VM::BehaviorTreeVM vm(program);
+        vm.run();
+        runs.clear();
+        VM::BehaviorTreeVMWakeQueue queue(5);
+        if (queue.capacity() != 8)
+            return fail("the capacity was not rounded up to a power of two");
+        while (queue.push(&vm, 0))
+            ;
+        if ((queue.drain() != 8) || !queue.push(&vm, 0) || (queue.drain() != 1))
+            return fail("push() did not succeed again after a drain");
+        vm.run();
+        return (runs[&vm] == 1) || fail("waking a thread twice did not run it once");
+    }
+}
+
+int main() {
+    VM::BehaviorTreeVMWakeQueue plain(16);
+    WrappingQueue wrapping(16, 20);
+    if (!concurrentPushes() || !fullQueue(plain) || !fullQueue(wrapping) || !drainWhenFull())
+        return 1;
+    return 0;
+}